@@ -13,6 +13,7 @@
 #include "adc.h"
 
 #include "adc.pio.h"
+#include "max/max14866.h"
 
 //---------------------------------------------------------------------------
 // GLOBAL VARIABLES
@@ -29,6 +30,31 @@ uint dma_chan;
 dma_channel_config dma_chan_cfg;
 uint16_t buffer[SAMPLE_COUNT];
 
+volatile bool acq_done;     // set by the DMA interrupt
+bool acq_running;           // state machines and DMA are armed
+bool acq_pending;           // "start acq" waits for its completion message
+absolute_time_t acq_deadline;
+uint32_t pulse_ticks[3];    // pon, poff, damp in 8 ns cycles
+
+bool stream_active;
+uint64_t stream_period_us;
+uint64_t stream_next_us;
+uint32_t stream_sent;
+uint32_t stream_skipped;
+
+//---------------------------------------------------------------------------
+// ADC DMA IRQ HANDLER
+//---------------------------------------------------------------------------
+
+static void dma_irq_handler()
+{
+    if (dma_channel_get_irq0_status(dma_chan))
+    {
+        dma_channel_acknowledge_irq0(dma_chan);
+        acq_done = true;
+    }
+}
+
 //---------------------------------------------------------------------------
 // ADC INIT FUNCTION
 //---------------------------------------------------------------------------
@@ -51,7 +77,9 @@ void pio_adc_init()
     channel_config_set_read_increment(&dma_chan_cfg, false);
     channel_config_set_write_increment(&dma_chan_cfg, true);
     channel_config_set_dreq(&dma_chan_cfg, pio_get_dreq(pio_adc, sm, false));
-    // pio_enable_sm_mask_in_sync(pio_adc, ((1u << sm) | (1u << sm2) | (1u << sm3)));
+    dma_channel_set_irq0_enabled(dma_chan, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, dma_irq_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
 }
 
 //---------------------------------------------------------------------------
@@ -74,39 +102,70 @@ void pio_adc_clear_fifo()
     pio_sm_clear_fifos(pio_adc, sm3);
 }
 
-
-//---------------------------------------------------------------------------
-// PULSE ADC DMA TIMEOUT
-//---------------------------------------------------------------------------
-bool dma_wait_timeout(uint chan, uint32_t ms) {
-    absolute_time_t deadline = make_timeout_time_ms(ms);
-    while (dma_channel_is_busy(chan)) {
-        if (absolute_time_diff_us(get_absolute_time(), deadline) >= 0) {
-            return false;
-        }
-    }
-    return true;
-}
-
 //---------------------------------------------------------------------------
 // PULSE ADC RESTART SMs
 //---------------------------------------------------------------------------
-void reset_all_sms() {
+// Stops the three state machines and puts each back at the start of its
+// program, whatever it was doing when an acquisition was cut short.
+void reset_all_sms()
+{
     uint sms[] = { sm, sm2, sm3 };
+    uint offsets[] = { offset, offset2, offset3 };
+    pio_set_sm_mask_enabled(pio_adc, (1u << sm) | (1u << sm2) | (1u << sm3), false);
+    pio_adc_clear_fifo();
     for (int i = 0; i < 3; i++) {
-        pio_sm_set_enabled(pio_adc, sms[i], false);
         pio_sm_restart(pio_adc, sms[i]);
-        pio_sm_set_enabled(pio_adc, sms[i], true);
+        pio_sm_exec(pio_adc, sms[i], pio_encode_jmp(offsets[i]));
     }
+    // Write-1-to-clear; a stale flag would release pulse2 early.
+    pio_adc->irq = (1u << 0) | (1u << 1) | (1u << 2);
 }
 
 //---------------------------------------------------------------------------
-// PULSE ADC TRIGGER FUNCTION
+// PULSE ADC START / STOP
 //---------------------------------------------------------------------------
-void pulse_adc_trigger(const char *data)
+// All FIFOs are loaded while the state machines are stopped, then the three
+// are enabled on the same cycle.  The pulse-to-ADC timing is therefore fixed
+// by the PIO programs alone, not by when the CPU reaches each FIFO.
+void pulse_adc_start()
+{
+    reset_all_sms();
+    dma_channel_abort(dma_chan);
+    memset(buffer, 0x00, sizeof(buffer));
+    acq_done = false;
+    dma_channel_configure(dma_chan, &dma_chan_cfg, buffer, &pio_adc->rxf[sm], SAMPLE_COUNT, true);
+    pio_sm_put(pio_adc, sm, SAMPLE_COUNT);
+    pio_sm_put(pio_adc, sm3, pulse_ticks[2]);
+    pio_sm_put(pio_adc, sm2, pulse_ticks[0]);
+    pio_sm_put(pio_adc, sm2, pulse_ticks[1]);
+    acq_deadline = make_timeout_time_ms(DMA_TIMEOUT_MS);
+    acq_running = true;
+    pio_enable_sm_mask_in_sync(pio_adc, (1u << sm) | (1u << sm2) | (1u << sm3));
+}
+
+void pulse_adc_stop()
+{
+    pio_set_sm_mask_enabled(pio_adc, (1u << sm) | (1u << sm2) | (1u << sm3), false);
+    dma_channel_abort(dma_chan);
+    // Aborting can still raise the completion interrupt.
+    dma_channel_acknowledge_irq0(dma_chan);
+    acq_running = false;
+}
+
+bool pulse_adc_busy()
+{
+    return acq_pending || stream_active;
+}
+
+bool pulse_adc_streaming()
+{
+    return stream_active;
+}
+
+// Parses "<pon> <poff> <damp>" in nanoseconds; missing values are 1000 ns.
+static void parse_pulse_ticks(const char *data)
 {
     char *token;
-    uint32_t numbers[3];
     int i = 0;
 
     char data_copy[strlen(data) + 1];
@@ -116,27 +175,133 @@ void pulse_adc_trigger(const char *data)
     while (i < 3)
     {
         if (token != NULL)
-            numbers[i] = (atoi(token) / 8); // divide by 8 as one cycle is 8 nanoseconds
+            pulse_ticks[i] = (atoi(token) / 8); // divide by 8 as one cycle is 8 nanoseconds
         else
-            numbers[i] = 125; // default value
+            pulse_ticks[i] = 125; // default value
         i++;
         token = strtok(NULL, " ");
     }
-    pio_interrupt_clear(pio_adc, (1u<<0)|(1u<<1)|(1u<<2));
-    pio_adc_clear_fifo();
-    reset_all_sms();
-    memset(buffer, 0x00, SAMPLE_COUNT);
+}
+
+//---------------------------------------------------------------------------
+// PULSE ADC TRIGGER FUNCTION
+//---------------------------------------------------------------------------
+// Returns at once; pulse_adc_task() reports the end of the acquisition.
+void pulse_adc_trigger(const char *data)
+{
+    if (pulse_adc_busy())
+    {
+        printf("Acquisition busy\n");
+        return;
+    }
+    parse_pulse_ticks(data);
     printf("Acquisition of %d samples started\n", SAMPLE_COUNT);
-    dma_channel_configure(dma_chan, &dma_chan_cfg, buffer, &pio_adc->rxf[sm], SAMPLE_COUNT, true);
-    pio_sm_put_blocking(pio_adc, sm, SAMPLE_COUNT);
-    pio_sm_put_blocking(pio_adc, sm3, numbers[2]);
-    pio_sm_put_blocking(pio_adc, sm2, numbers[0]);
-    pio_sm_put_blocking(pio_adc, sm2, numbers[1]);
-    if (!dma_wait_timeout(dma_chan, DMA_TIMEOUT_MS)) {
-        printf("ADC timeout occured\n");
+    pulse_adc_start();
+    acq_pending = true;
+}
+
+//---------------------------------------------------------------------------
+// PULSE ADC STREAM FUNCTIONS
+//---------------------------------------------------------------------------
+void pulse_adc_stream_start(const char *data)
+{
+    char data_copy[strlen(data) + 1];
+    strcpy(data_copy, data);
+    char *rest;
+    char *prf_text = strtok_r(data_copy, " ", &rest);
+    int prf = prf_text != NULL ? atoi(prf_text) : 0;
+
+    if (pulse_adc_busy())
+    {
+        printf("Acquisition busy\n");
+        return;
+    }
+    if (prf < 1 || prf > STREAM_MAX_PRF_HZ)
+    {
+        printf("Stream rate must be 1..%d Hz\n", STREAM_MAX_PRF_HZ);
+        return;
+    }
+    parse_pulse_ticks(rest != NULL ? rest : "");
+    printf("Stream of %d samples at %d Hz started\n", SAMPLE_COUNT, prf);
+    // With a MUX table loaded, block n is acquired on pattern n modulo the
+    // table length; the first shot waits for pattern 0 to be latched.
+    max14866_rewind();
+    max14866_step();
+    stream_period_us = 1000000u / (uint32_t)prf;
+    stream_next_us = time_us_64();
+    stream_sent = 0;
+    stream_skipped = 0;
+    stream_active = true;
+}
+
+void pulse_adc_stream_stop(const char *data)
+{
+    if (!stream_active)
+    {
+        printf("No stream running\n");
+        return;
+    }
+    if (acq_running)
+    {
+        pulse_adc_stop();
     }
-    // dma_channel_wait_for_finish_blocking(dma_chan);
-    printf("Acquisition ended\n");
+    stream_active = false;
+    printf("Stream stopped after %lu acquisitions, %lu skipped\n",
+           (unsigned long)stream_sent, (unsigned long)stream_skipped);
+}
+
+//---------------------------------------------------------------------------
+// PULSE ADC TASK
+//---------------------------------------------------------------------------
+// Called from the command loop: finishes acquisitions and paces the stream.
+void pulse_adc_task()
+{
+    if (acq_running)
+    {
+        if (acq_done)
+        {
+            acq_running = false;
+            if (stream_active)
+            {
+                // The next pattern is latched by DMA and PIO while the
+                // block is sent.
+                max14866_step();
+                send_block();
+                stream_sent++;
+            }
+        }
+        else if (time_reached(acq_deadline))
+        {
+            pulse_adc_stop();
+            if (stream_active)
+                stream_skipped++;
+            else
+                printf("ADC timeout occured\n");
+        }
+        if (!acq_running && acq_pending)
+        {
+            acq_pending = false;
+            printf("Acquisition ended\n");
+        }
+    }
+
+    if (!stream_active)
+        return;
+    if (!stdio_usb_connected())
+    {
+        if (acq_running)
+            pulse_adc_stop();
+        stream_active = false;
+        return;
+    }
+    uint64_t now = time_us_64();
+    if (acq_running || now < stream_next_us || max14866_busy())
+        return;
+    // Shots that could not start on time are skipped rather than bunched.
+    uint64_t late = (now - stream_next_us) / stream_period_us;
+    stream_skipped += (uint32_t)late;
+    stream_next_us += (late + 1) * stream_period_us;
+    pulse_adc_start();
 }
 
 //---------------------------------------------------------------------------
@@ -145,6 +310,12 @@ void pulse_adc_trigger(const char *data)
 
 void adc(const char *data)
 {
+    if (pulse_adc_busy())
+    {
+        printf("Acquisition busy\n");
+        return;
+    }
+
     printf("----------Start of ACQ----------\n");
 
     for (uint16_t i = 0; i < SAMPLE_COUNT; ++i)
@@ -155,6 +326,80 @@ void adc(const char *data)
     printf("\n-----------End of ACQ-----------\n");
 }
 
+//---------------------------------------------------------------------------
+// ADC BINARY READ FUNCTIONS
+//---------------------------------------------------------------------------
+
+// CRC-32 (IEEE, as zlib.crc32), four bits at a time.
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    }
+    return crc;
+}
+
+static void put_u32(uint8_t *out, uint32_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+// Raw writes: stdio would otherwise turn every 0x0A byte into CR LF.
+static void put_bytes(const uint8_t *data, int len)
+{
+    stdio_put_string((const char *)data, len, false, false);
+}
+
+void send_block()
+{
+    uint8_t chunk[2 * BIN_CHUNK_SAMPLES];
+    uint8_t header[8] = { 'P', '0', 'R', 'B' };
+    uint8_t trailer[4];
+    uint32_t crc = 0xFFFFFFFF;
+
+    put_u32(&header[4], SAMPLE_COUNT * 2);
+    stdio_flush();
+    put_bytes(header, sizeof(header));
+    for (uint16_t i = 0; i < SAMPLE_COUNT; i += BIN_CHUNK_SAMPLES)
+    {
+        uint16_t n = SAMPLE_COUNT - i < BIN_CHUNK_SAMPLES ? SAMPLE_COUNT - i : BIN_CHUNK_SAMPLES;
+        for (uint16_t j = 0; j < n; ++j)
+        {
+            uint16_t value = (buffer[i + j] >> 1) & 0x3FF;
+            chunk[2 * j] = value & 0xFF;
+            chunk[2 * j + 1] = value >> 8;
+        }
+        crc = crc32_update(crc, chunk, 2 * n);
+        put_bytes(chunk, 2 * n);
+    }
+    put_u32(trailer, ~crc);
+    put_bytes(trailer, sizeof(trailer));
+    stdio_flush();
+}
+
+void adc_bin(const char *data)
+{
+    if (pulse_adc_busy())
+    {
+        printf("Acquisition busy\n");
+        return;
+    }
+    send_block();
+}
+
 //---------------------------------------------------------------------------
 // END OF FILE
 //---------------------------------------------------------------------------
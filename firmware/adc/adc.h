@@ -21,6 +21,7 @@
 #include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
+#include "hardware/irq.h"
 
 //---------------------------------------------------------------------------
 // CONSTANTS
@@ -35,6 +36,9 @@
 
 #define DMA_TIMEOUT_MS 3000
 
+#define BIN_CHUNK_SAMPLES 256
+#define STREAM_MAX_PRF_HZ 1000
+
 //---------------------------------------------------------------------------
 // ADC INIT FUNCTION
 //---------------------------------------------------------------------------
@@ -51,25 +55,50 @@ void pio_adc_dma();
 void pio_adc_clear_fifo();
 
 //---------------------------------------------------------------------------
-// PULSE ADC DMA TIMEOUT
+// PULSE ADC RESTART SMs
 //---------------------------------------------------------------------------
-bool dma_wait_timeout(uint chan, uint32_t ms);
+void reset_all_sms();
 
 //---------------------------------------------------------------------------
-// PULSE ADC RESTART SMs
+// PULSE ADC START / STOP
 //---------------------------------------------------------------------------
-void reset_all_sms();
+void pulse_adc_start();
+void pulse_adc_stop();
+bool pulse_adc_busy();
+bool pulse_adc_streaming();
 
 //---------------------------------------------------------------------------
 // PULSE ADC TRIGGER FUNCTION
 //---------------------------------------------------------------------------
 void pulse_adc_trigger(const char *data);
 
+//---------------------------------------------------------------------------
+// PULSE ADC STREAM FUNCTIONS
+//---------------------------------------------------------------------------
+// "start stream <prf_hz> <pon> <poff> <damp>" repeats the acquisition at a
+// fixed rate and sends each trace as an adc_bin() block until "stop stream".
+void pulse_adc_stream_start(const char *data);
+void pulse_adc_stream_stop(const char *data);
+
+//---------------------------------------------------------------------------
+// PULSE ADC TASK
+//---------------------------------------------------------------------------
+void pulse_adc_task();
+
 //---------------------------------------------------------------------------
 // ADC MAIN FUNCTION
 //---------------------------------------------------------------------------
 void adc(const char *data);
 
+//---------------------------------------------------------------------------
+// ADC BINARY READ FUNCTION
+//---------------------------------------------------------------------------
+// Sends the buffer as one block: "P0RB", uint32 payload length in bytes,
+// SAMPLE_COUNT uint16 samples (10-bit, as printed by adc()) and the CRC-32
+// of the payload, all little-endian.
+void send_block();
+void adc_bin(const char *data);
+
 //---------------------------------------------------------------------------
 // END OF FILE
 //---------------------------------------------------------------------------
@@ -18,11 +18,16 @@ typedef struct
 
 command_t command_list[] = {
     {"start acq", pulse_adc_trigger},
+    {"start stream", pulse_adc_stream_start},
+    {"stop stream", pulse_adc_stream_stop},
     {"write dac", dac},
     {"write mux", max14866},
     {"set mux", max14866_set},
     {"clear mux", max14866_clear},
+    {"load mux", max14866_load},
+    {"sweep mux", max14866_sweep},
     {"read", adc},
+    {"read bin", adc_bin},
 };
 
 void process_command(char *input)
@@ -64,24 +69,31 @@ void process_command(char *input)
     }
 }
 
-void read_input(char *buffer, int max_len)
+// Collects one line without blocking; returns true once it is complete.
+// Nothing is echoed while a stream owns the output.
+bool read_input(char *buffer, int max_len)
 {
-    int index = 0;
-    while (1)
+    static int index = 0;
+    bool echo = !pulse_adc_streaming();
+    int c;
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT)
     {
-        char ch = getchar();
+        char ch = (char)c;
         if (ch == '\r' || ch == '\n')
         {
             buffer[index] = '\0';
-            printf("\n");
-            return;
+            index = 0;
+            if (echo)
+                printf("\n");
+            return true;
         }
         else if (ch == 127 || ch == '\b')
         {
             if (index > 0)
             {
                 index--;
-                printf("\b \b");
+                if (echo)
+                    printf("\b \b");
             }
         }
         else if (ch >= 32 && ch <= 126)
@@ -89,10 +101,12 @@ void read_input(char *buffer, int max_len)
             if (index < max_len - 1)
             {
                 buffer[index++] = ch;
-                putchar(ch);
+                if (echo)
+                    putchar(ch);
             }
         }
     }
+    return false;
 }
 
 //---------------------------------------------------------------------------
@@ -115,11 +129,26 @@ int main()
     max14866_init();
     sleep_ms(100);
     char input[128];
+    bool prompt = true;
     while (true)
     {
-        printf("run> ");
-        fflush(stdout);
-        read_input(input, sizeof(input));
-        process_command(input);
+        pulse_adc_task();
+        // The prompt waits for a running acquisition to report its end.
+        if (prompt && !pulse_adc_busy())
+        {
+            printf("run> ");
+            fflush(stdout);
+            prompt = false;
+        }
+        if (read_input(input, sizeof(input)))
+        {
+            // Any text would corrupt the binary stream, so only its stop
+            // command is accepted while it runs.
+            if (!pulse_adc_streaming() || strcmp(input, "stop stream") == 0)
+            {
+                process_command(input);
+                prompt = true;
+            }
+        }
     }
 }
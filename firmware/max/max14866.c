@@ -18,6 +18,12 @@
 PIO pio_max;
 uint sm4;
 uint sm5;
+uint max_offset;
+uint max_dma_chan;
+uint32_t max_word;                          // single writes are sent from here
+uint32_t max_table[MAX14866_TABLE_SIZE];    // channel patterns for stepping
+uint max_table_len;
+uint max_table_pos;
 
 //---------------------------------------------------------------------------
 // MAX INIT FUNCTION
@@ -26,17 +32,40 @@ void max14866_init()
 {
     pio_max = pio1;
     sm4 = 0;
-    uint offset = pio_add_program(pio_max, &max14866_program);
-    max14866_program_init(pio_max, sm4, offset, MAX14866_SPI_DIN, MAX14866_SPI_SCLK, MAX14866_CLK);
-    gpio_init(MAX14866_SPI_LE);
-    gpio_init(MAX14866_SPI_SET);
-    gpio_init(MAX14866_SPI_CLR);
-    gpio_set_dir(MAX14866_SPI_LE, GPIO_OUT);
-    gpio_set_dir(MAX14866_SPI_SET, GPIO_OUT);
-    gpio_set_dir(MAX14866_SPI_CLR, GPIO_OUT);
-    gpio_put(MAX14866_SPI_SET, 0);
-    gpio_put(MAX14866_SPI_CLR, 0);
-    gpio_put(MAX14866_SPI_LE, 1);
+    max_offset = pio_add_program(pio_max, &max14866_latch_program);
+    max14866_latch_program_init(pio_max, sm4, max_offset, MAX14866_CLK);
+    max_dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config cfg = dma_channel_get_default_config(max_dma_chan);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&cfg, true);
+    channel_config_set_write_increment(&cfg, false);
+    channel_config_set_dreq(&cfg, pio_get_dreq(pio_max, sm4, true));
+    dma_channel_configure(max_dma_chan, &cfg, &pio_max->txf[sm4], max_table, 0, false);
+    max_table_len = 0;
+    max_table_pos = 0;
+}
+
+//---------------------------------------------------------------------------
+// MAX QUEUE FUNCTION
+//---------------------------------------------------------------------------
+// Hands sequencer words to the PIO by DMA.  Only waits while an earlier
+// transfer still has words to feed, i.e. when more than eight are queued.
+static void max14866_queue(const uint32_t *words, uint count)
+{
+    dma_channel_wait_for_finish_blocking(max_dma_chan);
+    dma_channel_transfer_from_buffer_now(max_dma_chan, words, count);
+}
+
+//---------------------------------------------------------------------------
+// MAX BUSY FUNCTION
+//---------------------------------------------------------------------------
+// True until the last queued write has been latched and its SET/CLR pulse
+// has ended: the sequencer is idle only when it waits on its pull.
+bool max14866_busy()
+{
+    return dma_channel_is_busy(max_dma_chan) ||
+           !pio_sm_is_tx_fifo_empty(pio_max, sm4) ||
+           pio_sm_get_pc(pio_max, sm4) != max_offset;
 }
 
 //---------------------------------------------------------------------------
@@ -44,33 +73,86 @@ void max14866_init()
 //---------------------------------------------------------------------------
 void max14866_write(uint16_t data)
 {
-    max14866_wait_idle(pio_max, sm4);
-    gpio_put(MAX14866_SPI_LE, 0);
-    sleep_us(10);
-    gpio_put(MAX14866_SPI_LE, 1);
-    max14866_put(pio_max, sm4, data);
-    max14866_wait_idle(pio_max, sm4);
-    gpio_put(MAX14866_SPI_LE, 0);
-    sleep_us(10);
-    gpio_put(MAX14866_SPI_LE, 1);
+    dma_channel_wait_for_finish_blocking(max_dma_chan);
+    max_word = max14866_latch_word(data, 0);
+    max14866_queue(&max_word, 1);
 }
 
 //---------------------------------------------------------------------------
 // MAX SET FUNCTION
 //---------------------------------------------------------------------------
+// Only the SET or CLR pin is pulsed; the shift register keeps the last
+// pattern written, as with the former GPIO pulse.
 void max14866_set(const char *input) {
-    gpio_put(MAX14866_SPI_SET, 1);
-    sleep_us(5);
-    gpio_put(MAX14866_SPI_SET, 0);
+    dma_channel_wait_for_finish_blocking(max_dma_chan);
+    max_word = max14866_pulse_word(MAX14866_PULSE_SET);
+    max14866_queue(&max_word, 1);
 }
 
 //---------------------------------------------------------------------------
 // MAX CLEAR FUNCTION
 //---------------------------------------------------------------------------
 void max14866_clear(const char *input) {
-    gpio_put(MAX14866_SPI_CLR, 1);
-    sleep_us(5);
-    gpio_put(MAX14866_SPI_CLR, 0);
+    dma_channel_wait_for_finish_blocking(max_dma_chan);
+    max_word = max14866_pulse_word(MAX14866_PULSE_CLR);
+    max14866_queue(&max_word, 1);
+}
+
+//---------------------------------------------------------------------------
+// MAX TABLE FUNCTIONS
+//---------------------------------------------------------------------------
+// "load mux <hex> <hex> ..." stores up to MAX14866_TABLE_SIZE channel
+// patterns; "load mux none" empties the table.
+void max14866_load(const char *input)
+{
+    char data_copy[strlen(input) + 1];
+    strcpy(data_copy, input);
+    char *rest;
+    char *token = strtok_r(data_copy, " ", &rest);
+
+    dma_channel_wait_for_finish_blocking(max_dma_chan);
+    max_table_len = 0;
+    max_table_pos = 0;
+    if (token != NULL && strcmp(token, "none") == 0)
+    {
+        printf("MUX table cleared\n");
+        return;
+    }
+    while (token != NULL && max_table_len < MAX14866_TABLE_SIZE)
+    {
+        uint16_t pattern = (uint16_t)strtol(token, NULL, 16);
+        max_table[max_table_len++] = max14866_latch_word(pattern, 0);
+        token = strtok_r(NULL, " ", &rest);
+    }
+    printf("MUX table of %u patterns loaded\n", max_table_len);
+}
+
+// Writes the next table pattern and wraps around; false without a table.
+bool max14866_step()
+{
+    if (max_table_len == 0)
+        return false;
+    max14866_queue(&max_table[max_table_pos], 1);
+    max_table_pos = (max_table_pos + 1) % max_table_len;
+    return true;
+}
+
+void max14866_rewind()
+{
+    max_table_pos = 0;
+}
+
+// Runs the whole table back to back, as fast as the sequencer allows.
+void max14866_sweep(const char *input)
+{
+    if (max_table_len == 0)
+    {
+        printf("No MUX table loaded\n");
+        return;
+    }
+    max14866_queue(max_table, max_table_len);
+    max_table_pos = 0;
+    printf("MUX sweep of %u patterns started\n", max_table_len);
 }
 
 //---------------------------------------------------------------------------
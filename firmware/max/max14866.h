@@ -15,8 +15,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
 #include "hardware/gpio.h"
 #include "hardware/clocks.h"
 
@@ -31,6 +33,7 @@
 #define MAX14866_SPI_CLR   28
 
 #define MAX14866_CLK   2000000
+#define MAX14866_TABLE_SIZE 16
 
 //---------------------------------------------------------------------------
 // MAX INIT FUNCTION
@@ -52,6 +55,20 @@ void max14866_set(const char *input);
 //---------------------------------------------------------------------------
 void max14866_clear(const char *input);
 
+//---------------------------------------------------------------------------
+// MAX BUSY FUNCTION
+//---------------------------------------------------------------------------
+bool max14866_busy();
+
+//---------------------------------------------------------------------------
+// MAX TABLE FUNCTIONS
+//---------------------------------------------------------------------------
+// A loaded table makes each streamed acquisition use the next pattern.
+void max14866_load(const char *input);
+bool max14866_step();
+void max14866_rewind();
+void max14866_sweep(const char *input);
+
 //---------------------------------------------------------------------------
 // MAX MAIN FUNCTION
 //---------------------------------------------------------------------------
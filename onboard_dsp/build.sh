@@ -5,3 +5,11 @@ set -e
 cmake -B build2350 -DPICO_BOARD=pico2
 cmake --build build2350 -j4
 cp build2350/pic0rick-envelope.uf2 pic0rick-envelope.uf2
+
+# rp2040: same sources, integer DSP backend; not yet linked or run on an
+# RP2040, so only built on request (./build.sh rp2040)
+if [ "$1" = "rp2040" ]; then
+    cmake -B build2040 -DU4RK_RP2040=ON
+    cmake --build build2040 -j4
+    cp build2040/pic0rick-envelope.uf2 pic0rick-envelope-rp2040.uf2
+fi
@@ -0,0 +1,232 @@
+#include "command_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *const payload_type_names[U4RK_PAYLOAD_TYPE_COUNT] = {
+    [U4RK_PAYLOAD_RAW] = "raw",
+    [U4RK_PAYLOAD_ENVELOPE] = "envelope",
+    [U4RK_PAYLOAD_ALAW] = "alaw",
+    [U4RK_PAYLOAD_RAW_RICE] = "rawz",
+    [U4RK_PAYLOAD_ENVELOPE_F16] = "envelope-f16",
+    [U4RK_PAYLOAD_ENVELOPE_U16] = "envelope-u16",
+    [U4RK_PAYLOAD_ENVELOPE_SPARSE] = "sparse",
+};
+
+/* Fixed argument sizes; the text parser does the range checks. */
+static const uint8_t argument_sizes[U4RK_OP_COUNT] = {
+    [U4RK_OP_PULSE_CONFIG] = 13,
+    [U4RK_OP_DAC_WRITE] = 2,
+    [U4RK_OP_DSP_SCALE] = 4,
+    [U4RK_OP_DSP_THRESHOLD] = 4,
+    [U4RK_OP_ACQ] = 1,
+    [U4RK_OP_STREAM_START] = 12,
+    [U4RK_OP_CREDIT] = 4,
+    [U4RK_OP_DATA] = 1,
+    [U4RK_OP_RESEND] = 4,
+};
+
+static uint16_t get_u16(const uint8_t *in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) |
+           ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static float get_f32(const uint8_t *in) {
+    uint32_t bits = get_u32(in);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint8_t packet_check(const uint8_t *packet, size_t size) {
+    uint8_t check = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (i != 3u) {
+            check ^= packet[i];
+        }
+    }
+    return check;
+}
+
+const char *u4rk_payload_type_name(uint8_t type) {
+    return type < U4RK_PAYLOAD_TYPE_COUNT ? payload_type_names[type] : NULL;
+}
+
+size_t u4rk_command_encode(uint8_t opcode, uint32_t request_id,
+                           const void *args, size_t length, uint8_t *out) {
+    if (length > U4RK_COMMAND_MAX_ARGS) {
+        return 0;
+    }
+    out[0] = U4RK_COMMAND_SYNC;
+    out[1] = opcode;
+    out[2] = (uint8_t)length;
+    out[4] = (uint8_t)request_id;
+    out[5] = (uint8_t)(request_id >> 8);
+    out[6] = (uint8_t)(request_id >> 16);
+    out[7] = (uint8_t)(request_id >> 24);
+    if (length != 0u) {
+        memcpy(out + U4RK_COMMAND_HEADER_SIZE, args, length);
+    }
+    size_t size = U4RK_COMMAND_HEADER_SIZE + length;
+    out[3] = packet_check(out, size);
+    return size;
+}
+
+bool u4rk_command_header_ok(const uint8_t header[U4RK_COMMAND_HEADER_SIZE]) {
+    return header[0] == U4RK_COMMAND_SYNC &&
+           header[2] <= U4RK_COMMAND_MAX_ARGS;
+}
+
+bool u4rk_command_check_ok(const uint8_t *packet, size_t size) {
+    return packet_check(packet, size) == packet[3];
+}
+
+bool u4rk_command_to_text(const uint8_t *packet, char *line,
+                          size_t capacity) {
+    uint8_t opcode = packet[1];
+    uint8_t length = packet[2];
+    const uint8_t *args = packet + U4RK_COMMAND_HEADER_SIZE;
+    if (opcode == 0u || opcode >= U4RK_OP_COUNT ||
+        length != argument_sizes[opcode]) {
+        return false;
+    }
+
+    int used;
+    const char *type_name;
+    switch ((u4rk_opcode_t)opcode) {
+        case U4RK_OP_STATUS:
+            used = snprintf(line, capacity, "status");
+            break;
+        case U4RK_OP_PULSER_ARM:
+            used = snprintf(line, capacity, "pulser arm");
+            break;
+        case U4RK_OP_PULSER_DISARM:
+            used = snprintf(line, capacity, "pulser disarm");
+            break;
+        case U4RK_OP_PULSE_CONFIG:
+            used = snprintf(line, capacity, "pulse config %lu %lu %lu %s",
+                            (unsigned long)get_u32(args),
+                            (unsigned long)get_u32(args + 4),
+                            (unsigned long)get_u32(args + 8),
+                            args[12] == U4RK_PULSE_NEGATIVE_FIRST
+                                ? "neg-first" : "pos-first");
+            break;
+        case U4RK_OP_DAC_WRITE:
+            used = snprintf(line, capacity, "dac write %u",
+                            (unsigned)get_u16(args));
+            break;
+        case U4RK_OP_DSP_SCALE:
+            used = snprintf(line, capacity, "dsp scale %.9g",
+                            (double)get_f32(args));
+            break;
+        case U4RK_OP_DSP_THRESHOLD:
+            used = snprintf(line, capacity, "dsp threshold %.9g",
+                            (double)get_f32(args));
+            break;
+        case U4RK_OP_DSP_SELFTEST:
+            used = snprintf(line, capacity, "dsp selftest");
+            break;
+        case U4RK_OP_ACQ:
+            type_name = u4rk_payload_type_name(args[0]);
+            if (type_name == NULL) {
+                return false;
+            }
+            used = snprintf(line, capacity, "acq %s", type_name);
+            break;
+        case U4RK_OP_STREAM_START: {
+            uint8_t options = args[1];
+            type_name = u4rk_payload_type_name(args[0]);
+            if (type_name == NULL) {
+                return false;
+            }
+            char rate[12] = "max";
+            if ((options & U4RK_STREAM_OPTION_MAX_RATE) == 0u) {
+                snprintf(rate, sizeof(rate), "%lu",
+                         (unsigned long)get_u32(args + 4));
+            }
+            used = snprintf(line, capacity, "stream start %s %s", type_name,
+                            rate);
+            if (used >= 0 && (size_t)used < capacity &&
+                (options & U4RK_STREAM_OPTION_CREDIT) != 0u) {
+                used += snprintf(line + used, capacity - (size_t)used,
+                                 " credit %lu",
+                                 (unsigned long)get_u32(args + 8));
+            }
+            if (used >= 0 && (size_t)used < capacity &&
+                get_u16(args + 2) > 1u) {
+                used += snprintf(line + used, capacity - (size_t)used,
+                                 " batch %u", (unsigned)get_u16(args + 2));
+            }
+            break;
+        }
+        case U4RK_OP_CREDIT:
+            used = snprintf(line, capacity, "credit %lu",
+                            (unsigned long)get_u32(args));
+            break;
+        case U4RK_OP_STREAM_STOP:
+            used = snprintf(line, capacity, "stream stop");
+            break;
+        case U4RK_OP_STATS:
+            used = snprintf(line, capacity, "stats");
+            break;
+        case U4RK_OP_STATS_RESET:
+            used = snprintf(line, capacity, "stats reset");
+            break;
+        case U4RK_OP_STATS_FRAME:
+            used = snprintf(line, capacity, "stats frame");
+            break;
+        case U4RK_OP_DATA:
+            if (args[0] > 1u) {
+                return false;
+            }
+            used = snprintf(line, capacity, "data %s",
+                            args[0] != 0u ? "vendor" : "cdc");
+            break;
+        case U4RK_OP_RESEND:
+            used = snprintf(line, capacity, "resend %lu",
+                            (unsigned long)get_u32(args));
+            break;
+        default:
+            return false;
+    }
+    return used > 0 && (size_t)used < capacity;
+}
+
+bool u4rk_command_is_immediate(uint8_t opcode) {
+    switch (opcode) {
+        case U4RK_OP_STATUS:
+        case U4RK_OP_CREDIT:
+        case U4RK_OP_STREAM_STOP:
+        case U4RK_OP_STATS:
+        case U4RK_OP_STATS_RESET:
+        case U4RK_OP_STATS_FRAME:
+        case U4RK_OP_RESEND:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Compares the next word of *text with word and steps past it on a match. */
+static bool take_word(const char **text, const char *word) {
+    const char *cursor = *text + strspn(*text, " \t");
+    size_t length = strcspn(cursor, " \t");
+    if (length != strlen(word) || strncmp(cursor, word, length) != 0) {
+        return false;
+    }
+    *text = cursor + length;
+    return true;
+}
+
+bool u4rk_command_line_is_immediate(const char *line) {
+    if (take_word(&line, "status") || take_word(&line, "help") ||
+        take_word(&line, "stats") || take_word(&line, "credit") ||
+        take_word(&line, "resend")) {
+        return true;
+    }
+    return take_word(&line, "stream") && take_word(&line, "stop");
+}
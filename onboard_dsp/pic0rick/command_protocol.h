@@ -0,0 +1,79 @@
+#ifndef U4RK_COMMAND_PROTOCOL_H
+#define U4RK_COMMAND_PROTOCOL_H
+
+#include "u4rk.h"
+
+/*
+ * Binary commands share the CDC command channel with text.  A packet starts
+ * with a sync byte that can never begin a text line, so both forms can be
+ * mixed freely:
+ *
+ *   offset 0  sync        U4RK_COMMAND_SYNC
+ *          1  opcode      u4rk_opcode_t
+ *          2  length      argument bytes, at most U4RK_COMMAND_MAX_ARGS
+ *          3  check       XOR of every other byte of the packet
+ *          4  request_id  uint32, little-endian
+ *          8  arguments   little-endian, layout per opcode below
+ *
+ * Packets are executed strictly in order, each once the previous one's
+ * operation has finished, and each is answered by a response frame carrying
+ * its request_id.  Hosts may therefore send many without waiting.  The same
+ * file builds into the host library.
+ */
+#define U4RK_COMMAND_SYNC         0xC5u
+#define U4RK_COMMAND_HEADER_SIZE  8u
+#define U4RK_COMMAND_MAX_ARGS     16u
+#define U4RK_COMMAND_MAX_SIZE \
+    (U4RK_COMMAND_HEADER_SIZE + U4RK_COMMAND_MAX_ARGS)
+#define U4RK_COMMAND_LINE_SIZE    96u
+
+/* Arguments are listed after each opcode. */
+typedef enum {
+    U4RK_OP_STATUS = 1,         /* none */
+    U4RK_OP_PULSER_ARM = 2,     /* none */
+    U4RK_OP_PULSER_DISARM = 3,  /* none */
+    U4RK_OP_PULSE_CONFIG = 4,   /* u32 negative_ns, u32 damp_ns,
+                                   u32 positive_ns, u8 order */
+    U4RK_OP_DAC_WRITE = 5,      /* u16 value */
+    U4RK_OP_DSP_SCALE = 6,      /* f32 reference */
+    U4RK_OP_DSP_THRESHOLD = 7,  /* f32 counts */
+    U4RK_OP_DSP_SELFTEST = 8,   /* none */
+    U4RK_OP_ACQ = 9,            /* u8 payload type */
+    U4RK_OP_STREAM_START = 10,  /* u8 payload type, u8 options, u16 batch,
+                                   u32 rate_hz, u32 credits */
+    U4RK_OP_CREDIT = 11,        /* u32 credits */
+    U4RK_OP_STREAM_STOP = 12,   /* none */
+    U4RK_OP_STATS = 13,         /* none */
+    U4RK_OP_STATS_RESET = 14,   /* none */
+    U4RK_OP_STATS_FRAME = 15,   /* none */
+    U4RK_OP_DATA = 16,          /* u8 u4rk_usb_data_channel_t */
+    U4RK_OP_RESEND = 17,        /* u32 sequence */
+    U4RK_OP_COUNT,
+} u4rk_opcode_t;
+
+enum {
+    U4RK_STREAM_OPTION_CREDIT = 1u << 0,
+    U4RK_STREAM_OPTION_MAX_RATE = 1u << 1,
+};
+
+/* Name used by the text commands, or NULL for types that cannot be
+ * requested (none, telemetry, superframe, response). */
+const char *u4rk_payload_type_name(uint8_t type);
+
+/* Builds a packet into out (U4RK_COMMAND_MAX_SIZE bytes); returns its size,
+ * or 0 when the arguments are too long. */
+size_t u4rk_command_encode(uint8_t opcode, uint32_t request_id,
+                           const void *args, size_t length, uint8_t *out);
+/* Checks a complete packet.  header_ok covers sync and length only. */
+bool u4rk_command_header_ok(const uint8_t header[U4RK_COMMAND_HEADER_SIZE]);
+bool u4rk_command_check_ok(const uint8_t *packet, size_t size);
+/* Translates a packet into the equivalent text command so both forms share
+ * one parser.  Returns false for an unknown opcode or bad arguments. */
+bool u4rk_command_to_text(const uint8_t *packet, char *line,
+                          size_t capacity);
+/* True for commands that answer at once even while an operation is busy. */
+bool u4rk_command_is_immediate(uint8_t opcode);
+/* The same for a text command (after any "@<id> " prefix). */
+bool u4rk_command_line_is_immediate(const char *line);
+
+#endif
@@ -3,30 +3,204 @@
 #include <math.h>
 #include <string.h>
 
+#include "hal.h"
+#if U4RK_DSP_FIXED_POINT
+#include "hilbert_fixed.h"
+#else
 #include "arm_math.h"
-#include "pico/stdlib.h"
+#endif
 
 #define U4RK_ALAW_A 87.6f
 #define U4RK_ALAW_LUT_SIZE 4096u
 #define U4RK_PI 3.14159265358979323846f
 
+#if U4RK_DSP_FIXED_POINT
+/* Quadrature, then magnitude, in ADC counts with
+ * U4RK_HILBERT_FRACTION_BITS fractional bits. */
+static int32_t hilbert_buffer[U4RK_SAMPLE_COUNT]
+    __attribute__((aligned(16)));
+#else
 static arm_rfft_fast_instance_f32 rfft;
 static float32_t rfft_buffer[U4RK_SAMPLE_COUNT]
     __attribute__((aligned(16)));
 static float32_t envelope_buffer[U4RK_SAMPLE_COUNT]
     __attribute__((aligned(16)));
-static uint8_t alaw_buffer[U4RK_SAMPLE_COUNT] __attribute__((aligned(16)));
+#endif
+static uint16_t raw_work[U4RK_SAMPLE_COUNT] __attribute__((aligned(16)));
 static uint8_t alaw_lut[U4RK_ALAW_LUT_SIZE];
 static uint32_t worst_total_us;
 
+/* IEEE binary16 with round-to-nearest-even.  With -mfp16-format=ieee the
+ * M33 converts in one VCVTB instruction; the portable path is for host
+ * builds.  CMSIS-DSP float16 kernels stay disabled: none are needed. */
+static inline uint16_t float_to_half(float value) {
+#if defined(__ARM_FP16_FORMAT_IEEE)
+    __fp16 half = (__fp16)value;
+    uint16_t result;
+    memcpy(&result, &half, sizeof(result));
+    return result;
+#else
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t biased = (bits >> 23) & 0xffu;
+    uint32_t mantissa = bits & 0x7fffffu;
+    if (biased == 0xffu) {
+        return (uint16_t)(sign | 0x7c00u | (mantissa != 0u ? 0x200u : 0u));
+    }
+    int32_t exponent = (int32_t)biased - 127 + 15;
+    if (exponent >= 31) {
+        return (uint16_t)(sign | 0x7c00u);
+    }
+    uint32_t shift = 13u;
+    uint32_t half = sign | ((uint32_t)exponent << 10);
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return (uint16_t)sign;
+        }
+        mantissa |= 0x800000u;
+        shift = (uint32_t)(14 - exponent);
+        half = sign;
+    }
+    uint32_t remainder = mantissa & ((1u << shift) - 1u);
+    uint32_t halfway = 1u << (shift - 1u);
+    half += mantissa >> shift;
+    /* A carry out of the mantissa correctly bumps the exponent. */
+    if (remainder > halfway || (remainder == halfway && (half & 1u) != 0u)) {
+        ++half;
+    }
+    return (uint16_t)half;
+#endif
+}
+
+static inline uint16_t scale_u16(float magnitude, bool *saturated) {
+    float scaled = magnitude * U4RK_ENVELOPE_U16_SCALE + 0.5f;
+    if (scaled >= 65535.0f) {
+        *saturated = true;
+        return 65535u;
+    }
+    return (uint16_t)scaled;
+}
+
+_Static_assert(U4RK_SPARSE_MERGE_GAP >= 2u,
+               "U4RK_SPARSE_MAX_PAYLOAD_SIZE assumes gaps of two are merged");
+
+#if U4RK_DSP_FIXED_POINT
+#define U4RK_FIXED_ONE (1u << U4RK_HILBERT_FRACTION_BITS)
+#define U4RK_U16_SHIFT (U4RK_HILBERT_FRACTION_BITS - 5u)
+
+_Static_assert((int)U4RK_ENVELOPE_U16_SCALE == 1 << 5,
+               "uint16 envelope codes are derived by shifting the magnitude");
+
+static inline uint16_t fixed_u16(uint32_t magnitude, bool *saturated) {
+    uint32_t code =
+        (magnitude + (1u << (U4RK_U16_SHIFT - 1u))) >> U4RK_U16_SHIFT;
+    if (code >= 65535u) {
+        *saturated = true;
+        return 65535u;
+    }
+    return (uint16_t)code;
+}
+
+/* Bitwise square root, rounded to nearest. */
+static uint32_t isqrt_rounded(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0u) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    /* value is now the remainder above root * root. */
+    return value > root ? root + 1u : root;
+}
+
+/* The M0+ multiplier is 32-bit, so large components are scaled down until
+ * the sum of squares fits; only echoes above 512 counts lose a low bit. */
+static inline uint32_t fixed_magnitude(int32_t real, int32_t quadrature) {
+    uint32_t a = real < 0 ? (uint32_t)-real : (uint32_t)real;
+    uint32_t b = quadrature < 0 ? (uint32_t)-quadrature : (uint32_t)quadrature;
+    uint32_t shift = 0;
+    while ((a | b) >= (1u << 15)) {
+        a >>= 1;
+        b >>= 1;
+        ++shift;
+    }
+    return isqrt_rounded(a * a + b * b) << shift;
+}
+
+static uint32_t encode_sparse_fixed(const int32_t *envelope, uint32_t threshold,
+                                    uint16_t *out, bool *saturated) {
+    uint16_t *cursor = out;
+    uint32_t i = 0;
+    while (i < U4RK_SAMPLE_COUNT) {
+        if ((uint32_t)envelope[i] <= threshold) {
+            ++i;
+            continue;
+        }
+        uint32_t last_loud = i;
+        for (uint32_t j = i + 1u;
+             j < U4RK_SAMPLE_COUNT && j - last_loud <= U4RK_SPARSE_MERGE_GAP;
+             ++j) {
+            if ((uint32_t)envelope[j] > threshold) {
+                last_loud = j;
+            }
+        }
+        *cursor++ = (uint16_t)i;
+        *cursor++ = (uint16_t)(last_loud + 1u - i);
+        for (; i <= last_loud; ++i) {
+            *cursor++ = fixed_u16((uint32_t)envelope[i], saturated);
+        }
+    }
+    return (uint32_t)((cursor - out) * sizeof(uint16_t));
+}
+#else
+static uint32_t encode_sparse(const float32_t *envelope, float threshold,
+                              uint16_t *out, bool *saturated) {
+    uint16_t *cursor = out;
+    uint32_t i = 0;
+    while (i < U4RK_SAMPLE_COUNT) {
+        if (envelope[i] <= threshold) {
+            ++i;
+            continue;
+        }
+        uint32_t last_loud = i;
+        for (uint32_t j = i + 1u;
+             j < U4RK_SAMPLE_COUNT && j - last_loud <= U4RK_SPARSE_MERGE_GAP;
+             ++j) {
+            if (envelope[j] > threshold) {
+                last_loud = j;
+            }
+        }
+        *cursor++ = (uint16_t)i;
+        *cursor++ = (uint16_t)(last_loud + 1u - i);
+        for (; i <= last_loud; ++i) {
+            *cursor++ = scale_u16(envelope[i], saturated);
+        }
+    }
+    return (uint32_t)((cursor - out) * sizeof(uint16_t));
+}
+#endif
+
 static uint32_t elapsed_us(uint64_t start) {
-    return (uint32_t)(time_us_64() - start);
+    return (uint32_t)(u4rk_hal_time_us() - start);
 }
 
 bool u4rk_dsp_init(void) {
+#if U4RK_DSP_FIXED_POINT
+    u4rk_hilbert_fixed_init();
+#else
     if (arm_rfft_fast_init_4096_f32(&rfft) != ARM_MATH_SUCCESS) {
         return false;
     }
+#endif
 
     const float denominator = 1.0f + logf(U4RK_ALAW_A);
     for (uint32_t i = 0; i < U4RK_ALAW_LUT_SIZE; ++i) {
@@ -49,38 +223,137 @@ bool u4rk_dsp_init(void) {
     return true;
 }
 
-float u4rk_dsp_extract(const uint16_t *dma_samples, uint16_t *raw_out) {
+static uint32_t extract_sum(const uint16_t *dma_samples, uint16_t *raw_out) {
     uint32_t sum = 0;
     for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
         uint16_t value = (uint16_t)((dma_samples[i] >> 1) & 0x03ffu);
         raw_out[i] = value;
         sum += value;
     }
-    return (float)sum / (float)U4RK_SAMPLE_COUNT;
+    return sum;
 }
 
-void u4rk_dsp_envelope(const uint16_t *dma_samples, uint16_t *raw_out,
-                       float reference, bool make_alaw,
-                       float **envelope_out, uint8_t **alaw_out,
-                       bool *saturated, u4rk_dsp_metrics_t *metrics) {
+float u4rk_dsp_extract(const uint16_t *dma_samples, uint16_t *raw_out) {
+    return (float)extract_sum(dma_samples, raw_out) /
+           (float)U4RK_SAMPLE_COUNT;
+}
+
+#if U4RK_DSP_FIXED_POINT
+uint32_t u4rk_dsp_envelope(const uint16_t *dma_samples, float reference,
+                           float threshold, u4rk_payload_type_t format,
+                           void *out, bool *saturated,
+                           u4rk_dsp_metrics_t *metrics) {
     memset(metrics, 0, sizeof(*metrics));
-    uint64_t total_started = time_us_64();
+    uint64_t total_started = u4rk_hal_time_us();
     uint64_t stage_started = total_started;
 
-    float mean = u4rk_dsp_extract(dma_samples, raw_out);
+    uint32_t sum = extract_sum(dma_samples, raw_work);
+    /* The mean in output units: sum / 4096 * 64. */
+    int32_t mean = (int32_t)((sum + (U4RK_SAMPLE_COUNT / U4RK_FIXED_ONE) / 2u) /
+                             (U4RK_SAMPLE_COUNT / U4RK_FIXED_ONE));
+    metrics->dc_mean = (float)sum / (float)U4RK_SAMPLE_COUNT;
+    metrics->preprocess_us = elapsed_us(stage_started);
+
+    /* Both transforms and the -j rotation run in one call; the whole
+     * transform is reported in the forward FFT slot. */
+    stage_started = u4rk_hal_time_us();
+    u4rk_hilbert_fixed(raw_work, hilbert_buffer);
+    metrics->forward_fft_us = elapsed_us(stage_started);
+
+    /* Magnitudes replace the quadrature in place; float, half and uint16
+     * envelopes are written straight into the caller's output payload. */
+    float *envelope32 = (float *)out;
+    uint16_t *envelope16 = (uint16_t *)out;
+    stage_started = u4rk_hal_time_us();
+    uint32_t peak = 0;
+    *saturated = false;
     for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
-        rfft_buffer[i] = (float32_t)raw_out[i] - mean;
+        int32_t real = (int32_t)raw_work[i] * (int32_t)U4RK_FIXED_ONE - mean;
+        uint32_t magnitude = fixed_magnitude(real, hilbert_buffer[i]);
+        if (format == U4RK_PAYLOAD_ENVELOPE) {
+            envelope32[i] = (float)magnitude * (1.0f / (float)U4RK_FIXED_ONE);
+        } else if (format == U4RK_PAYLOAD_ENVELOPE_F16) {
+            envelope16[i] =
+                float_to_half((float)magnitude * (1.0f / (float)U4RK_FIXED_ONE));
+        } else if (format == U4RK_PAYLOAD_ENVELOPE_U16) {
+            envelope16[i] = fixed_u16(magnitude, saturated);
+        } else {
+            hilbert_buffer[i] = (int32_t)magnitude;
+        }
+        if (magnitude > peak) {
+            peak = magnitude;
+        }
+    }
+    metrics->envelope_peak = (float)peak / (float)U4RK_FIXED_ONE;
+    metrics->magnitude_us = elapsed_us(stage_started);
+
+    uint32_t payload_bytes = U4RK_SAMPLE_COUNT * sizeof(uint16_t);
+    if (format == U4RK_PAYLOAD_ENVELOPE) {
+        payload_bytes = U4RK_SAMPLE_COUNT * sizeof(float);
+    } else if (format == U4RK_PAYLOAD_ENVELOPE_SPARSE) {
+        stage_started = u4rk_hal_time_us();
+        payload_bytes = encode_sparse_fixed(
+            hilbert_buffer, (uint32_t)(threshold * (float)U4RK_FIXED_ONE),
+            envelope16, saturated);
+        metrics->alaw_us = elapsed_us(stage_started);
+    } else if (format == U4RK_PAYLOAD_ALAW) {
+        payload_bytes = U4RK_SAMPLE_COUNT;
+        uint8_t *alaw_out = (uint8_t *)out;
+        stage_started = u4rk_hal_time_us();
+        /* index = magnitude / reference * 4095 as a 16.16 factor, which
+         * cannot overflow below the saturation limit. */
+        float limit_f = reference * (float)U4RK_FIXED_ONE;
+        uint32_t limit = (uint32_t)limit_f;
+        uint32_t factor = limit == 0u ? 0u :
+            (uint32_t)((float)(U4RK_ALAW_LUT_SIZE - 1u) * 65536.0f / limit_f +
+                       0.5f);
+        for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
+            uint32_t magnitude = (uint32_t)hilbert_buffer[i];
+            uint32_t index = U4RK_ALAW_LUT_SIZE - 1u;
+            if (magnitude > limit) {
+                *saturated = true;
+            } else {
+                index = (magnitude * factor + 0x8000u) >> 16;
+                if (index > U4RK_ALAW_LUT_SIZE - 1u) {
+                    index = U4RK_ALAW_LUT_SIZE - 1u;
+                }
+            }
+            alaw_out[i] = alaw_lut[index];
+        }
+        metrics->alaw_us = elapsed_us(stage_started);
+    }
+
+    metrics->total_us = elapsed_us(total_started);
+    if (metrics->total_us > worst_total_us) {
+        worst_total_us = metrics->total_us;
+    }
+    metrics->worst_total_us = worst_total_us;
+    return payload_bytes;
+}
+#else
+
+uint32_t u4rk_dsp_envelope(const uint16_t *dma_samples, float reference,
+                           float threshold, u4rk_payload_type_t format,
+                           void *out, bool *saturated,
+                           u4rk_dsp_metrics_t *metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+    uint64_t total_started = u4rk_hal_time_us();
+    uint64_t stage_started = total_started;
+
+    float mean = u4rk_dsp_extract(dma_samples, raw_work);
+    for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
+        rfft_buffer[i] = (float32_t)raw_work[i] - mean;
     }
     metrics->dc_mean = mean;
     metrics->preprocess_us = elapsed_us(stage_started);
 
-    stage_started = time_us_64();
+    stage_started = u4rk_hal_time_us();
     /* A real input has a redundant negative-frequency half, so the fast real
      * FFT performs half the complex FFT work of the former implementation. */
     arm_rfft_fast_f32(&rfft, rfft_buffer, envelope_buffer, 0);
     metrics->forward_fft_us = elapsed_us(stage_started);
 
-    stage_started = time_us_64();
+    stage_started = u4rk_hal_time_us();
     /* Build the packed spectrum of the real Hilbert transform. Multiplication
      * by -j maps (real + j*imag) to (imag - j*real). */
     envelope_buffer[0] = 0.0f;
@@ -93,29 +366,53 @@ void u4rk_dsp_envelope(const uint16_t *dma_samples, uint16_t *raw_out,
     }
     metrics->mask_us = elapsed_us(stage_started);
 
-    stage_started = time_us_64();
+    stage_started = u4rk_hal_time_us();
     arm_rfft_fast_f32(&rfft, envelope_buffer, rfft_buffer, 1);
     metrics->inverse_fft_us = elapsed_us(stage_started);
 
-    stage_started = time_us_64();
+    /* The spectrum in envelope_buffer is dead after the inverse transform, so
+     * it doubles as scratch for A-law and sparse output.  Float,
+     * half and uint16 envelopes are converted inside the magnitude loop and
+     * written straight into the caller's output payload. */
+    float32_t *envelope = format == U4RK_PAYLOAD_ENVELOPE
+        ? (float32_t *)out : envelope_buffer;
+    uint16_t *envelope16 = (uint16_t *)out;
+    stage_started = u4rk_hal_time_us();
     metrics->envelope_peak = 0.0f;
+    *saturated = false;
     for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
-        float32_t real = (float32_t)raw_out[i] - mean;
+        float32_t real = (float32_t)raw_work[i] - mean;
         float32_t quadrature = rfft_buffer[i];
         float32_t magnitude = sqrtf(real * real + quadrature * quadrature);
-        envelope_buffer[i] = magnitude;
+        if (format == U4RK_PAYLOAD_ENVELOPE_F16) {
+            envelope16[i] = float_to_half(magnitude);
+        } else if (format == U4RK_PAYLOAD_ENVELOPE_U16) {
+            envelope16[i] = scale_u16(magnitude, saturated);
+        } else {
+            envelope[i] = magnitude;
+        }
         if (magnitude > metrics->envelope_peak) {
             metrics->envelope_peak = magnitude;
         }
     }
     metrics->magnitude_us = elapsed_us(stage_started);
 
-    *saturated = false;
-    if (make_alaw) {
-        stage_started = time_us_64();
+    uint32_t payload_bytes = U4RK_SAMPLE_COUNT * sizeof(uint16_t);
+    if (format == U4RK_PAYLOAD_ENVELOPE) {
+        payload_bytes = U4RK_SAMPLE_COUNT * sizeof(float);
+    } else if (format == U4RK_PAYLOAD_ENVELOPE_SPARSE) {
+        /* Reported in the A-law stage slot: it is the same post-pass. */
+        stage_started = u4rk_hal_time_us();
+        payload_bytes = encode_sparse(envelope, threshold, envelope16,
+                                      saturated);
+        metrics->alaw_us = elapsed_us(stage_started);
+    } else if (format == U4RK_PAYLOAD_ALAW) {
+        payload_bytes = U4RK_SAMPLE_COUNT;
+        uint8_t *alaw_out = (uint8_t *)out;
+        stage_started = u4rk_hal_time_us();
         float inv_reference = 1.0f / reference;
         for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
-            float normalized = envelope_buffer[i] * inv_reference;
+            float normalized = envelope[i] * inv_reference;
             if (normalized > 1.0f) {
                 normalized = 1.0f;
                 *saturated = true;
@@ -124,7 +421,7 @@ void u4rk_dsp_envelope(const uint16_t *dma_samples, uint16_t *raw_out,
             }
             uint32_t index =
                 (uint32_t)(normalized * (U4RK_ALAW_LUT_SIZE - 1u) + 0.5f);
-            alaw_buffer[i] = alaw_lut[index];
+            alaw_out[i] = alaw_lut[index];
         }
         metrics->alaw_us = elapsed_us(stage_started);
     }
@@ -134,9 +431,9 @@ void u4rk_dsp_envelope(const uint16_t *dma_samples, uint16_t *raw_out,
         worst_total_us = metrics->total_us;
     }
     metrics->worst_total_us = worst_total_us;
-    *envelope_out = envelope_buffer;
-    *alaw_out = alaw_buffer;
+    return payload_bytes;
 }
+#endif
 
 static uint16_t clamp_adc(float value) {
     if (value < 0.0f) {
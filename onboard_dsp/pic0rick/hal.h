@@ -0,0 +1,52 @@
+#ifndef U4RK_HAL_H
+#define U4RK_HAL_H
+
+#include <stdint.h>
+
+/*
+ * Platform primitives for the portable modules (main loop, pipeline, DSP).
+ * The RP2350 build maps them straight onto the Pico SDK; the Linux
+ * simulator (sim/, built with U4RK_SIMULATOR) implements them with POSIX
+ * threads.  Peripherals sit behind their own interfaces instead:
+ * acquisition.h (PIO/DMA), dac.h (SPI) and usb_transport.h (TinyUSB), each
+ * with a simulator counterpart in sim/.
+ */
+#ifdef U4RK_SIMULATOR
+
+uint64_t u4rk_hal_time_us(void);
+void u4rk_hal_launch_core1(void (*entry)(void));
+/* Sets core 1's event flag; u4rk_hal_wait_for_event() waits for and
+ * clears it, like SEV and WFE. */
+void u4rk_hal_signal_core1(void);
+void u4rk_hal_wait_for_event(void);
+void u4rk_hal_idle(void);
+
+#else
+
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+
+static inline uint64_t u4rk_hal_time_us(void) {
+    return time_us_64();
+}
+
+static inline void u4rk_hal_launch_core1(void (*entry)(void)) {
+    multicore_launch_core1(entry);
+}
+
+static inline void u4rk_hal_signal_core1(void) {
+    __sev();
+}
+
+static inline void u4rk_hal_wait_for_event(void) {
+    __wfe();
+}
+
+static inline void u4rk_hal_idle(void) {
+    tight_loop_contents();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef U4RK_HANDOFF_H
+#define U4RK_HANDOFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Core 0 / core 1 handoff primitives.  They use only compiler atomics, so
+ * the same header also builds in a host pthread program.
+ *
+ * u4rk_ring_t is a wait-free single-producer/single-consumer ring of 32-bit
+ * descriptors (buffer indices or sequence numbers).  head is written only by
+ * the producer and tail only by the consumer; both run freely and wrap.
+ */
+#define U4RK_RING_CAPACITY 4u
+
+_Static_assert((U4RK_RING_CAPACITY & (U4RK_RING_CAPACITY - 1u)) == 0u,
+               "ring capacity must be a power of two");
+
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t entries[U4RK_RING_CAPACITY];
+} u4rk_ring_t;
+
+static inline void u4rk_ring_init(u4rk_ring_t *ring) {
+    __atomic_store_n(&ring->head, 0u, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, 0u, __ATOMIC_RELAXED);
+}
+
+static inline bool u4rk_ring_push(u4rk_ring_t *ring, uint32_t value) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail == U4RK_RING_CAPACITY) {
+        return false;
+    }
+    ring->entries[head & (U4RK_RING_CAPACITY - 1u)] = value;
+    __atomic_store_n(&ring->head, head + 1u, __ATOMIC_RELEASE);
+    return true;
+}
+
+static inline bool u4rk_ring_pop(u4rk_ring_t *ring, uint32_t *value) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return false;
+    }
+    *value = ring->entries[tail & (U4RK_RING_CAPACITY - 1u)];
+    __atomic_store_n(&ring->tail, tail + 1u, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Consumer only: reads the oldest entry without removing it. */
+static inline bool u4rk_ring_peek(const u4rk_ring_t *ring, uint32_t *value) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return false;
+    }
+    *value = ring->entries[tail & (U4RK_RING_CAPACITY - 1u)];
+    return true;
+}
+
+/* Either side may call this; the result is exact only on a quiet ring. */
+static inline uint32_t u4rk_ring_level(const u4rk_ring_t *ring) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
+
+/*
+ * Single-writer sequence lock.  An odd sequence marks a write in progress;
+ * readers copy the protected data and retry if the sequence moved.
+ */
+typedef struct {
+    uint32_t sequence;
+} u4rk_seqlock_t;
+
+static inline void u4rk_seqlock_init(u4rk_seqlock_t *lock) {
+    __atomic_store_n(&lock->sequence, 0u, __ATOMIC_RELAXED);
+}
+
+static inline void u4rk_seqlock_write_begin(u4rk_seqlock_t *lock) {
+    uint32_t sequence = __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->sequence, sequence + 1u, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void u4rk_seqlock_write_end(u4rk_seqlock_t *lock) {
+    uint32_t sequence = __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->sequence, sequence + 1u, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t u4rk_seqlock_read_begin(const u4rk_seqlock_t *lock) {
+    uint32_t sequence;
+    while ((sequence = __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE)) &
+           1u) {
+    }
+    return sequence;
+}
+
+static inline bool u4rk_seqlock_read_retry(const u4rk_seqlock_t *lock,
+                                           uint32_t sequence) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) != sequence;
+}
+
+#endif
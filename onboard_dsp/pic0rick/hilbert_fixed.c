@@ -0,0 +1,147 @@
+#include "hilbert_fixed.h"
+
+#include <math.h>
+
+#define U4RK_HILBERT_POINTS (U4RK_SAMPLE_COUNT / 2u)
+#define U4RK_HILBERT_QUARTER (U4RK_SAMPLE_COUNT / 4u)
+#define U4RK_TWIDDLE_SHIFT 30
+/* Samples enter at 2^9 per ADC count: a 2048-point forward transform of
+ * values below 2^18 stays below 2^29.5, and the -j spectrum below 2^30.5. */
+#define U4RK_HILBERT_INPUT_SHIFT 9u
+
+/* cos(2*pi*i/4096) in Q30 for the first quarter turn. */
+static int32_t cosine[U4RK_HILBERT_QUARTER + 1u];
+
+/* cos and sin of 2*pi*index/4096 for index in [0, 2048]. */
+static inline void twiddle(uint32_t index, int32_t *c, int32_t *s) {
+    if (index <= U4RK_HILBERT_QUARTER) {
+        *c = cosine[index];
+        *s = cosine[U4RK_HILBERT_QUARTER - index];
+    } else {
+        *c = -cosine[2u * U4RK_HILBERT_QUARTER - index];
+        *s = cosine[index - U4RK_HILBERT_QUARTER];
+    }
+}
+
+void u4rk_hilbert_fixed_init(void) {
+    for (uint32_t i = 0; i <= U4RK_HILBERT_QUARTER; ++i) {
+        double angle = 2.0 * 3.14159265358979323846 * (double)i /
+                       (double)U4RK_SAMPLE_COUNT;
+        cosine[i] = (int32_t)lround(cos(angle) * (double)(1 << 30));
+    }
+}
+
+static void bit_reverse(int32_t *data) {
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < U4RK_HILBERT_POINTS - 1u; ++i) {
+        if (i < j) {
+            int32_t re = data[2u * i];
+            int32_t im = data[2u * i + 1u];
+            data[2u * i] = data[2u * j];
+            data[2u * i + 1u] = data[2u * j + 1u];
+            data[2u * j] = re;
+            data[2u * j + 1u] = im;
+        }
+        uint32_t bit = U4RK_HILBERT_POINTS >> 1;
+        while (j & bit) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+}
+
+/* Radix-2 decimation in time on interleaved complex data.  The inverse
+ * halves every stage, so it is normalized by 1/2048 overall. */
+static void transform(int32_t *data, bool inverse) {
+    const int64_t round = (int64_t)1 << (U4RK_TWIDDLE_SHIFT - 1);
+    const int64_t half_round = (int64_t)1 << U4RK_TWIDDLE_SHIFT;
+    bit_reverse(data);
+    for (uint32_t size = 2u; size <= U4RK_HILBERT_POINTS; size <<= 1) {
+        uint32_t half = size / 2u;
+        uint32_t step = U4RK_SAMPLE_COUNT / size;
+        for (uint32_t j = 0; j < half; ++j) {
+            int32_t c;
+            int32_t s;
+            twiddle(j * step, &c, &s);
+            if (!inverse) {
+                s = -s;
+            }
+            for (uint32_t k = j; k < U4RK_HILBERT_POINTS; k += size) {
+                int32_t *a = &data[2u * k];
+                int32_t *b = &data[2u * (k + half)];
+                /* b * (c + js) */
+                int64_t t_re = (int64_t)b[0] * c - (int64_t)b[1] * s;
+                int64_t t_im = (int64_t)b[1] * c + (int64_t)b[0] * s;
+                if (inverse) {
+                    int64_t a_re = (int64_t)a[0] << U4RK_TWIDDLE_SHIFT;
+                    int64_t a_im = (int64_t)a[1] << U4RK_TWIDDLE_SHIFT;
+                    a[0] = (int32_t)((a_re + t_re + half_round) >>
+                                     (U4RK_TWIDDLE_SHIFT + 1));
+                    a[1] = (int32_t)((a_im + t_im + half_round) >>
+                                     (U4RK_TWIDDLE_SHIFT + 1));
+                    b[0] = (int32_t)((a_re - t_re + half_round) >>
+                                     (U4RK_TWIDDLE_SHIFT + 1));
+                    b[1] = (int32_t)((a_im - t_im + half_round) >>
+                                     (U4RK_TWIDDLE_SHIFT + 1));
+                } else {
+                    int32_t re = (int32_t)((t_re + round) >> U4RK_TWIDDLE_SHIFT);
+                    int32_t im = (int32_t)((t_im + round) >> U4RK_TWIDDLE_SHIFT);
+                    b[0] = a[0] - re;
+                    b[1] = a[1] - im;
+                    a[0] += re;
+                    a[1] += im;
+                }
+            }
+        }
+    }
+}
+
+/* With Z the transform of the even/odd packed input, the packed spectrum of
+ * the Hilbert transform is V[k] = j sin(t) Z[k] + cos(t) conj(Z[2048-k]),
+ * t = 2*pi*k/4096, and V[0] = 0 (DC and Nyquist carry no quadrature). */
+static void rotate_spectrum(int32_t *data) {
+    const int64_t round = (int64_t)1 << (U4RK_TWIDDLE_SHIFT - 1);
+    data[0] = 0;
+    data[1] = 0;
+    for (uint32_t k = 1; k < U4RK_HILBERT_POINTS / 2u; ++k) {
+        int32_t c;
+        int32_t s;
+        twiddle(k, &c, &s);
+        int32_t *z = &data[2u * k];
+        int32_t *mirror = &data[2u * (U4RK_HILBERT_POINTS - k)];
+        int64_t z_re = z[0];
+        int64_t z_im = z[1];
+        int64_t m_re = mirror[0];
+        int64_t m_im = mirror[1];
+        z[0] = (int32_t)((-s * z_im + c * m_re + round) >> U4RK_TWIDDLE_SHIFT);
+        z[1] = (int32_t)((s * z_re - c * m_im + round) >> U4RK_TWIDDLE_SHIFT);
+        mirror[0] = (int32_t)((-s * m_im - c * z_re + round) >>
+                              U4RK_TWIDDLE_SHIFT);
+        mirror[1] = (int32_t)((s * m_re + c * z_im + round) >>
+                              U4RK_TWIDDLE_SHIFT);
+    }
+    /* k = 1024: cos = 0, sin = 1, so V = jZ. */
+    int32_t *middle = &data[U4RK_HILBERT_POINTS];
+    int32_t re = middle[0];
+    middle[0] = -middle[1];
+    middle[1] = re;
+}
+
+void u4rk_hilbert_fixed(const uint16_t *samples, int32_t *quadrature) {
+    /* DC is discarded by the transform, so mid-scale is removed only to
+     * bound the input; even/odd samples form the real/imaginary parts. */
+    for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
+        quadrature[i] = ((int32_t)samples[i] - 512) *
+                        (1 << U4RK_HILBERT_INPUT_SHIFT);
+    }
+    transform(quadrature, false);
+    rotate_spectrum(quadrature);
+    transform(quadrature, true);
+    /* The inverse output is already the interleaved real result. */
+    const uint32_t shift =
+        U4RK_HILBERT_INPUT_SHIFT - U4RK_HILBERT_FRACTION_BITS;
+    for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
+        quadrature[i] = (quadrature[i] + (1 << (shift - 1u))) >> shift;
+    }
+}
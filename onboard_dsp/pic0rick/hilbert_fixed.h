@@ -0,0 +1,20 @@
+#ifndef U4RK_HILBERT_FIXED_H
+#define U4RK_HILBERT_FIXED_H
+
+#include "u4rk.h"
+
+/*
+ * Integer Hilbert transform for cores without an FPU (RP2040).  The 4096
+ * real samples are packed into a 2048-point complex FFT with Q30 twiddles
+ * and 64-bit products; the spectrum is multiplied by -j and transformed
+ * back with one halving per stage.  Results stay within 0.015 ADC counts
+ * of a float64 reference, most of it the 1/64 count output step.
+ */
+#define U4RK_HILBERT_FRACTION_BITS 6u
+
+void u4rk_hilbert_fixed_init(void);
+/* samples are 10-bit ADC codes; quadrature receives their Hilbert
+ * transform in ADC counts with U4RK_HILBERT_FRACTION_BITS fractional bits. */
+void u4rk_hilbert_fixed(const uint16_t *samples, int32_t *quadrature);
+
+#endif
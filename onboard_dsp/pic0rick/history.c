@@ -0,0 +1,106 @@
+#include "history.h"
+
+#include <string.h>
+
+typedef struct {
+    uint32_t sequence;
+    uint32_t offset;
+    uint32_t size;
+    uint8_t pins;
+} history_entry_t;
+
+static uint8_t history_bytes[U4RK_HISTORY_BYTES];
+static history_entry_t entries[U4RK_HISTORY_ENTRIES];
+static uint32_t first_entry;
+static uint32_t entry_count;
+/* End of the newest frame; the next one goes here unless it must wrap. */
+static uint32_t write_offset;
+
+static history_entry_t *entry_at(uint32_t age) {
+    return &entries[(first_entry + age) % U4RK_HISTORY_ENTRIES];
+}
+
+static history_entry_t *find_entry(uint32_t sequence) {
+    for (uint32_t age = entry_count; age-- != 0u;) {
+        history_entry_t *entry = entry_at(age);
+        if (entry->sequence == sequence) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void u4rk_history_reset(void) {
+    first_entry = 0;
+    entry_count = 0;
+    write_offset = 0;
+}
+
+bool u4rk_history_record(const uint8_t *frame, size_t size,
+                         uint32_t sequence) {
+    if (size < U4RK_HEADER_SIZE || size > U4RK_HISTORY_BYTES) {
+        return false;
+    }
+    uint32_t offset = write_offset;
+    bool wrapped = offset + size > U4RK_HISTORY_BYTES;
+    if (wrapped) {
+        offset = 0;
+    }
+    /* Frames sit in the ring oldest first, so the space needed (including
+     * a skipped tail when wrapping) is always held by the oldest ones. */
+    while (entry_count != 0u) {
+        history_entry_t *oldest = entry_at(0);
+        bool overlaps = oldest->offset < offset + size &&
+                        offset < oldest->offset + oldest->size;
+        if (entry_count < U4RK_HISTORY_ENTRIES && !overlaps &&
+            !(wrapped && oldest->offset >= write_offset)) {
+            break;
+        }
+        if (oldest->pins != 0u) {
+            return false;
+        }
+        first_entry = (first_entry + 1u) % U4RK_HISTORY_ENTRIES;
+        --entry_count;
+    }
+
+    uint8_t *copy = history_bytes + offset;
+    memcpy(copy, frame, size);
+    /* Flags are not covered by the payload CRC. */
+    uint16_t flags = (uint16_t)(copy[6] | (copy[7] << 8)) | U4RK_FLAG_RESENT;
+    copy[6] = (uint8_t)flags;
+    copy[7] = (uint8_t)(flags >> 8);
+    *entry_at(entry_count) = (history_entry_t){
+        .sequence = sequence,
+        .offset = offset,
+        .size = (uint32_t)size,
+    };
+    ++entry_count;
+    write_offset = offset + (uint32_t)size;
+    return true;
+}
+
+const uint8_t *u4rk_history_pin(uint32_t sequence, size_t *size) {
+    history_entry_t *entry = find_entry(sequence);
+    if (entry == NULL || entry->pins == UINT8_MAX) {
+        return NULL;
+    }
+    ++entry->pins;
+    *size = entry->size;
+    return history_bytes + entry->offset;
+}
+
+void u4rk_history_unpin(uint32_t sequence) {
+    history_entry_t *entry = find_entry(sequence);
+    if (entry != NULL && entry->pins != 0u) {
+        --entry->pins;
+    }
+}
+
+bool u4rk_history_range(uint32_t *oldest, uint32_t *newest) {
+    if (entry_count == 0u) {
+        return false;
+    }
+    *oldest = entry_at(0)->sequence;
+    *newest = entry_at(entry_count - 1u)->sequence;
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef U4RK_HISTORY_H
+#define U4RK_HISTORY_H
+
+#include "u4rk.h"
+
+/*
+ * Retransmission history: a copy of each data frame handed to USB, kept so
+ * "resend <sequence>" can recover a frame the host lost or received
+ * corrupted without restarting the stream.  Frames are stored whole in a
+ * byte ring with U4RK_FLAG_RESENT already set, and the oldest are evicted
+ * as space is needed.  A pinned frame (queued for resend) is never
+ * evicted; a new frame that would need its space is not recorded.
+ */
+#if U4RK_COMPACT_SRAM
+#define U4RK_HISTORY_BYTES    32768u
+#else
+#define U4RK_HISTORY_BYTES    65536u
+#endif
+#define U4RK_HISTORY_ENTRIES  32u
+
+void u4rk_history_reset(void);
+bool u4rk_history_record(const uint8_t *frame, size_t size,
+                         uint32_t sequence);
+/* Pins the frame with this sequence and returns it, or NULL once it has
+ * been evicted.  Every successful pin needs one u4rk_history_unpin. */
+const uint8_t *u4rk_history_pin(uint32_t sequence, size_t *size);
+void u4rk_history_unpin(uint32_t sequence);
+/* Oldest and newest recorded sequence; false while the history is empty. */
+bool u4rk_history_range(uint32_t *oldest, uint32_t *newest);
+
+#endif
@@ -4,20 +4,29 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "pico/multicore.h"
+#ifndef U4RK_SIMULATOR
 #include "pico/binary_info.h"
-#include "pico/stdlib.h"
+#endif
 
 #include "acquisition.h"
+#include "command_protocol.h"
 #include "dac.h"
 #include "dsp.h"
+#include "hal.h"
+#include "history.h"
 #include "pipeline.h"
+#include "protocol.h"
+#include "superframe.h"
+#include "telemetry.h"
 #include "u4rk.h"
+#include "usb_bench.h"
 #include "usb_transport.h"
 
 #define U4RK_COMMAND_BUFFER_SIZE 160u
 #define U4RK_RESPONSE_BUFFER_SIZE 512u
 #define U4RK_CONTROL_TIMEOUT_MS 2000u
+#define U4RK_RESPONSE_QUEUE_DEPTH 4u
+#define U4RK_RESEND_QUEUE_DEPTH 8u
 
 typedef struct {
     bool active;
@@ -25,6 +34,13 @@ typedef struct {
     uint32_t rate_hz;
     uint32_t interval_us;
     uint64_t next_capture_us;
+    /* Credit mode: each capture spends one host-granted credit, and no more
+     * frames are in flight than there are output slots, so nothing drops. */
+    bool credit_mode;
+    uint32_t credits;
+    uint32_t frames_outstanding;
+    /* Frames per superframe; 0 sends every frame on its own. */
+    uint32_t batch;
 } stream_state_t;
 
 static stream_state_t stream;
@@ -33,15 +49,53 @@ static uint8_t capture_raw_index;
 static u4rk_capture_job_t capture_job;
 static uint32_t next_sequence;
 static float alaw_reference = U4RK_ALAW_DEFAULT_REFERENCE;
+static float sparse_threshold = U4RK_SPARSE_DEFAULT_THRESHOLD;
 
 static char command_buffer[U4RK_COMMAND_BUFFER_SIZE];
 static size_t command_length;
+static bool command_ready;
+static uint8_t command_packet[U4RK_COMMAND_MAX_SIZE];
+static size_t packet_length;
+static bool packet_ready;
 static char response_buffer[U4RK_RESPONSE_BUFFER_SIZE];
 
+/* A request written as "@<id> <command>" is answered with a response frame
+ * on the binary stream instead of a text line, so it can be accepted while
+ * a frame is in flight.  deferred_route remembers who started the current
+ * operation for replies sent after the command returns. */
+typedef struct {
+    bool framed;
+    uint32_t request_id;
+} reply_route_t;
+
+static reply_route_t reply_route;
+static reply_route_t deferred_route;
+static uint8_t response_frames[U4RK_RESPONSE_QUEUE_DEPTH]
+                              [U4RK_HEADER_SIZE + U4RK_RESPONSE_BUFFER_SIZE];
+static size_t response_sizes[U4RK_RESPONSE_QUEUE_DEPTH];
+static uint32_t response_head;
+static uint32_t response_count;
+static bool response_in_flight;
+
+/* Frames pinned in the history for "resend", sent ahead of new data. */
+typedef struct {
+    uint32_t sequence;
+    const uint8_t *frame;
+    size_t size;
+} resend_t;
+
+static resend_t resends[U4RK_RESEND_QUEUE_DEPTH];
+static uint32_t resend_head;
+static uint32_t resend_count;
+static bool resend_in_flight;
+
 static bool output_slot_active;
 static uint8_t active_output_slot;
 static uint32_t active_output_sequence;
 static uint32_t active_output_session;
+static uint64_t active_output_started_us;
+static bool telemetry_pending;
+static bool telemetry_in_flight;
 static bool stop_pending;
 static bool dma_fault_pending;
 static bool legacy_capture_pending;
@@ -58,28 +112,73 @@ static u4rk_payload_type_t selftest_type;
 static uint32_t usb_session_id = 1u;
 static bool usb_was_mounted;
 
+/* Batched stream frames are copied out of the output slots into one
+ * superframe while the other one is on the wire.  A single-buffer build
+ * sends and fills the same one, so U4RK_SUPERFRAME_OTHER is then 0. */
+#define U4RK_SUPERFRAME_OTHER (U4RK_SUPERFRAME_BUFFERS - 1u)
+static u4rk_superframe_t superframes[U4RK_SUPERFRAME_BUFFERS];
+static uint8_t superframe_filling;
+static bool superframe_in_flight;
+static uint64_t superframe_started_us;
+
 static uint16_t legacy_read_buffer[U4RK_SAMPLE_COUNT];
+static uint8_t telemetry_frame[U4RK_HEADER_SIZE + U4RK_TELEMETRY_PAYLOAD_SIZE];
 
-static bool send_formatted(const char *prefix, const char *format, va_list args) {
-    int used = snprintf(response_buffer, sizeof(response_buffer), "%s", prefix);
-    if (used < 0 || (size_t)used >= sizeof(response_buffer)) {
-        return false;
-    }
-    int added = vsnprintf(response_buffer + used, sizeof(response_buffer) - used,
-                          format, args);
-    if (added < 0) {
+static bool queue_response_frame(size_t length, bool error) {
+    if (response_count == U4RK_RESPONSE_QUEUE_DEPTH) {
         return false;
     }
+    uint32_t index =
+        (response_head + response_count) % U4RK_RESPONSE_QUEUE_DEPTH;
+    uint8_t *frame = response_frames[index];
+    memcpy(frame + U4RK_HEADER_SIZE, response_buffer, length);
+    u4rk_frame_header_t header = {
+        .payload_type = U4RK_PAYLOAD_RESPONSE,
+        .flags = error ? U4RK_FLAG_RESPONSE_ERROR : 0u,
+        .sequence = reply_route.request_id,
+        .sample_count = 0,
+        .sample_rate_hz = U4RK_SAMPLE_RATE_HZ,
+        .payload_bytes = (uint32_t)length,
+        .capture_timestamp_us = u4rk_hal_time_us(),
+        .alaw_reference = alaw_reference,
+        .pulse = u4rk_pulser_get_config(),
+        .dropped_frames = u4rk_pipeline_dropped_frames(),
+        .payload_crc32 = u4rk_crc32(frame + U4RK_HEADER_SIZE, length),
+    };
+    u4rk_serialize_header(frame, &header);
+    response_sizes[index] = U4RK_HEADER_SIZE + length;
+    ++response_count;
+    return true;
+}
+
+/* Sends response_buffer as a text line or a response frame. */
+static bool emit_response(bool error) {
     size_t length = strnlen(response_buffer, sizeof(response_buffer));
     if (length + 2u >= sizeof(response_buffer)) {
         length = sizeof(response_buffer) - 3u;
     }
+    if (reply_route.framed) {
+        return queue_response_frame(length, error);
+    }
     response_buffer[length++] = '\r';
     response_buffer[length++] = '\n';
     return u4rk_usb_write_blocking(response_buffer, length,
                                     U4RK_CONTROL_TIMEOUT_MS);
 }
 
+static bool send_formatted(const char *prefix, const char *format, va_list args) {
+    int used = snprintf(response_buffer, sizeof(response_buffer), "%s", prefix);
+    if (used < 0 || (size_t)used >= sizeof(response_buffer)) {
+        return false;
+    }
+    int added = vsnprintf(response_buffer + used, sizeof(response_buffer) - used,
+                          format, args);
+    if (added < 0) {
+        return false;
+    }
+    return emit_response(false);
+}
+
 static bool send_ok(const char *format, ...) {
     va_list args;
     va_start(args, format);
@@ -104,14 +203,7 @@ static bool send_error(const char *code, const char *format, ...) {
     if (added < 0) {
         return false;
     }
-    size_t length = strnlen(response_buffer, sizeof(response_buffer));
-    if (length + 2u >= sizeof(response_buffer)) {
-        length = sizeof(response_buffer) - 3u;
-    }
-    response_buffer[length++] = '\r';
-    response_buffer[length++] = '\n';
-    return u4rk_usb_write_blocking(response_buffer, length,
-                                    U4RK_CONTROL_TIMEOUT_MS);
+    return emit_response(true);
 }
 
 static bool parse_u32(const char *text, uint32_t *value) {
@@ -145,23 +237,25 @@ static bool parse_payload_type(const char *text,
     if (text == NULL) {
         return false;
     }
-    if (strcmp(text, "raw") == 0) {
-        *type = U4RK_PAYLOAD_RAW;
-    } else if (strcmp(text, "envelope") == 0) {
-        *type = U4RK_PAYLOAD_ENVELOPE;
-    } else if (strcmp(text, "alaw") == 0) {
-        *type = U4RK_PAYLOAD_ALAW;
-    } else {
-        return false;
+    for (uint8_t i = 0; i < U4RK_PAYLOAD_TYPE_COUNT; ++i) {
+        const char *name = u4rk_payload_type_name(i);
+        if (name != NULL && strcmp(text, name) == 0) {
+            *type = (u4rk_payload_type_t)i;
+            return true;
+        }
     }
-    return true;
+    return false;
 }
 
-static uint32_t maximum_rate(u4rk_payload_type_t type) {
+static uint32_t compiled_maximum_rate(u4rk_payload_type_t type) {
     switch (type) {
         case U4RK_PAYLOAD_RAW:
+        case U4RK_PAYLOAD_RAW_RICE:
             return U4RK_RAW_MAX_RATE_HZ;
         case U4RK_PAYLOAD_ENVELOPE:
+        case U4RK_PAYLOAD_ENVELOPE_F16:
+        case U4RK_PAYLOAD_ENVELOPE_U16:
+        case U4RK_PAYLOAD_ENVELOPE_SPARSE:
             return U4RK_ENVELOPE_MAX_RATE_HZ;
         case U4RK_PAYLOAD_ALAW:
             return U4RK_ALAW_MAX_RATE_HZ;
@@ -170,9 +264,50 @@ static uint32_t maximum_rate(u4rk_payload_type_t type) {
     }
 }
 
+/* The measured feasible rate, capped at the credit-mode ceiling, once a
+ * frame of this type has been timed; the compiled limit until then. */
+static uint32_t maximum_rate(u4rk_payload_type_t type) {
+    uint32_t measured = u4rk_telemetry_feasible_rate_hz(
+        (uint8_t)type, u4rk_hal_time_us());
+    if (measured == 0u) {
+        return compiled_maximum_rate(type);
+    }
+    return measured < U4RK_CREDIT_MAX_RATE_HZ ? measured
+                                              : U4RK_CREDIT_MAX_RATE_HZ;
+}
+
+static void note_stream_frame_done(void) {
+    if (stream.credit_mode && stream.frames_outstanding != 0u) {
+        --stream.frames_outstanding;
+    }
+}
+
+static bool superframes_idle(void) {
+    return !superframe_in_flight &&
+           superframes[superframe_filling].frame_count == 0u;
+}
+
+static void abandon_superframes(void) {
+    uint32_t lost = superframes[superframe_filling].frame_count;
+    if (superframe_in_flight && U4RK_SUPERFRAME_OTHER != 0u) {
+        lost +=
+            superframes[superframe_filling ^ U4RK_SUPERFRAME_OTHER].frame_count;
+    }
+    for (uint32_t i = 0; i < lost; ++i) {
+        u4rk_pipeline_note_usb_drop();
+    }
+    for (uint32_t i = 0; i < U4RK_SUPERFRAME_BUFFERS; ++i) {
+        u4rk_superframe_reset(&superframes[i]);
+    }
+    superframe_filling = 0;
+    superframe_in_flight = false;
+}
+
 static bool operation_busy(void) {
     return capture_inflight || legacy_capture_pending || selftest_active ||
-           output_slot_active || u4rk_usb_tx_busy() ||
+           output_slot_active || telemetry_pending || !superframes_idle() ||
+           u4rk_usb_bench_active() ||
+           u4rk_usb_tx_busy() ||
            u4rk_pipeline_has_pending_output() ||
            !u4rk_pipeline_processing_idle();
 }
@@ -195,8 +330,9 @@ static bool begin_capture(u4rk_payload_type_t type, uint16_t extra_flags) {
         .sequence = next_sequence++,
         .session_id = usb_session_id,
         .sample_rate_hz = U4RK_SAMPLE_RATE_HZ,
-        .capture_timestamp_us = time_us_64(),
+        .capture_timestamp_us = u4rk_hal_time_us(),
         .alaw_reference = alaw_reference,
+        .sparse_threshold = sparse_threshold,
         .pulse = u4rk_pulser_get_config(),
     };
     if (!u4rk_capture_start(raw_buffer)) {
@@ -215,7 +351,10 @@ static void poll_capture(void) {
     u4rk_capture_state_t state = u4rk_capture_poll();
     if (state == U4RK_CAPTURE_DONE) {
         capture_inflight = false;
-        u4rk_pipeline_submit(&capture_job);
+        capture_job.dma_done_us = u4rk_hal_time_us();
+        if (!u4rk_pipeline_submit(&capture_job) && stream.active) {
+            note_stream_frame_done();
+        }
     } else if (state == U4RK_CAPTURE_DMA_FAULT) {
         capture_inflight = false;
         u4rk_pipeline_release_raw(capture_raw_index);
@@ -258,11 +397,202 @@ static void advance_selftest(void) {
     }
 }
 
+static void send_telemetry_frame(void) {
+    uint8_t *payload = telemetry_frame + U4RK_HEADER_SIZE;
+    u4rk_telemetry_serialize(payload);
+    u4rk_frame_header_t header = {
+        .payload_type = U4RK_PAYLOAD_TELEMETRY,
+        .sequence = 0,
+        .sample_count = U4RK_TELEMETRY_BUCKETS,
+        .sample_rate_hz = U4RK_SAMPLE_RATE_HZ,
+        .payload_bytes = U4RK_TELEMETRY_PAYLOAD_SIZE,
+        .capture_timestamp_us = u4rk_hal_time_us(),
+        .alaw_reference = alaw_reference,
+        .pulse = u4rk_pulser_get_config(),
+        .dropped_frames = u4rk_pipeline_dropped_frames(),
+        .payload_crc32 = u4rk_crc32(payload, U4RK_TELEMETRY_PAYLOAD_SIZE),
+    };
+    u4rk_serialize_header(telemetry_frame, &header);
+    telemetry_in_flight =
+        u4rk_usb_tx_start(telemetry_frame, sizeof(telemetry_frame));
+}
+
+static void complete_superframe(bool failed) {
+    u4rk_superframe_t *sent =
+        &superframes[superframe_filling ^ U4RK_SUPERFRAME_OTHER];
+    uint64_t now = u4rk_hal_time_us();
+    for (uint32_t i = 0; i < sent->frame_count; ++i) {
+        if (failed) {
+            u4rk_pipeline_note_usb_drop();
+        } else {
+            u4rk_telemetry_record_frame(
+                &sent->timing[i], superframe_started_us, now);
+        }
+    }
+    u4rk_superframe_reset(sent);
+    superframe_in_flight = false;
+}
+
+static bool superframe_should_flush(const u4rk_superframe_t *filling,
+                                    size_t frame_size) {
+    if (filling->frame_count == 0u) {
+        return false;
+    }
+    if (filling->frame_count >= stream.batch ||
+        !u4rk_superframe_fits(filling, frame_size) ||
+        u4rk_hal_time_us() - filling->opened_us >= U4RK_SUPERFRAME_MAX_AGE_US) {
+        return true;
+    }
+    /* A credit stream that has run dry will not add another frame. */
+    return stream.credit_mode && stream.credits == 0u && !capture_inflight &&
+           !u4rk_pipeline_has_pending_output() &&
+           u4rk_pipeline_processing_idle();
+}
+
+static void pack_stream_outputs(void) {
+    if (stop_pending || dma_fault_pending ||
+        (U4RK_SUPERFRAME_OTHER == 0u && superframe_in_flight)) {
+        return;
+    }
+    u4rk_superframe_t *filling = &superframes[superframe_filling];
+    const uint8_t *data;
+    size_t size;
+    uint8_t slot;
+    uint32_t sequence;
+    uint32_t session_id;
+    /* Compressed and sparse frames vary in size, so check the next frame;
+     * with nothing ready, assume the largest frame of the stream type. */
+    size_t frame_size;
+    while (filling->frame_count < stream.batch &&
+           u4rk_pipeline_peek_output_size(&frame_size) &&
+           u4rk_superframe_fits(filling, frame_size) &&
+           u4rk_pipeline_take_output(
+               &slot, &data, &size, &sequence, &session_id)) {
+        if (session_id == usb_session_id) {
+            u4rk_superframe_append(filling, data, size,
+                                   u4rk_pipeline_output_timing(slot),
+                                   u4rk_hal_time_us());
+            (void)u4rk_history_record(data, size, sequence);
+        } else {
+            u4rk_pipeline_note_usb_drop();
+        }
+        /* The copy frees the slot at once, so core 1 keeps running while
+         * the previous superframe is still being sent. */
+        u4rk_pipeline_release_output(slot);
+        note_stream_frame_done();
+    }
+    if (!u4rk_pipeline_peek_output_size(&frame_size)) {
+        frame_size = U4RK_HEADER_SIZE +
+                     u4rk_pipeline_payload_size((uint8_t)stream.type);
+    }
+
+    if (superframe_in_flight || u4rk_usb_tx_busy() ||
+        !superframe_should_flush(filling, frame_size)) {
+        return;
+    }
+    size_t superframe_size =
+        u4rk_superframe_finish(filling, u4rk_pipeline_dropped_frames());
+    if (u4rk_usb_tx_start(filling->bytes, superframe_size)) {
+        superframe_in_flight = true;
+        superframe_started_us = u4rk_hal_time_us();
+        superframe_filling ^= U4RK_SUPERFRAME_OTHER;
+    } else {
+        for (uint32_t i = 0; i < filling->frame_count; ++i) {
+            u4rk_pipeline_note_usb_drop();
+        }
+        u4rk_superframe_reset(filling);
+    }
+}
+
+static void pop_resend(void) {
+    u4rk_history_unpin(resends[resend_head].sequence);
+    resend_head = (resend_head + 1u) % U4RK_RESEND_QUEUE_DEPTH;
+    --resend_count;
+}
+
+/* During a stream only framed requests are answered, as for "credit". */
+static void queue_resend(const char *sequence_text, const char *extra) {
+    bool answer = reply_route.framed || !stream.active;
+    uint32_t sequence;
+    if (!parse_u32(sequence_text, &sequence) || extra != NULL) {
+        if (answer) {
+            send_error("ARG", "expected a frame sequence");
+        }
+        return;
+    }
+    if (resend_count == U4RK_RESEND_QUEUE_DEPTH) {
+        if (answer) {
+            send_error("BUSY", "resend queue full");
+        }
+        return;
+    }
+    size_t size;
+    const uint8_t *frame = u4rk_history_pin(sequence, &size);
+    if (frame == NULL) {
+        if (answer) {
+            send_error("MISSING", "sequence %u not in history", sequence);
+        }
+        return;
+    }
+    resends[(resend_head + resend_count) % U4RK_RESEND_QUEUE_DEPTH] =
+        (resend_t){.sequence = sequence, .frame = frame, .size = size};
+    ++resend_count;
+    if (answer) {
+        send_ok("resend seq=%u bytes=%u", sequence, (unsigned)size);
+    }
+}
+
+static void report_usb_bench(void) {
+    const u4rk_usb_bench_result_t *bench = u4rk_usb_bench_result();
+    uint64_t bytes = (uint64_t)bench->frames_sent *
+                     (U4RK_HEADER_SIZE + bench->payload_bytes);
+    reply_route = deferred_route;
+    send_ok("bench done frames=%u failed=%u bytes=%llu elapsed_us=%llu "
+            "kb_per_s=%llu max_tx_us=%u",
+            bench->frames_sent, bench->frames_failed,
+            (unsigned long long)bytes,
+            (unsigned long long)bench->elapsed_us,
+            (unsigned long long)(bench->elapsed_us != 0u
+                ? bytes * 1000u / bench->elapsed_us : 0u),
+            bench->max_tx_us);
+    reply_route = (reply_route_t){0};
+}
+
 static void poll_output(void) {
+    if (telemetry_in_flight && !u4rk_usb_tx_busy()) {
+        (void)u4rk_usb_tx_take_failed();
+        telemetry_in_flight = false;
+    }
+
+    if (response_in_flight && !u4rk_usb_tx_busy()) {
+        (void)u4rk_usb_tx_take_failed();
+        response_in_flight = false;
+        response_head = (response_head + 1u) % U4RK_RESPONSE_QUEUE_DEPTH;
+        --response_count;
+    }
+
+    if (superframe_in_flight && !u4rk_usb_tx_busy()) {
+        complete_superframe(u4rk_usb_tx_take_failed());
+    }
+
+    if (resend_in_flight && !u4rk_usb_tx_busy()) {
+        (void)u4rk_usb_tx_take_failed();
+        resend_in_flight = false;
+        pop_resend();
+    }
+
     if (output_slot_active && !u4rk_usb_tx_busy()) {
         bool failed = u4rk_usb_tx_take_failed();
+        const u4rk_frame_timing_t *timing =
+            u4rk_pipeline_output_timing(active_output_slot);
+        /* Self-test vectors never pass through the capture DMA. */
+        if (!failed && timing->dma_done_us != 0u) {
+            u4rk_telemetry_record_frame(
+                timing, active_output_started_us, u4rk_hal_time_us());
+        }
         u4rk_pipeline_release_output(active_output_slot);
         output_slot_active = false;
+        note_stream_frame_done();
         bool was_pending_selftest = selftest_frame_pending &&
             active_output_session == usb_session_id &&
             active_output_sequence == selftest_pending_sequence;
@@ -277,6 +607,39 @@ static void poll_output(void) {
         }
     }
 
+    /* Response frames, resent frames, then a requested telemetry frame go
+     * out between two data frames. */
+    if (response_count != 0u && !u4rk_usb_tx_busy()) {
+        response_in_flight = u4rk_usb_tx_start(
+            response_frames[response_head], response_sizes[response_head]);
+        if (!response_in_flight) {
+            response_head = (response_head + 1u) % U4RK_RESPONSE_QUEUE_DEPTH;
+            --response_count;
+        }
+    }
+    if (resend_count != 0u && !u4rk_usb_tx_busy()) {
+        const resend_t *resend = &resends[resend_head];
+        resend_in_flight = u4rk_usb_tx_start(resend->frame, resend->size);
+        if (!resend_in_flight) {
+            pop_resend();
+        }
+    }
+    if (u4rk_usb_bench_active()) {
+        if (u4rk_usb_bench_poll()) {
+            report_usb_bench();
+        }
+        return;
+    }
+    if (telemetry_pending && !output_slot_active && !u4rk_usb_tx_busy()) {
+        telemetry_pending = false;
+        send_telemetry_frame();
+    }
+
+    if (stream.active && stream.batch != 0u) {
+        pack_stream_outputs();
+        return;
+    }
+
     if (!output_slot_active && !u4rk_usb_tx_busy() &&
         !stop_pending && !dma_fault_pending) {
         const uint8_t *data;
@@ -290,16 +653,21 @@ static void poll_output(void) {
                 /* Core 1 may finish an old job after its CDC session closes. */
                 u4rk_pipeline_release_output(slot);
                 u4rk_pipeline_note_usb_drop();
+                note_stream_frame_done();
                 continue;
             }
+            /* Kept even if this transfer fails, so the host can ask again. */
+            (void)u4rk_history_record(data, size, sequence);
             if (u4rk_usb_tx_start(data, size)) {
                 output_slot_active = true;
                 active_output_slot = slot;
                 active_output_sequence = sequence;
                 active_output_session = session_id;
+                active_output_started_us = u4rk_hal_time_us();
             } else {
                 u4rk_pipeline_release_output(slot);
                 u4rk_pipeline_note_usb_drop();
+                note_stream_frame_done();
                 /* Never leave a failed self-test transfer permanently busy. */
                 if (selftest_frame_pending &&
                     sequence == selftest_pending_sequence) {
@@ -325,11 +693,25 @@ static void schedule_stream(void) {
     if (!stream.active || capture_inflight) {
         return;
     }
-    uint64_t now = time_us_64();
+    if (stream.credit_mode &&
+        (stream.credits == 0u ||
+         stream.frames_outstanding >= U4RK_OUTPUT_SLOT_COUNT)) {
+        /* Wait for the host or the pipeline instead of dropping. */
+        return;
+    }
+    uint64_t now = u4rk_hal_time_us();
     if (now < stream.next_capture_us) {
         return;
     }
-    if (!begin_capture(stream.type, 0)) {
+    if (begin_capture(stream.type, 0)) {
+        if (stream.credit_mode) {
+            --stream.credits;
+            ++stream.frames_outstanding;
+        }
+    } else if (stream.credit_mode) {
+        /* No raw buffer yet; retry on the next pass. */
+        return;
+    } else {
         u4rk_pipeline_note_processing_drop();
     }
     stream.next_capture_us += stream.interval_us;
@@ -374,6 +756,7 @@ static void schedule_selftest(void) {
 
 static void stop_stream(void) {
     stream.active = false;
+    stream.credit_mode = false;
     u4rk_pulser_disarm();
     if (capture_inflight) {
         u4rk_capture_abort();
@@ -390,10 +773,15 @@ static void send_help(void) {
         "commands=status|help|pulser arm|pulser disarm|"
         "pulse config <negative_ns> <damp_ns> <positive_ns> "
         "<neg-first|pos-first>|dac write <0..1023>|"
-        "dsp scale <reference>|dsp selftest|"
-        "acq <raw|envelope|alaw>|"
-        "stream start <raw|envelope|alaw> <rate_hz>|stream stop|"
-        "start acq|read");
+        "dsp scale <reference>|dsp threshold <counts>|dsp selftest|"
+        "acq <type>|"
+        "stream start <type> <rate_hz|max> [credit <n>] "
+        "[batch <n>]|"
+        "credit <n>|stream stop|data <cdc|vendor>|"
+        "bench usb <bytes> <count>|resend <sequence>|"
+        "stats|stats reset|stats frame|start acq|read "
+        "framed=@<id> <command> binary=0xC5 packets "
+        "types=raw|rawz|envelope|envelope-f16|envelope-u16|sparse|alaw");
 }
 
 static void send_status(void) {
@@ -401,11 +789,11 @@ static void send_status(void) {
     u4rk_dsp_metrics_t metrics;
     u4rk_pipeline_get_metrics(&metrics);
     send_ok(
-        "board=pic0rick package=RP2350A firmware=%s "
-        "dsp_backend=f32-rfft-hilbert "
+        "board=pic0rick package=" U4RK_CHIP_NAME " firmware=%s "
+        "dsp_backend=" U4RK_DSP_BACKEND_NAME " "
         "samples=%u sample_rate=%u "
-        "pulser=%s pulse=%u/%u/%u/%s dac=%u scale=%.6g "
-        "stream=%s/%u drops=%u stages_us=%u/%u/%u/%u/%u/%u "
+        "pulser=%s pulse=%u/%u/%u/%s dac=%u scale=%.6g threshold=%.6g "
+        "stream=%s/%u data=%s drops=%u stages_us=%u/%u/%u/%u/%u/%u "
         "dsp_us=%u worst_us=%u performance=%s "
         "envelope_max_rate=%u alaw_max_rate=%u cmsis=%s",
         PICO_PROGRAM_VERSION_STRING,
@@ -414,17 +802,47 @@ static void send_status(void) {
         pulse.negative_ns, pulse.damp_ns, pulse.positive_ns,
         pulse.order == U4RK_PULSE_NEGATIVE_FIRST ? "neg-first" : "pos-first",
         u4rk_dac_last_value(), (double)alaw_reference,
+        (double)sparse_threshold,
         stream.active ? "on" : "off", stream.rate_hz,
+        u4rk_usb_data_channel_name(u4rk_usb_data_channel()),
         u4rk_pipeline_dropped_frames(),
         metrics.preprocess_us, metrics.forward_fft_us, metrics.mask_us,
         metrics.inverse_fft_us, metrics.magnitude_us, metrics.alaw_us,
         metrics.total_us, metrics.worst_total_us,
         metrics.worst_total_us <= U4RK_DSP_TARGET_US
             ? "ok" : "over-budget",
-        U4RK_ENVELOPE_MAX_RATE_HZ, U4RK_ALAW_MAX_RATE_HZ,
+        maximum_rate(U4RK_PAYLOAD_ENVELOPE), maximum_rate(U4RK_PAYLOAD_ALAW),
         U4RK_CMSIS_DSP_VERSION);
 }
 
+static void send_stats(void) {
+    char stages[320];
+    size_t used = 0;
+    for (uint32_t i = 0; i < U4RK_STAGE_COUNT; ++i) {
+        u4rk_stage_t stage = (u4rk_stage_t)i;
+        int count = snprintf(
+            stages + used, sizeof(stages) - used, "%s%s_us=%u/%u/%u",
+            i == 0u ? "" : " ", u4rk_telemetry_stage_name(stage),
+            u4rk_telemetry_percentile_us(stage, 500u),
+            u4rk_telemetry_percentile_us(stage, 990u),
+            u4rk_telemetry_stage(stage)->max_us);
+        if (count < 0 || (size_t)count >= sizeof(stages) - used) {
+            break;
+        }
+        used += (size_t)count;
+    }
+    uint32_t job_high_water;
+    uint32_t ready_high_water;
+    uint32_t processing_drops;
+    uint32_t usb_drops;
+    u4rk_pipeline_get_high_water(&job_high_water, &ready_high_water);
+    u4rk_pipeline_get_drop_counts(&processing_drops, &usb_drops);
+    send_ok("frames=%u %s jobs_hwm=%u ready_hwm=%u "
+            "processing_drops=%u usb_drops=%u",
+            u4rk_telemetry_stage(U4RK_STAGE_TOTAL)->count, stages,
+            job_high_water, ready_high_water, processing_drops, usb_drops);
+}
+
 static void legacy_read(void) {
     if (!u4rk_pipeline_copy_latest_raw(legacy_read_buffer)) {
         send_error("NO_DATA", "no completed acquisition");
@@ -459,16 +877,43 @@ static void process_command(char *line) {
     char *save;
     char *first = strtok_r(line, " \t", &save);
     if (first == NULL) {
+        if (reply_route.framed) {
+            send_error("COMMAND", "empty request");
+        }
         return;
     }
     char *second = strtok_r(NULL, " \t", &save);
 
     if (stream.active) {
+        /* No unframed text is emitted while a stream is active; framed
+         * requests are always answered. */
         if (strcmp(first, "stream") == 0 && second != NULL &&
             strcmp(second, "stop") == 0) {
+            /* Answered by "stream stopped" once the pipeline drains. */
+            deferred_route = reply_route;
             stop_stream();
+        } else if (strcmp(first, "stats") == 0 && second != NULL &&
+                   strcmp(second, "frame") == 0) {
+            telemetry_pending = true;
+            if (reply_route.framed) {
+                send_ok("stats frame");
+            }
+        } else if (strcmp(first, "credit") == 0 && stream.credit_mode) {
+            uint32_t granted;
+            if (parse_u32(second, &granted)) {
+                stream.credits = granted > U4RK_CREDIT_LIMIT - stream.credits
+                    ? U4RK_CREDIT_LIMIT : stream.credits + granted;
+                if (reply_route.framed) {
+                    send_ok("credits=%u", stream.credits);
+                }
+            } else if (reply_route.framed) {
+                send_error("ARG", "expected a credit count");
+            }
+        } else if (strcmp(first, "resend") == 0) {
+            queue_resend(second, strtok_r(NULL, " \t", &save));
+        } else if (reply_route.framed) {
+            send_error("BUSY", "stream active");
         }
-        /* No unframed text is emitted while a stream is active. */
         return;
     }
 
@@ -481,6 +926,25 @@ static void process_command(char *line) {
         return;
     }
 
+    if (strcmp(first, "stats") == 0) {
+        if (second == NULL) {
+            send_stats();
+        } else if (strcmp(second, "reset") == 0) {
+            u4rk_telemetry_reset();
+            u4rk_pipeline_reset_high_water();
+            send_ok("stats reset");
+        } else if (strcmp(second, "frame") == 0) {
+            /* The binary frame itself is the response. */
+            telemetry_pending = true;
+            if (reply_route.framed) {
+                send_ok("stats frame");
+            }
+        } else {
+            send_error("ARG", "expected reset or frame");
+        }
+        return;
+    }
+
     if (strcmp(first, "pulser") == 0 && second != NULL) {
         if (operation_busy()) {
             send_error("BUSY", "operation in progress");
@@ -554,6 +1018,30 @@ static void process_command(char *line) {
         return;
     }
 
+    if (strcmp(first, "data") == 0) {
+        char *extra = strtok_r(NULL, " \t", &save);
+        u4rk_usb_data_channel_t channel;
+        if (second == NULL || extra != NULL) {
+            send_error("ARG", "expected cdc or vendor");
+            return;
+        } else if (strcmp(second, "cdc") == 0) {
+            channel = U4RK_USB_DATA_CDC;
+        } else if (strcmp(second, "vendor") == 0) {
+            channel = U4RK_USB_DATA_VENDOR;
+        } else {
+            send_error("ARG", "expected cdc or vendor");
+            return;
+        }
+        if (operation_busy()) {
+            send_error("BUSY", "operation in progress");
+        } else if (!u4rk_usb_set_data_channel(channel)) {
+            send_error("STATE", "vendor interface not configured");
+        } else {
+            send_ok("data=%s", u4rk_usb_data_channel_name(channel));
+        }
+        return;
+    }
+
     if (strcmp(first, "dsp") == 0 && second != NULL) {
         if (strcmp(second, "scale") == 0) {
             char *reference_text = strtok_r(NULL, " \t", &save);
@@ -569,6 +1057,20 @@ static void process_command(char *line) {
                 alaw_reference = reference;
                 send_ok("scale=%.6g", (double)alaw_reference);
             }
+        } else if (strcmp(second, "threshold") == 0) {
+            char *threshold_text = strtok_r(NULL, " \t", &save);
+            char *extra = strtok_r(NULL, " \t", &save);
+            float threshold;
+            if (operation_busy()) {
+                send_error("BUSY", "operation in progress");
+            } else if (!parse_float(threshold_text, &threshold) ||
+                       threshold < 0.0f || threshold > 2048.0f ||
+                       extra != NULL) {
+                send_error("RANGE", "threshold must be in [0,2048]");
+            } else {
+                sparse_threshold = threshold;
+                send_ok("threshold=%.6g", (double)sparse_threshold);
+            }
         } else if (strcmp(second, "selftest") == 0) {
             if (operation_busy()) {
                 send_error("BUSY", "operation in progress");
@@ -576,13 +1078,14 @@ static void process_command(char *line) {
                 selftest_active = true;
                 selftest_frame_pending = false;
                 selftest_case = 0;
+                deferred_route = reply_route;
                 selftest_type = U4RK_PAYLOAD_RAW;
                 send_ok("selftest frames=%u cases=%u",
                         (unsigned)u4rk_dsp_selftest_count() * 3u,
                         u4rk_dsp_selftest_count());
             }
         } else {
-            send_error("ARG", "expected scale or selftest");
+            send_error("ARG", "expected scale, threshold or selftest");
         }
         return;
     }
@@ -592,10 +1095,12 @@ static void process_command(char *line) {
         if (operation_busy()) {
             send_error("BUSY", "operation in progress");
         } else if (!parse_payload_type(second, &type)) {
-            send_error("ARG", "type must be raw, envelope, or alaw");
+            send_error("ARG", "type must be raw, rawz, envelope, envelope-f16, envelope-u16, "
+                       "sparse, or alaw");
         } else if (!begin_capture(type, 0)) {
             send_error("BUSY", "no acquisition buffer");
         } else {
+            deferred_route = reply_route;
             send_ok("capture started type=%s", second);
         }
         return;
@@ -605,28 +1110,112 @@ static void process_command(char *line) {
         strcmp(second, "start") == 0) {
         char *type_text = strtok_r(NULL, " \t", &save);
         char *rate_text = strtok_r(NULL, " \t", &save);
-        char *extra = strtok_r(NULL, " \t", &save);
         u4rk_payload_type_t type;
-        uint32_t rate;
+        uint32_t rate = 0;
+        uint32_t credits = 0;
+        uint32_t batch = 0;
+        bool credit_mode = false;
+        bool options_valid = true;
+        char *option;
+        while (options_valid &&
+               (option = strtok_r(NULL, " \t", &save)) != NULL) {
+            char *value = strtok_r(NULL, " \t", &save);
+            if (strcmp(option, "credit") == 0) {
+                credit_mode = true;
+                options_valid = parse_u32(value, &credits) &&
+                                credits <= U4RK_CREDIT_LIMIT;
+            } else if (strcmp(option, "batch") == 0) {
+                options_valid = parse_u32(value, &batch) && batch != 0u;
+            } else {
+                options_valid = false;
+            }
+        }
+        bool rate_is_max = rate_text != NULL && strcmp(rate_text, "max") == 0;
+        uint32_t rate_limit = 0;
+        uint32_t batch_limit = 0;
+        if (parse_payload_type(type_text, &type)) {
+            rate_limit = credit_mode ? U4RK_CREDIT_MAX_RATE_HZ
+                                     : maximum_rate(type);
+            /* Variable-size frames are packed by their actual size. */
+            batch_limit = type == U4RK_PAYLOAD_RAW_RICE ||
+                              type == U4RK_PAYLOAD_ENVELOPE_SPARSE
+                ? U4RK_SUPERFRAME_MAX_FRAMES
+                : u4rk_superframe_capacity(
+                      U4RK_HEADER_SIZE +
+                      u4rk_pipeline_payload_size((uint8_t)type));
+        }
         if (operation_busy()) {
             send_error("BUSY", "operation in progress");
         } else if (!parse_payload_type(type_text, &type) ||
-                   !parse_u32(rate_text, &rate) || extra != NULL) {
-            send_error("ARG", "expected type and integer rate");
-        } else if (rate < 1u || rate > maximum_rate(type)) {
-            send_error("RATE", "allowed rate is 1..%u Hz",
-                       maximum_rate(type));
+                   (!rate_is_max && !parse_u32(rate_text, &rate)) ||
+                   !options_valid) {
+            send_error("ARG",
+                       "expected type, rate, [credit <n>] and [batch <n>]");
+        } else if (rate_is_max && !credit_mode) {
+            send_error("RATE", "max rate requires credit mode");
+        } else if (!rate_is_max && (rate < 1u || rate > rate_limit)) {
+            send_error("RATE", "allowed rate is 1..%u Hz", rate_limit);
+        } else if (batch > batch_limit) {
+            send_error("ARG", "batch allowed is 1..%u for %s", batch_limit,
+                       type_text);
         } else {
-            send_ok("stream started type=%s rate=%u", type_text, rate);
+            char credits_label[12] = "off";
+            if (credit_mode) {
+                snprintf(credits_label, sizeof(credits_label), "%u", credits);
+            }
+            send_ok("stream started type=%s rate=%s max_rate=%u "
+                    "credits=%s batch=%u",
+                    type_text, rate_text, maximum_rate(type), credits_label,
+                    batch > 1u ? batch : 1u);
+            deferred_route = reply_route;
             stream.active = true;
             stream.type = type;
             stream.rate_hz = rate;
-            stream.interval_us = 1000000u / rate;
-            stream.next_capture_us = time_us_64();
+            stream.interval_us = rate_is_max ? 0u : 1000000u / rate;
+            stream.next_capture_us = u4rk_hal_time_us();
+            stream.credit_mode = credit_mode;
+            stream.credits = credits;
+            stream.frames_outstanding = 0;
+            stream.batch = batch > 1u ? batch : 0u;
+            abandon_superframes();
+        }
+        return;
+    }
+
+    if (strcmp(first, "bench") == 0 && second != NULL &&
+        strcmp(second, "usb") == 0) {
+        char *bytes_text = strtok_r(NULL, " \t", &save);
+        char *count_text = strtok_r(NULL, " \t", &save);
+        char *extra = strtok_r(NULL, " \t", &save);
+        uint32_t bytes;
+        uint32_t count;
+        if (operation_busy()) {
+            send_error("BUSY", "operation in progress");
+        } else if (!parse_u32(bytes_text, &bytes) ||
+                   !parse_u32(count_text, &count) || extra != NULL ||
+                   !u4rk_usb_bench_start(bytes, count)) {
+            send_error("RANGE", "bench usb <1..%u bytes> <1..%u frames>",
+                       (unsigned)U4RK_USB_BENCH_MAX_PAYLOAD,
+                       U4RK_USB_BENCH_MAX_FRAMES);
+        } else {
+            /* "bench done" follows the last frame. */
+            deferred_route = reply_route;
+            send_ok("bench usb bytes=%u count=%u data=%s", bytes, count,
+                    u4rk_usb_data_channel_name(u4rk_usb_data_channel()));
         }
         return;
     }
 
+    if (strcmp(first, "resend") == 0) {
+        queue_resend(second, strtok_r(NULL, " \t", &save));
+        return;
+    }
+
+    if (strcmp(first, "credit") == 0) {
+        send_error("STATE", "no credit-mode stream is active");
+        return;
+    }
+
     if (strcmp(first, "stream") == 0 && second != NULL &&
         strcmp(second, "stop") == 0) {
         send_ok("stream already stopped");
@@ -640,6 +1229,7 @@ static void process_command(char *line) {
         } else if (!begin_capture(U4RK_PAYLOAD_NONE, 0)) {
             send_error("BUSY", "no acquisition buffer");
         } else {
+            deferred_route = reply_route;
             legacy_capture_pending = true;
             legacy_capture_sequence = capture_job.sequence;
             send_ok("legacy acquisition started");
@@ -650,6 +1240,8 @@ static void process_command(char *line) {
     if (strcmp(first, "read") == 0 && second == NULL) {
         if (operation_busy()) {
             send_error("BUSY", "operation in progress");
+        } else if (reply_route.framed) {
+            send_error("ARG", "read is text-only; use acq raw");
         } else {
             legacy_read();
         }
@@ -659,25 +1251,131 @@ static void process_command(char *line) {
     send_error("COMMAND", "unknown command");
 }
 
+/* Parses an "@<id> " prefix off the line and selects the reply route. */
+static char *take_request_route(char *line) {
+    reply_route = (reply_route_t){0};
+    if (line[0] != '@') {
+        return line;
+    }
+    char *end;
+    unsigned long id = strtoul(line + 1, &end, 10);
+    if (end == line + 1 || (*end != ' ' && *end != '\t' && *end != '\0') ||
+        id > UINT32_MAX) {
+        return NULL;
+    }
+    reply_route.framed = true;
+    reply_route.request_id = (uint32_t)id;
+    return end;
+}
+
+/* Returns false while the line has to wait.  An unframed reply must not be
+ * mixed into a one-shot frame in flight, and a framed one needs room in the
+ * response queue.  Like a binary packet, a framed command that needs an
+ * idle device waits for the current operation instead of being refused. */
+static bool dispatch_command_line(void) {
+    bool framed = command_buffer[0] == '@';
+    if (framed && response_count == U4RK_RESPONSE_QUEUE_DEPTH) {
+        return false;
+    }
+    if (!framed && !stream.active &&
+        (output_slot_active || telemetry_pending || u4rk_usb_tx_busy() ||
+         u4rk_usb_bench_active() ||
+         u4rk_pipeline_has_pending_output())) {
+        return false;
+    }
+    char *command = take_request_route(command_buffer);
+    if (framed && command != NULL && !stream.active &&
+        !u4rk_command_line_is_immediate(command) && operation_busy()) {
+        reply_route = (reply_route_t){0};
+        return false;
+    }
+    if (command == NULL) {
+        if (!stream.active) {
+            send_error("ARG", "bad request id");
+        }
+    } else {
+        process_command(command);
+    }
+    reply_route = (reply_route_t){0};
+    command_ready = false;
+    command_length = 0;
+    return true;
+}
+
+/* Binary packets run in order, each once the previous operation is done,
+ * so a host can queue a whole sequence without waiting for replies. */
+static bool dispatch_command_packet(void) {
+    uint8_t opcode = command_packet[1];
+    if (response_count == U4RK_RESPONSE_QUEUE_DEPTH ||
+        (!stream.active && !u4rk_command_is_immediate(opcode) &&
+         operation_busy())) {
+        return false;
+    }
+    reply_route.framed = true;
+    reply_route.request_id =
+        (uint32_t)command_packet[4] | ((uint32_t)command_packet[5] << 8) |
+        ((uint32_t)command_packet[6] << 16) |
+        ((uint32_t)command_packet[7] << 24);
+    char line[U4RK_COMMAND_LINE_SIZE];
+    if (!u4rk_command_check_ok(command_packet, packet_length)) {
+        send_error("PACKET", "check byte mismatch");
+    } else if (!u4rk_command_to_text(command_packet, line, sizeof(line))) {
+        send_error("PACKET", "unknown opcode or bad arguments");
+    } else {
+        process_command(line);
+    }
+    reply_route = (reply_route_t){0};
+    packet_ready = false;
+    packet_length = 0;
+    return true;
+}
+
+/* Collects one byte of a binary packet; returns false if it must wait. */
+static bool take_packet_byte(uint8_t byte) {
+    command_packet[packet_length++] = byte;
+    if (packet_length < U4RK_COMMAND_HEADER_SIZE) {
+        return true;
+    }
+    if (packet_length == U4RK_COMMAND_HEADER_SIZE &&
+        !u4rk_command_header_ok(command_packet)) {
+        /* Not a packet after all; resynchronize on the next byte. */
+        packet_length = 0;
+        return true;
+    }
+    if (packet_length < U4RK_COMMAND_HEADER_SIZE + command_packet[2]) {
+        return true;
+    }
+    packet_ready = true;
+    return dispatch_command_packet();
+}
+
 static void poll_command_input(void) {
     /*
-     * During a stream, input is still consumed so "stream stop" always works.
-     * During a one-shot binary response, defer parsing to avoid mixing text
-     * into a frame already in flight.
+     * Input is consumed at all times so "stream stop" always works and
+     * framed requests are accepted during one-shot transfers; a completed
+     * line or packet that has to wait holds back further input.
      */
-    if (!stream.active &&
-        (output_slot_active || u4rk_usb_tx_busy() ||
-         u4rk_pipeline_has_pending_output())) {
+    if (command_ready && !dispatch_command_line()) {
+        return;
+    }
+    if (packet_ready && !dispatch_command_packet()) {
         return;
     }
 
     int character;
     while ((character = u4rk_usb_read_char()) >= 0) {
-        if (character == '\r' || character == '\n') {
+        if (packet_length != 0u ||
+            (character == U4RK_COMMAND_SYNC && command_length == 0u)) {
+            if (!take_packet_byte((uint8_t)character)) {
+                return;
+            }
+        } else if (character == '\r' || character == '\n') {
             if (command_length != 0u) {
                 command_buffer[command_length] = '\0';
-                process_command(command_buffer);
-                command_length = 0;
+                command_ready = true;
+                if (!dispatch_command_line()) {
+                    return;
+                }
             }
         } else if ((character == '\b' || character == 127) &&
                    command_length != 0u) {
@@ -704,7 +1402,7 @@ static void finish_stop_or_fault(void) {
     if (!stop_pending && !dma_fault_pending) {
         return;
     }
-    if (output_slot_active || u4rk_usb_tx_busy()) {
+    if (output_slot_active || superframe_in_flight || u4rk_usb_tx_busy()) {
         return;
     }
     drain_ready_outputs_as_drops();
@@ -713,6 +1411,8 @@ static void finish_stop_or_fault(void) {
     }
     /* A just-finished DSP job may have populated the ready queue. */
     drain_ready_outputs_as_drops();
+    abandon_superframes();
+    reply_route = deferred_route;
     if (stop_pending) {
         stop_pending = false;
         send_ok("stream stopped drops=%u",
@@ -721,6 +1421,7 @@ static void finish_stop_or_fault(void) {
         dma_fault_pending = false;
         send_error("DMA", "acquisition timeout; pulser disarmed");
     }
+    reply_route = (reply_route_t){0};
 }
 
 static void cancel_usb_session(void) {
@@ -730,18 +1431,32 @@ static void cancel_usb_session(void) {
         usb_session_id = 1u;
     }
     stream.active = false;
+    stream.credit_mode = false;
     stop_pending = false;
     dma_fault_pending = false;
     selftest_active = false;
     selftest_frame_pending = false;
     legacy_capture_pending = false;
     command_length = 0;
+    command_ready = false;
+    packet_length = 0;
+    packet_ready = false;
+    response_count = 0;
+    response_in_flight = false;
+    resend_count = 0;
+    resend_in_flight = false;
+    u4rk_history_reset();
+    u4rk_usb_bench_cancel();
     u4rk_capture_abort();
     if (capture_inflight) {
         u4rk_pipeline_release_raw(capture_raw_index);
         capture_inflight = false;
     }
     u4rk_usb_tx_cancel();
+    (void)u4rk_usb_set_data_channel(U4RK_USB_DATA_CDC);
+    abandon_superframes();
+    telemetry_pending = false;
+    telemetry_in_flight = false;
     if (output_slot_active) {
         u4rk_pipeline_release_output(active_output_slot);
         output_slot_active = false;
@@ -759,8 +1474,10 @@ static void handle_disconnect(void) {
 }
 
 int main(void) {
+#ifndef U4RK_SIMULATOR
     bi_decl(bi_program_description(
-        "pic0rick RP2350A 4096-sample Hilbert envelope and A-law firmware"));
+        "pic0rick " U4RK_CHIP_NAME
+        " 4096-sample Hilbert envelope and A-law firmware"));
     bi_decl(bi_pin_mask_with_name(0x7ffu, "ADC clock GPIO0 and data GPIO1..10"));
     bi_decl(bi_3pins_with_names(
         U4RK_DAC_CS_PIN, "MCP4812 CS",
@@ -772,6 +1489,7 @@ int main(void) {
     bi_decl(bi_2pins_with_names(
         U4RK_PULSER_PDAMP_PIN, "PMOD pulser PDAMP",
         U4RK_PULSER_OE_PIN, "PMOD pulser OE"));
+#endif
 
     /*
      * Pulser safety comes first: all four control pins are driven low before
@@ -782,14 +1500,14 @@ int main(void) {
     if (!u4rk_pipeline_init()) {
         u4rk_pulser_disarm();
         while (true) {
-            tight_loop_contents();
+            u4rk_hal_idle();
         }
     }
-    multicore_launch_core1(u4rk_pipeline_core1_entry);
+    u4rk_hal_launch_core1(u4rk_pipeline_core1_entry);
     if (!u4rk_usb_init()) {
         u4rk_pulser_disarm();
         while (true) {
-            tight_loop_contents();
+            u4rk_hal_idle();
         }
     }
 
@@ -803,6 +1521,6 @@ int main(void) {
         poll_command_input();
         schedule_stream();
         schedule_selftest();
-        tight_loop_contents();
+        u4rk_hal_idle();
     }
 }
@@ -2,65 +2,103 @@
 
 #include <string.h>
 
-#include "pico/critical_section.h"
-#include "pico/util/queue.h"
-
 #include "dsp.h"
+#include "hal.h"
+#include "handoff.h"
 #include "protocol.h"
+#include "rice.h"
+
+_Static_assert(U4RK_RAW_BUFFER_COUNT <= U4RK_RING_CAPACITY,
+               "every raw buffer must fit in a handoff ring");
+_Static_assert(U4RK_OUTPUT_SLOT_COUNT <= U4RK_RING_CAPACITY,
+               "every output slot must fit in a handoff ring");
+_Static_assert(U4RK_MAX_PAYLOAD_SIZE >=
+                   2u * U4RK_SAMPLE_COUNT * sizeof(uint16_t),
+               "Rice coding stages the raw samples in the slot's upper half");
 
 typedef struct {
+    /* Kept first so the float/uint16 payload at bytes + 64 stays aligned. */
+    uint8_t bytes[U4RK_MAX_FRAME_SIZE];
     size_t size;
     uint32_t sequence;
     uint32_t session_id;
-    uint8_t bytes[U4RK_MAX_FRAME_SIZE];
+    u4rk_frame_timing_t timing;
 } output_slot_t;
 
 static uint16_t raw_buffers[U4RK_RAW_BUFFER_COUNT][U4RK_SAMPLE_COUNT]
     __attribute__((aligned(16)));
-static uint16_t latest_raw[U4RK_SAMPLE_COUNT] __attribute__((aligned(16)));
-static uint16_t raw_work[U4RK_SAMPLE_COUNT] __attribute__((aligned(16)));
 static output_slot_t output_slots[U4RK_OUTPUT_SLOT_COUNT]
     __attribute__((aligned(16)));
-
-static queue_t raw_free_queue;
-static queue_t job_queue;
-static queue_t output_free_queue;
-static queue_t output_ready_queue;
-static queue_t completion_queue;
-static critical_section_t shared_lock;
+/* A job travels with the raw buffer it describes, so the job ring only has
+ * to carry the raw index. */
+static u4rk_capture_job_t jobs[U4RK_RAW_BUFFER_COUNT];
+
+/*
+ * Each ring has exactly one producer core and one consumer core:
+ *   raw_return_ring   core 1 -> core 0  raw buffers finished by the DSP
+ *   job_ring          core 0 -> core 1  raw indices with a queued job
+ *   output_free_ring  core 0 -> core 1  output slots released after USB
+ *   output_ready_ring core 1 -> core 0  completed frames
+ *   completion_ring   core 1 -> core 0  finished job sequences
+ * Raw buffers that core 0 abandons itself go to a core-0-only free list.
+ */
+static u4rk_ring_t raw_return_ring;
+static u4rk_ring_t job_ring;
+static u4rk_ring_t output_free_ring;
+static u4rk_ring_t output_ready_ring;
+static u4rk_ring_t completion_ring;
+static uint8_t raw_free_list[U4RK_RAW_BUFFER_COUNT];
+static uint32_t raw_free_count;
+
+/* The latest snapshot is the DMA buffer of the last processed job itself.
+ * It stays out of the free pool until a newer job supersedes it. */
+static u4rk_seqlock_t latest_lock;
 static bool latest_valid;
+static uint8_t latest_index;
 static u4rk_dsp_metrics_t latest_metrics;
+/* Each counter has a single writing core, so plain increments suffice and
+ * the RP2040 (no atomic read-modify-write on ARMv6-M) needs no lock. */
 static volatile uint32_t processing_drops;
+static volatile uint32_t core1_processing_drops;
 static volatile uint32_t usb_drops;
-
-static void store_u16_le(uint8_t *out, uint16_t value) {
-    out[0] = (uint8_t)value;
-    out[1] = (uint8_t)(value >> 8);
-}
+/* Deepest ring levels seen by core 0, for telemetry. */
+static uint32_t job_high_water;
+static uint32_t ready_high_water;
 
 bool u4rk_pipeline_init(void) {
-    queue_init(&raw_free_queue, sizeof(uint8_t), U4RK_RAW_BUFFER_COUNT);
-    queue_init(&job_queue, sizeof(u4rk_capture_job_t), U4RK_RAW_BUFFER_COUNT);
-    queue_init(&output_free_queue, sizeof(uint8_t), U4RK_OUTPUT_SLOT_COUNT);
-    queue_init(&output_ready_queue, sizeof(uint8_t), U4RK_OUTPUT_SLOT_COUNT);
-    queue_init(&completion_queue, sizeof(uint32_t), U4RK_RAW_BUFFER_COUNT);
-    critical_section_init(&shared_lock);
+    u4rk_crc32_init();
+    u4rk_ring_init(&raw_return_ring);
+    u4rk_ring_init(&job_ring);
+    u4rk_ring_init(&output_free_ring);
+    u4rk_ring_init(&output_ready_ring);
+    u4rk_ring_init(&completion_ring);
+    u4rk_seqlock_init(&latest_lock);
     latest_valid = false;
+    latest_index = 0;
     processing_drops = 0;
+    core1_processing_drops = 0;
     usb_drops = 0;
+    job_high_water = 0;
+    ready_high_water = 0;
     memset(&latest_metrics, 0, sizeof(latest_metrics));
 
+    raw_free_count = 0;
     for (uint8_t i = 0; i < U4RK_RAW_BUFFER_COUNT; ++i) {
-        queue_add_blocking(&raw_free_queue, &i);
+        raw_free_list[raw_free_count++] = i;
     }
     for (uint8_t i = 0; i < U4RK_OUTPUT_SLOT_COUNT; ++i) {
-        queue_add_blocking(&output_free_queue, &i);
+        u4rk_ring_push(&output_free_ring, i);
     }
     return u4rk_dsp_init();
 }
 
 bool u4rk_pipeline_claim_raw(uint8_t *index, uint16_t **buffer) {
-    if (!queue_try_remove(&raw_free_queue, index)) {
+    uint32_t returned;
+    if (raw_free_count != 0u) {
+        *index = raw_free_list[--raw_free_count];
+    } else if (u4rk_ring_pop(&raw_return_ring, &returned)) {
+        *index = (uint8_t)returned;
+    } else {
         return false;
     }
     *buffer = raw_buffers[*index];
@@ -68,11 +106,22 @@ bool u4rk_pipeline_claim_raw(uint8_t *index, uint16_t **buffer) {
 }
 
 void u4rk_pipeline_release_raw(uint8_t index) {
-    queue_add_blocking(&raw_free_queue, &index);
+    raw_free_list[raw_free_count++] = index;
+}
+
+static void return_raw_from_core1(uint8_t index) {
+    /* Cannot overflow: the ring can hold every raw buffer at once. */
+    (void)u4rk_ring_push(&raw_return_ring, index);
 }
 
 bool u4rk_pipeline_submit(const u4rk_capture_job_t *job) {
-    if (queue_try_add(&job_queue, job)) {
+    jobs[job->raw_index] = *job;
+    if (u4rk_ring_push(&job_ring, job->raw_index)) {
+        u4rk_hal_signal_core1();
+        uint32_t level = u4rk_ring_level(&job_ring);
+        if (level > job_high_water) {
+            job_high_water = level;
+        }
         return true;
     }
     u4rk_pipeline_release_raw(job->raw_index);
@@ -81,53 +130,97 @@ bool u4rk_pipeline_submit(const u4rk_capture_job_t *job) {
 }
 
 void u4rk_pipeline_note_processing_drop(void) {
-    __atomic_fetch_add(&processing_drops, 1u, __ATOMIC_RELAXED);
+    processing_drops = processing_drops + 1u;
+}
+
+static void note_core1_processing_drop(void) {
+    core1_processing_drops = core1_processing_drops + 1u;
 }
 
 void u4rk_pipeline_note_usb_drop(void) {
-    __atomic_fetch_add(&usb_drops, 1u, __ATOMIC_RELAXED);
+    usb_drops = usb_drops + 1u;
+}
+
+static uint32_t processing_drop_total(void) {
+    return processing_drops + core1_processing_drops;
 }
 
 uint32_t u4rk_pipeline_dropped_frames(void) {
-    return __atomic_load_n(&processing_drops, __ATOMIC_RELAXED) +
-           __atomic_load_n(&usb_drops, __ATOMIC_RELAXED);
+    return processing_drop_total() + usb_drops;
 }
 
-static void copy_latest(const uint16_t *source,
-                        const u4rk_dsp_metrics_t *metrics) {
-    critical_section_enter_blocking(&shared_lock);
-    memcpy(latest_raw, source, sizeof(latest_raw));
-    if (metrics != NULL) {
-        latest_metrics = *metrics;
-    }
+void u4rk_pipeline_get_drop_counts(uint32_t *processing, uint32_t *usb) {
+    *processing = processing_drop_total();
+    *usb = usb_drops;
+}
+
+void u4rk_pipeline_get_high_water(uint32_t *jobs, uint32_t *ready_outputs) {
+    *jobs = job_high_water;
+    *ready_outputs = ready_high_water;
+}
+
+void u4rk_pipeline_reset_high_water(void) {
+    job_high_water = 0;
+    ready_high_water = 0;
+}
+
+static void publish_latest(uint8_t raw_index,
+                           const u4rk_dsp_metrics_t *metrics) {
+    bool had_previous = latest_valid;
+    uint8_t previous = latest_index;
+    u4rk_seqlock_write_begin(&latest_lock);
+    latest_index = raw_index;
+    latest_metrics = *metrics;
     latest_valid = true;
-    critical_section_exit(&shared_lock);
+    u4rk_seqlock_write_end(&latest_lock);
+    if (had_previous) {
+        return_raw_from_core1(previous);
+    }
+}
+
+static bool read_latest_index(uint8_t *index) {
+    uint32_t sequence;
+    bool valid;
+    do {
+        sequence = u4rk_seqlock_read_begin(&latest_lock);
+        valid = latest_valid;
+        *index = latest_index;
+    } while (u4rk_seqlock_read_retry(&latest_lock, sequence));
+    return valid;
 }
 
 bool u4rk_pipeline_copy_latest_raw(
         uint16_t destination[U4RK_SAMPLE_COUNT]) {
-    bool valid;
-    critical_section_enter_blocking(&shared_lock);
-    valid = latest_valid;
-    if (valid) {
-        memcpy(destination, latest_raw, sizeof(latest_raw));
+    uint8_t index;
+    if (!read_latest_index(&index)) {
+        return false;
     }
-    critical_section_exit(&shared_lock);
-    return valid;
+    /* Only core 0 claims raw buffers, so a snapshot superseded while this
+     * core-0 caller reads it cannot be refilled before the read finishes. */
+    u4rk_dsp_extract(raw_buffers[index], destination);
+    return true;
 }
 
 void u4rk_pipeline_get_metrics(u4rk_dsp_metrics_t *metrics) {
-    critical_section_enter_blocking(&shared_lock);
-    *metrics = latest_metrics;
-    critical_section_exit(&shared_lock);
+    uint32_t sequence;
+    do {
+        sequence = u4rk_seqlock_read_begin(&latest_lock);
+        *metrics = latest_metrics;
+    } while (u4rk_seqlock_read_retry(&latest_lock, sequence));
 }
 
 bool u4rk_pipeline_take_output(uint8_t *slot, const uint8_t **data,
                                size_t *size, uint32_t *sequence,
                                uint32_t *session_id) {
-    if (!queue_try_remove(&output_ready_queue, slot)) {
+    uint32_t ready;
+    uint32_t level = u4rk_ring_level(&output_ready_ring);
+    if (level > ready_high_water) {
+        ready_high_water = level;
+    }
+    if (!u4rk_ring_pop(&output_ready_ring, &ready)) {
         return false;
     }
+    *slot = (uint8_t)ready;
     *data = output_slots[*slot].bytes;
     *size = output_slots[*slot].size;
     *sequence = output_slots[*slot].sequence;
@@ -135,27 +228,48 @@ bool u4rk_pipeline_take_output(uint8_t *slot, const uint8_t **data,
     return true;
 }
 
+const u4rk_frame_timing_t *u4rk_pipeline_output_timing(uint8_t slot) {
+    return &output_slots[slot].timing;
+}
+
 void u4rk_pipeline_release_output(uint8_t slot) {
-    queue_add_blocking(&output_free_queue, &slot);
+    (void)u4rk_ring_push(&output_free_ring, slot);
 }
 
 bool u4rk_pipeline_has_pending_output(void) {
-    return !queue_is_empty(&output_ready_queue);
+    return u4rk_ring_level(&output_ready_ring) != 0u;
+}
+
+bool u4rk_pipeline_peek_output_size(size_t *size) {
+    uint32_t ready;
+    if (!u4rk_ring_peek(&output_ready_ring, &ready)) {
+        return false;
+    }
+    *size = output_slots[ready].size;
+    return true;
 }
 
 bool u4rk_pipeline_take_completion(uint32_t *sequence) {
-    return queue_try_remove(&completion_queue, sequence);
+    return u4rk_ring_pop(&completion_ring, sequence);
 }
 
 bool u4rk_pipeline_processing_idle(void) {
-    return queue_get_level(&raw_free_queue) == U4RK_RAW_BUFFER_COUNT &&
-           queue_is_empty(&job_queue);
+    uint8_t index;
+    uint32_t held = read_latest_index(&index) ? 1u : 0u;
+    return raw_free_count + u4rk_ring_level(&raw_return_ring) + held ==
+               U4RK_RAW_BUFFER_COUNT &&
+           u4rk_ring_level(&job_ring) == 0u;
 }
 
-static uint32_t payload_size_for(uint8_t payload_type) {
+uint32_t u4rk_pipeline_payload_size(uint8_t payload_type) {
     switch ((u4rk_payload_type_t)payload_type) {
         case U4RK_PAYLOAD_RAW:
+        case U4RK_PAYLOAD_RAW_RICE:
+        case U4RK_PAYLOAD_ENVELOPE_F16:
+        case U4RK_PAYLOAD_ENVELOPE_U16:
             return U4RK_SAMPLE_COUNT * sizeof(uint16_t);
+        case U4RK_PAYLOAD_ENVELOPE_SPARSE:
+            return U4RK_SPARSE_MAX_PAYLOAD_SIZE;
         case U4RK_PAYLOAD_ENVELOPE:
             return U4RK_SAMPLE_COUNT * sizeof(float);
         case U4RK_PAYLOAD_ALAW:
@@ -166,58 +280,59 @@ static uint32_t payload_size_for(uint8_t payload_type) {
 }
 
 static void process_job(const u4rk_capture_job_t *job) {
+    uint64_t dsp_started_us = u4rk_hal_time_us();
     if (job->payload_type == U4RK_PAYLOAD_NONE) {
         u4rk_dsp_metrics_t metrics;
         memset(&metrics, 0, sizeof(metrics));
-        metrics.dc_mean =
-            u4rk_dsp_extract(raw_buffers[job->raw_index], raw_work);
-        copy_latest(raw_work, &metrics);
-        u4rk_pipeline_release_raw(job->raw_index);
-        queue_try_add(&completion_queue, &job->sequence);
+        publish_latest(job->raw_index, &metrics);
+        (void)u4rk_ring_push(&completion_ring, job->sequence);
         return;
     }
 
-    uint8_t output_index;
-    if (!queue_try_remove(&output_free_queue, &output_index)) {
-        u4rk_pipeline_note_processing_drop();
-        u4rk_pipeline_release_raw(job->raw_index);
+    uint32_t output_index;
+    if (!u4rk_ring_pop(&output_free_ring, &output_index)) {
+        note_core1_processing_drop();
+        return_raw_from_core1(job->raw_index);
         return;
     }
 
+    /* Results are produced in place in the output slot.  The RP2350 is
+     * little-endian, so uint16/float arrays already have the wire layout. */
     output_slot_t *slot = &output_slots[output_index];
     uint8_t *payload = slot->bytes + U4RK_HEADER_SIZE;
     u4rk_dsp_metrics_t metrics;
     memset(&metrics, 0, sizeof(metrics));
-    float *envelope = NULL;
-    uint8_t *alaw = NULL;
     bool saturated = false;
+    uint8_t payload_type = job->payload_type;
+    uint32_t payload_size = u4rk_pipeline_payload_size(payload_type);
 
     if (job->payload_type == U4RK_PAYLOAD_RAW) {
+        metrics.dc_mean = u4rk_dsp_extract(
+            raw_buffers[job->raw_index], (uint16_t *)payload);
+    } else if (job->payload_type == U4RK_PAYLOAD_RAW_RICE) {
+        /* Samples go to the upper half of the slot and the code to the
+         * lower half.  A frame that would not shrink is sent as plain raw. */
+        uint16_t *samples = (uint16_t *)(payload + payload_size);
         metrics.dc_mean =
-            u4rk_dsp_extract(raw_buffers[job->raw_index], raw_work);
-        for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
-            store_u16_le(payload + 2u * i, raw_work[i]);
-        }
-        copy_latest(raw_work, &metrics);
-    } else {
-        u4rk_dsp_envelope(
-            raw_buffers[job->raw_index], raw_work, job->alaw_reference,
-            job->payload_type == U4RK_PAYLOAD_ALAW,
-            &envelope, &alaw, &saturated, &metrics);
-        copy_latest(raw_work, &metrics);
-        if (job->payload_type == U4RK_PAYLOAD_ENVELOPE) {
-            memcpy(payload, envelope, U4RK_SAMPLE_COUNT * sizeof(float));
+            u4rk_dsp_extract(raw_buffers[job->raw_index], samples);
+        size_t coded = u4rk_rice_encode(
+            samples, U4RK_SAMPLE_COUNT, payload, payload_size - 1u);
+        if (coded != 0u) {
+            payload_size = (uint32_t)coded;
         } else {
-            memcpy(payload, alaw, U4RK_SAMPLE_COUNT);
+            memcpy(payload, samples, payload_size);
+            payload_type = U4RK_PAYLOAD_RAW;
         }
+    } else {
+        payload_size = u4rk_dsp_envelope(
+            raw_buffers[job->raw_index], job->alaw_reference,
+            job->sparse_threshold, (u4rk_payload_type_t)job->payload_type,
+            payload, &saturated, &metrics);
     }
 
-    uint32_t payload_size = payload_size_for(job->payload_type);
     uint16_t flags = job->flags;
-    uint32_t processing_drop_count =
-        __atomic_load_n(&processing_drops, __ATOMIC_RELAXED);
-    uint32_t usb_drop_count =
-        __atomic_load_n(&usb_drops, __ATOMIC_RELAXED);
+    uint32_t processing_drop_count = processing_drop_total();
+    uint32_t usb_drop_count = usb_drops;
     if (saturated) {
         flags |= U4RK_FLAG_ALAW_SATURATED;
     }
@@ -229,7 +344,7 @@ static void process_job(const u4rk_capture_job_t *job) {
     }
 
     u4rk_frame_header_t header = {
-        .payload_type = job->payload_type,
+        .payload_type = payload_type,
         .flags = flags,
         .sequence = job->sequence,
         .sample_count = U4RK_SAMPLE_COUNT,
@@ -238,7 +353,10 @@ static void process_job(const u4rk_capture_job_t *job) {
         .capture_timestamp_us = job->capture_timestamp_us,
         .adc_dc_mean = metrics.dc_mean,
         .envelope_peak = metrics.envelope_peak,
-        .alaw_reference = job->alaw_reference,
+        /* uint16 envelope values record their fixed scale in this field. */
+        .alaw_reference = job->payload_type == U4RK_PAYLOAD_ENVELOPE_U16 ||
+                job->payload_type == U4RK_PAYLOAD_ENVELOPE_SPARSE
+            ? U4RK_ENVELOPE_U16_SCALE : job->alaw_reference,
         .pulse = job->pulse,
         .dropped_frames = processing_drop_count + usb_drop_count,
         .payload_crc32 = u4rk_crc32(payload, payload_size),
@@ -247,19 +365,27 @@ static void process_job(const u4rk_capture_job_t *job) {
     slot->size = U4RK_HEADER_SIZE + payload_size;
     slot->sequence = job->sequence;
     slot->session_id = job->session_id;
+    slot->timing = (u4rk_frame_timing_t){
+        .payload_type = job->payload_type,
+        .trigger_us = job->capture_timestamp_us,
+        .dma_done_us = job->dma_done_us,
+        .dsp_started_us = dsp_started_us,
+        .dsp_finished_us = u4rk_hal_time_us(),
+    };
 
-    u4rk_pipeline_release_raw(job->raw_index);
-    if (!queue_try_add(&output_ready_queue, &output_index)) {
-        u4rk_pipeline_note_processing_drop();
-        queue_add_blocking(&output_free_queue, &output_index);
-    }
-    queue_try_add(&completion_queue, &job->sequence);
+    publish_latest(job->raw_index, &metrics);
+    /* Cannot overflow: the ring can hold every output slot at once. */
+    (void)u4rk_ring_push(&output_ready_ring, output_index);
+    (void)u4rk_ring_push(&completion_ring, job->sequence);
 }
 
 void u4rk_pipeline_core1_entry(void) {
     while (true) {
-        u4rk_capture_job_t job;
-        queue_remove_blocking(&job_queue, &job);
-        process_job(&job);
+        uint32_t raw_index;
+        /* Core 0 signals each submitted job with SEV. */
+        while (!u4rk_ring_pop(&job_ring, &raw_index)) {
+            u4rk_hal_wait_for_event();
+        }
+        process_job(&jobs[raw_index]);
     }
 }
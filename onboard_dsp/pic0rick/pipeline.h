@@ -5,7 +5,11 @@
 
 bool u4rk_pipeline_init(void);
 void u4rk_pipeline_core1_entry(void);
+/* Payload bytes of a raw, envelope or A-law frame; 0 for other types. */
+uint32_t u4rk_pipeline_payload_size(uint8_t payload_type);
 
+/* Everything below except u4rk_pipeline_core1_entry is called from core 0.
+ * The handoffs to core 1 are single-producer/single-consumer rings. */
 bool u4rk_pipeline_claim_raw(uint8_t *index, uint16_t **buffer);
 void u4rk_pipeline_release_raw(uint8_t index);
 bool u4rk_pipeline_submit(const u4rk_capture_job_t *job);
@@ -13,14 +17,20 @@ bool u4rk_pipeline_submit(const u4rk_capture_job_t *job);
 bool u4rk_pipeline_take_output(uint8_t *slot, const uint8_t **data,
                                size_t *size, uint32_t *sequence,
                                uint32_t *session_id);
+const u4rk_frame_timing_t *u4rk_pipeline_output_timing(uint8_t slot);
 void u4rk_pipeline_release_output(uint8_t slot);
 bool u4rk_pipeline_has_pending_output(void);
+/* Size of the oldest ready frame, without taking it. */
+bool u4rk_pipeline_peek_output_size(size_t *size);
 bool u4rk_pipeline_take_completion(uint32_t *sequence);
 bool u4rk_pipeline_processing_idle(void);
 
 void u4rk_pipeline_note_processing_drop(void);
 void u4rk_pipeline_note_usb_drop(void);
 uint32_t u4rk_pipeline_dropped_frames(void);
+void u4rk_pipeline_get_drop_counts(uint32_t *processing, uint32_t *usb);
+void u4rk_pipeline_get_high_water(uint32_t *jobs, uint32_t *ready_outputs);
+void u4rk_pipeline_reset_high_water(void);
 bool u4rk_pipeline_copy_latest_raw(uint16_t destination[U4RK_SAMPLE_COUNT]);
 void u4rk_pipeline_get_metrics(u4rk_dsp_metrics_t *metrics);
 
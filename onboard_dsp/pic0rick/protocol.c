@@ -2,6 +2,10 @@
 
 #include <string.h>
 
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the slice-by-8 CRC loads words in little-endian order"
+#endif
+
 static void put_u16(uint8_t *out, uint16_t value) {
     out[0] = (uint8_t)value;
     out[1] = (uint8_t)(value >> 8);
@@ -25,18 +29,60 @@ static void put_f32(uint8_t *out, float value) {
     put_u32(out, bits);
 }
 
-uint32_t u4rk_crc32(const uint8_t *data, size_t length) {
-    uint32_t crc = 0xffffffffu;
-    for (size_t i = 0; i < length; ++i) {
-        crc ^= data[i];
+/* Slice-by-8 tables for the reflected IEEE polynomial used by zlib: row 0
+ * is the classic byte table, row k advances a byte through k more zeros. */
+static uint32_t crc_table[8][256];
+
+void u4rk_crc32_init(void) {
+    for (uint32_t i = 0; i < 256u; ++i) {
+        uint32_t crc = i;
         for (uint32_t bit = 0; bit < 8u; ++bit) {
             uint32_t mask = 0u - (crc & 1u);
             crc = (crc >> 1) ^ (0xedb88320u & mask);
         }
+        crc_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256u; ++i) {
+        for (uint32_t k = 1; k < 8u; ++k) {
+            uint32_t previous = crc_table[k - 1u][i];
+            crc_table[k][i] = (previous >> 8) ^ crc_table[0][previous & 0xffu];
+        }
+    }
+}
+
+uint32_t u4rk_crc32_update(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    while (length != 0u && ((uintptr_t)data & 3u) != 0u) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xffu];
+        --length;
+    }
+    while (length >= 8u) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+        crc = crc_table[7][low & 0xffu] ^
+              crc_table[6][(low >> 8) & 0xffu] ^
+              crc_table[5][(low >> 16) & 0xffu] ^
+              crc_table[4][low >> 24] ^
+              crc_table[3][high & 0xffu] ^
+              crc_table[2][(high >> 8) & 0xffu] ^
+              crc_table[1][(high >> 16) & 0xffu] ^
+              crc_table[0][high >> 24];
+        data += 8;
+        length -= 8u;
+    }
+    while (length-- != 0u) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xffu];
     }
     return ~crc;
 }
 
+uint32_t u4rk_crc32(const uint8_t *data, size_t length) {
+    return u4rk_crc32_update(0u, data, length);
+}
+
 void u4rk_serialize_header(uint8_t destination[U4RK_HEADER_SIZE],
                            const u4rk_frame_header_t *header) {
     memset(destination, 0, U4RK_HEADER_SIZE);
@@ -19,6 +19,11 @@ typedef struct {
     uint32_t payload_crc32;
 } u4rk_frame_header_t;
 
+/* IEEE CRC32, bit-identical to zlib.crc32.  u4rk_crc32_init must run
+ * before either core computes a CRC; _update continues a previous result
+ * exactly like zlib.crc32(data, crc). */
+void u4rk_crc32_init(void);
+uint32_t u4rk_crc32_update(uint32_t crc, const uint8_t *data, size_t length);
 uint32_t u4rk_crc32(const uint8_t *data, size_t length);
 void u4rk_serialize_header(uint8_t destination[U4RK_HEADER_SIZE],
                            const u4rk_frame_header_t *header);
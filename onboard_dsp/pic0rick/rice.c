@@ -0,0 +1,149 @@
+#include "rice.h"
+
+typedef struct {
+    uint8_t *out;
+    size_t capacity;
+    size_t length;
+    uint32_t accumulator;
+    uint32_t pending;
+    bool overflow;
+} bit_writer_t;
+
+/* count is at most 24, so the accumulator never holds more than 31 bits. */
+static void put_bits(bit_writer_t *writer, uint32_t value, uint32_t count) {
+    writer->accumulator = (writer->accumulator << count) | value;
+    writer->pending += count;
+    while (writer->pending >= 8u) {
+        writer->pending -= 8u;
+        if (writer->length == writer->capacity) {
+            writer->overflow = true;
+            return;
+        }
+        writer->out[writer->length++] =
+            (uint8_t)(writer->accumulator >> writer->pending);
+    }
+}
+
+static uint32_t zigzag(int32_t delta) {
+    return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+static uint32_t block_parameter(const uint16_t *samples, uint32_t count,
+                                uint32_t previous) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        int32_t delta = (int32_t)samples[i] - (int32_t)previous;
+        sum += zigzag(delta);
+        previous = samples[i];
+    }
+    /* Rice codes are near optimal when 2^k is close to the mean residual. */
+    uint32_t k = 0;
+    while (k < U4RK_RICE_MAX_K && (count << (k + 1u)) <= sum) {
+        ++k;
+    }
+    return k;
+}
+
+size_t u4rk_rice_encode(const uint16_t *samples, uint32_t count,
+                        uint8_t *out, size_t capacity) {
+    bit_writer_t writer = {.out = out, .capacity = capacity};
+    uint32_t previous = U4RK_RICE_PREDICTOR_START;
+    for (uint32_t start = 0; start < count; start += U4RK_RICE_BLOCK) {
+        uint32_t block = count - start < U4RK_RICE_BLOCK
+            ? count - start : U4RK_RICE_BLOCK;
+        uint32_t k = block_parameter(samples + start, block, previous);
+        put_bits(&writer, k, 4u);
+        for (uint32_t i = start; i < start + block; ++i) {
+            int32_t delta = (int32_t)samples[i] - (int32_t)previous;
+            uint32_t residual = zigzag(delta);
+            uint32_t quotient = residual >> k;
+            if (quotient < U4RK_RICE_ESCAPE) {
+                put_bits(&writer, ((1u << quotient) - 1u) << 1, quotient + 1u);
+                put_bits(&writer, residual & ((1u << k) - 1u), k);
+            } else {
+                put_bits(&writer, (1u << U4RK_RICE_ESCAPE) - 1u,
+                         U4RK_RICE_ESCAPE);
+                put_bits(&writer, residual, U4RK_RICE_RESIDUAL_BITS);
+            }
+            previous = samples[i];
+        }
+        if (writer.overflow) {
+            return 0;
+        }
+    }
+    if (writer.pending != 0u) {
+        put_bits(&writer, 0u, 8u - writer.pending);
+    }
+    return writer.overflow ? 0u : writer.length;
+}
+
+typedef struct {
+    const uint8_t *in;
+    size_t length;
+    size_t bit;
+} bit_reader_t;
+
+static bool get_bit(bit_reader_t *reader, uint32_t *value) {
+    if (reader->bit >= reader->length * 8u) {
+        return false;
+    }
+    *value = (reader->in[reader->bit >> 3] >> (7u - (reader->bit & 7u))) & 1u;
+    ++reader->bit;
+    return true;
+}
+
+static bool get_bits(bit_reader_t *reader, uint32_t count, uint32_t *value) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t bit;
+        if (!get_bit(reader, &bit)) {
+            return false;
+        }
+        result = (result << 1) | bit;
+    }
+    *value = result;
+    return true;
+}
+
+bool u4rk_rice_decode(const uint8_t *in, size_t length, uint16_t *samples,
+                      uint32_t count) {
+    bit_reader_t reader = {.in = in, .length = length};
+    int32_t previous = (int32_t)U4RK_RICE_PREDICTOR_START;
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (i % U4RK_RICE_BLOCK == 0u &&
+            (!get_bits(&reader, 4u, &k) || k > U4RK_RICE_MAX_K)) {
+            return false;
+        }
+        uint32_t quotient = 0;
+        uint32_t bit = 1;
+        while (quotient < U4RK_RICE_ESCAPE) {
+            if (!get_bit(&reader, &bit)) {
+                return false;
+            }
+            if (bit == 0u) {
+                break;
+            }
+            ++quotient;
+        }
+        uint32_t residual;
+        if (bit != 0u) {
+            if (!get_bits(&reader, U4RK_RICE_RESIDUAL_BITS, &residual)) {
+                return false;
+            }
+        } else {
+            uint32_t remainder;
+            if (!get_bits(&reader, k, &remainder)) {
+                return false;
+            }
+            residual = (quotient << k) | remainder;
+        }
+        int32_t delta = (int32_t)(residual >> 1) ^ -(int32_t)(residual & 1u);
+        previous += delta;
+        if (previous < 0 || previous > 0x3ff) {
+            return false;
+        }
+        samples[i] = (uint16_t)previous;
+    }
+    return true;
+}
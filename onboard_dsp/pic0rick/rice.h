@@ -0,0 +1,33 @@
+#ifndef U4RK_RICE_H
+#define U4RK_RICE_H
+
+#include "u4rk.h"
+
+/*
+ * Lossless coding of 10-bit raw traces.  Each sample is predicted by the one
+ * before it (the first by mid-scale), the signed difference is zigzag-mapped
+ * to 0..2046, and blocks of U4RK_RICE_BLOCK residuals are Rice coded with a
+ * per-block parameter k.  Bits are packed MSB first:
+ *
+ *   block:    k (4 bits), then one code per sample
+ *   code:     q one-bits, a zero, then the low k bits of the residual,
+ *             where q = residual >> k and q < U4RK_RICE_ESCAPE
+ *   escape:   U4RK_RICE_ESCAPE one-bits, then the residual in 11 bits
+ *
+ * The last byte is zero-padded.  The coder has no host dependencies so the
+ * same file builds into the host tools.
+ */
+#define U4RK_RICE_BLOCK            64u
+#define U4RK_RICE_ESCAPE           16u
+#define U4RK_RICE_RESIDUAL_BITS    11u
+#define U4RK_RICE_MAX_K            11u
+#define U4RK_RICE_PREDICTOR_START  512u
+
+/* Returns the encoded size, or 0 when it would exceed capacity. */
+size_t u4rk_rice_encode(const uint16_t *samples, uint32_t count,
+                        uint8_t *out, size_t capacity);
+/* Returns false on truncated input or a sample outside 0..1023. */
+bool u4rk_rice_decode(const uint8_t *in, size_t length, uint16_t *samples,
+                      uint32_t count);
+
+#endif
@@ -0,0 +1,106 @@
+#include "superframe.h"
+
+#include <string.h>
+
+#include "protocol.h"
+
+static uint16_t get_u16(const uint8_t *in) {
+    return (uint16_t)(in[0] | ((uint16_t)in[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) |
+           ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static uint64_t get_u64(const uint8_t *in) {
+    return (uint64_t)get_u32(in) | ((uint64_t)get_u32(in + 4) << 32);
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+void u4rk_superframe_reset(u4rk_superframe_t *superframe) {
+    superframe->used = U4RK_HEADER_SIZE;
+    superframe->frame_count = 0;
+    superframe->opened_us = 0;
+}
+
+uint32_t u4rk_superframe_capacity(size_t frame_size) {
+    size_t available = U4RK_SUPERFRAME_SIZE - U4RK_HEADER_SIZE;
+    uint32_t count = (uint32_t)(available /
+                                (frame_size + U4RK_SUPERFRAME_INDEX_ENTRY));
+    return count < U4RK_SUPERFRAME_MAX_FRAMES ? count
+                                              : U4RK_SUPERFRAME_MAX_FRAMES;
+}
+
+bool u4rk_superframe_fits(const u4rk_superframe_t *superframe,
+                          size_t frame_size) {
+    if (superframe->frame_count == U4RK_SUPERFRAME_MAX_FRAMES) {
+        return false;
+    }
+    size_t index_size =
+        (superframe->frame_count + 1u) * U4RK_SUPERFRAME_INDEX_ENTRY;
+    return superframe->used + frame_size + index_size <= U4RK_SUPERFRAME_SIZE;
+}
+
+void u4rk_superframe_append(u4rk_superframe_t *superframe,
+                            const uint8_t *frame, size_t frame_size,
+                            const u4rk_frame_timing_t *timing,
+                            uint64_t now_us) {
+    uint32_t index = superframe->frame_count++;
+    if (index == 0u) {
+        superframe->opened_us = now_us;
+    }
+    memcpy(superframe->bytes + superframe->used, frame, frame_size);
+    superframe->offsets[index] =
+        (uint32_t)(superframe->used - U4RK_HEADER_SIZE);
+    superframe->lengths[index] = (uint32_t)frame_size;
+    superframe->timing[index] = *timing;
+    superframe->used += frame_size;
+}
+
+size_t u4rk_superframe_finish(u4rk_superframe_t *superframe,
+                              uint32_t dropped_frames) {
+    uint8_t *index = superframe->bytes + superframe->used;
+    for (uint32_t i = 0; i < superframe->frame_count; ++i) {
+        put_u32(index + i * U4RK_SUPERFRAME_INDEX_ENTRY,
+                superframe->offsets[i]);
+        put_u32(index + i * U4RK_SUPERFRAME_INDEX_ENTRY + 4u,
+                superframe->lengths[i]);
+    }
+    size_t size = superframe->used +
+                  superframe->frame_count * U4RK_SUPERFRAME_INDEX_ENTRY;
+
+    /* The outer header repeats the first frame's identity and the union of
+     * the inner flags so drop and saturation bits stay visible. */
+    const uint8_t *first = superframe->bytes + U4RK_HEADER_SIZE;
+    uint16_t flags = 0;
+    for (uint32_t i = 0; i < superframe->frame_count; ++i) {
+        flags |= get_u16(first + superframe->offsets[i] + 6u);
+    }
+    uint8_t *payload = superframe->bytes + U4RK_HEADER_SIZE;
+    uint32_t payload_bytes = (uint32_t)(size - U4RK_HEADER_SIZE);
+    u4rk_frame_header_t header = {
+        .payload_type = U4RK_PAYLOAD_SUPERFRAME,
+        .flags = flags,
+        .sequence = get_u32(first + 8u),
+        .sample_count = superframe->frame_count,
+        .sample_rate_hz = get_u32(first + 16u),
+        .payload_bytes = payload_bytes,
+        .capture_timestamp_us = get_u64(first + 24u),
+        .pulse = {
+            .negative_ns = get_u32(first + 44u),
+            .damp_ns = get_u32(first + 48u),
+            .positive_ns = get_u32(first + 52u),
+        },
+        .dropped_frames = dropped_frames,
+        .payload_crc32 = u4rk_crc32(payload, payload_bytes),
+    };
+    u4rk_serialize_header(superframe->bytes, &header);
+    return size;
+}
@@ -0,0 +1,49 @@
+#ifndef U4RK_SUPERFRAME_H
+#define U4RK_SUPERFRAME_H
+
+#include "u4rk.h"
+
+/*
+ * A superframe carries several complete P0RK frames in one USB transfer.
+ * Its outer header has payload type U4RK_PAYLOAD_SUPERFRAME, the number of
+ * inner frames as sample_count, and a CRC over the whole payload.  The
+ * payload is the inner frames back to back (each with its own header and
+ * payload CRC) followed by an index of one {offset, length} u32 pair per
+ * frame; offsets are relative to the start of the payload.
+ */
+#define U4RK_SUPERFRAME_MAX_FRAMES    16u
+#define U4RK_SUPERFRAME_SIZE          32768u
+#define U4RK_SUPERFRAME_INDEX_ENTRY   8u
+#define U4RK_SUPERFRAME_MAX_AGE_US    10000u
+/* Two let one fill while the other is on the wire; with one, packing waits
+ * for the transfer to finish and the frames wait in the output slots. */
+#if U4RK_COMPACT_SRAM
+#define U4RK_SUPERFRAME_BUFFERS       1u
+#else
+#define U4RK_SUPERFRAME_BUFFERS       2u
+#endif
+
+typedef struct {
+    uint8_t bytes[U4RK_SUPERFRAME_SIZE];
+    size_t used;
+    uint32_t frame_count;
+    uint32_t offsets[U4RK_SUPERFRAME_MAX_FRAMES];
+    uint32_t lengths[U4RK_SUPERFRAME_MAX_FRAMES];
+    u4rk_frame_timing_t timing[U4RK_SUPERFRAME_MAX_FRAMES];
+    uint64_t opened_us;
+} u4rk_superframe_t;
+
+void u4rk_superframe_reset(u4rk_superframe_t *superframe);
+/* Frames of frame_size bytes that fit in one superframe. */
+uint32_t u4rk_superframe_capacity(size_t frame_size);
+bool u4rk_superframe_fits(const u4rk_superframe_t *superframe,
+                          size_t frame_size);
+void u4rk_superframe_append(u4rk_superframe_t *superframe,
+                            const uint8_t *frame, size_t frame_size,
+                            const u4rk_frame_timing_t *timing,
+                            uint64_t now_us);
+/* Writes the index and outer header; returns the bytes to transmit. */
+size_t u4rk_superframe_finish(u4rk_superframe_t *superframe,
+                              uint32_t dropped_frames);
+
+#endif
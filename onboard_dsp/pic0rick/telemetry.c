@@ -0,0 +1,183 @@
+#include "telemetry.h"
+
+#include <string.h>
+
+#include "pipeline.h"
+
+#define U4RK_RATE_MARGIN_PERCENT 10u
+/* The held peak loses 1/8 every 50 ms, so a host pause that stretched one
+ * transfer stops limiting the rate within about two seconds. */
+#define U4RK_SERVICE_DECAY_US    50000u
+#define U4RK_SERVICE_DECAY_STEPS 64u
+
+static u4rk_stage_histogram_t stages[U4RK_STAGE_COUNT];
+/* Per-payload-type bottleneck time, held at its peak and decayed with time
+ * so one quick frame cannot inflate the reported feasible rate. */
+static uint32_t service_us[U4RK_PAYLOAD_TYPE_COUNT];
+static uint64_t service_at_us[U4RK_PAYLOAD_TYPE_COUNT];
+/* The latest frame's bottleneck time; the peak never decays below it. */
+static uint32_t latest_service_us[U4RK_PAYLOAD_TYPE_COUNT];
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t bucket_for(uint32_t latency_us) {
+    uint32_t bucket =
+        latency_us == 0u ? 0u : 32u - (uint32_t)__builtin_clz(latency_us);
+    return bucket < U4RK_TELEMETRY_BUCKETS
+        ? bucket : U4RK_TELEMETRY_BUCKETS - 1u;
+}
+
+static uint32_t span_us(uint64_t started, uint64_t finished) {
+    if (finished <= started) {
+        return 0u;
+    }
+    uint64_t span = finished - started;
+    return span > UINT32_MAX ? UINT32_MAX : (uint32_t)span;
+}
+
+static void record(u4rk_stage_t stage, uint32_t latency_us) {
+    u4rk_stage_histogram_t *histogram = &stages[stage];
+    ++histogram->count;
+    histogram->last_us = latency_us;
+    if (latency_us > histogram->max_us) {
+        histogram->max_us = latency_us;
+    }
+    ++histogram->buckets[bucket_for(latency_us)];
+}
+
+static uint32_t decayed_service(uint8_t payload_type, uint64_t now_us) {
+    uint32_t service = service_us[payload_type];
+    uint64_t steps = now_us > service_at_us[payload_type]
+        ? (now_us - service_at_us[payload_type]) / U4RK_SERVICE_DECAY_US
+        : 0u;
+    if (steps > U4RK_SERVICE_DECAY_STEPS) {
+        steps = U4RK_SERVICE_DECAY_STEPS;
+    }
+    while (steps-- != 0u) {
+        service -= service / 8u;
+    }
+    return service > latest_service_us[payload_type]
+        ? service : latest_service_us[payload_type];
+}
+
+static void update_service(uint8_t payload_type, uint32_t frame_us,
+                           uint64_t now_us) {
+    if (payload_type == U4RK_PAYLOAD_NONE ||
+        payload_type >= U4RK_PAYLOAD_TYPE_COUNT) {
+        return;
+    }
+    /* The peak decays from when it was set until a frame exceeds it. */
+    latest_service_us[payload_type] = frame_us;
+    if (frame_us >= decayed_service(payload_type, now_us)) {
+        service_us[payload_type] = frame_us;
+        service_at_us[payload_type] = now_us;
+    }
+}
+
+void u4rk_telemetry_reset(void) {
+    memset(stages, 0, sizeof(stages));
+    memset(service_us, 0, sizeof(service_us));
+    memset(service_at_us, 0, sizeof(service_at_us));
+    memset(latest_service_us, 0, sizeof(latest_service_us));
+}
+
+void u4rk_telemetry_record_frame(const u4rk_frame_timing_t *timing,
+                                 uint64_t tx_started_us,
+                                 uint64_t tx_finished_us) {
+    uint32_t acquire_us = span_us(timing->trigger_us, timing->dma_done_us);
+    uint32_t dsp_us =
+        span_us(timing->dsp_started_us, timing->dsp_finished_us);
+    uint32_t usb_us = span_us(tx_started_us, tx_finished_us);
+    record(U4RK_STAGE_ACQUIRE, acquire_us);
+    record(U4RK_STAGE_JOB_WAIT,
+           span_us(timing->dma_done_us, timing->dsp_started_us));
+    record(U4RK_STAGE_DSP, dsp_us);
+    record(U4RK_STAGE_OUTPUT_WAIT,
+           span_us(timing->dsp_finished_us, tx_started_us));
+    record(U4RK_STAGE_USB, usb_us);
+    record(U4RK_STAGE_TOTAL, span_us(timing->trigger_us, tx_finished_us));
+
+    /* Acquisition, core 1 and USB overlap across consecutive frames, so the
+     * slowest of the three bounds the sustainable frame period. */
+    uint32_t frame_us = acquire_us;
+    if (dsp_us > frame_us) {
+        frame_us = dsp_us;
+    }
+    if (usb_us > frame_us) {
+        frame_us = usb_us;
+    }
+    update_service(timing->payload_type, frame_us, tx_finished_us);
+}
+
+uint32_t u4rk_telemetry_feasible_rate_hz(uint8_t payload_type,
+                                         uint64_t now_us) {
+    if (payload_type == U4RK_PAYLOAD_NONE ||
+        payload_type >= U4RK_PAYLOAD_TYPE_COUNT ||
+        service_us[payload_type] == 0u) {
+        return 0u;
+    }
+    uint64_t period_us = (uint64_t)decayed_service(payload_type, now_us) *
+                         (100u + U4RK_RATE_MARGIN_PERCENT) / 100u;
+    return period_us == 0u ? UINT32_MAX : (uint32_t)(1000000u / period_us);
+}
+
+const u4rk_stage_histogram_t *u4rk_telemetry_stage(u4rk_stage_t stage) {
+    return &stages[stage];
+}
+
+uint32_t u4rk_telemetry_percentile_us(u4rk_stage_t stage, uint32_t permille) {
+    const u4rk_stage_histogram_t *histogram = &stages[stage];
+    if (histogram->count == 0u) {
+        return 0u;
+    }
+    /* Report the upper edge of the bucket holding the requested rank,
+     * capped by the exact maximum. */
+    uint64_t rank = ((uint64_t)histogram->count * permille + 999u) / 1000u;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < U4RK_TELEMETRY_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = i == 0u ? 0u : (uint32_t)((1ull << i) - 1u);
+            return upper < histogram->max_us ? upper : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+const char *u4rk_telemetry_stage_name(u4rk_stage_t stage) {
+    static const char *const names[] = {
+        "acquire", "job_wait", "dsp", "output_wait", "usb", "total",
+    };
+    return stage < U4RK_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+void u4rk_telemetry_serialize(
+        uint8_t destination[U4RK_TELEMETRY_PAYLOAD_SIZE]) {
+    uint8_t *out = destination;
+    for (uint32_t stage = 0; stage < U4RK_STAGE_COUNT; ++stage) {
+        const u4rk_stage_histogram_t *histogram = &stages[stage];
+        put_u32(out, histogram->count);
+        put_u32(out + 4, histogram->last_us);
+        put_u32(out + 8, histogram->max_us);
+        out += 12;
+        for (uint32_t i = 0; i < U4RK_TELEMETRY_BUCKETS; ++i) {
+            put_u32(out, histogram->buckets[i]);
+            out += 4;
+        }
+    }
+    uint32_t job_high_water;
+    uint32_t ready_high_water;
+    uint32_t processing_drops;
+    uint32_t usb_drops;
+    u4rk_pipeline_get_high_water(&job_high_water, &ready_high_water);
+    u4rk_pipeline_get_drop_counts(&processing_drops, &usb_drops);
+    put_u32(out, job_high_water);
+    put_u32(out + 4, ready_high_water);
+    put_u32(out + 8, processing_drops);
+    put_u32(out + 12, usb_drops);
+}
@@ -0,0 +1,53 @@
+#ifndef U4RK_TELEMETRY_H
+#define U4RK_TELEMETRY_H
+
+#include "u4rk.h"
+
+/*
+ * Per-stage latency histograms for frames that reach the host.  All
+ * recording happens on core 0 when a frame's USB transfer completes, using
+ * the timestamps the frame collected on its way through the pipeline.
+ *
+ * Bucket k counts latencies of 2^(k-1) .. 2^k - 1 microseconds; bucket 0
+ * counts zero and the last bucket also absorbs everything longer.
+ */
+#define U4RK_TELEMETRY_BUCKETS 24u
+
+typedef enum {
+    U4RK_STAGE_ACQUIRE = 0,     /* trigger -> DMA done */
+    U4RK_STAGE_JOB_WAIT,        /* DMA done -> DSP start (core 1 backlog) */
+    U4RK_STAGE_DSP,             /* DSP start -> DSP end */
+    U4RK_STAGE_OUTPUT_WAIT,     /* DSP end -> USB TX start */
+    U4RK_STAGE_USB,             /* USB TX start -> TX complete */
+    U4RK_STAGE_TOTAL,           /* trigger -> TX complete */
+    U4RK_STAGE_COUNT,
+} u4rk_stage_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t buckets[U4RK_TELEMETRY_BUCKETS];
+} u4rk_stage_histogram_t;
+
+/* Stage histograms followed by the two ring high-water marks and the
+ * processing and USB drop counters, all little-endian uint32. */
+#define U4RK_TELEMETRY_PAYLOAD_SIZE \
+    (U4RK_STAGE_COUNT * (3u + U4RK_TELEMETRY_BUCKETS) * 4u + 4u * 4u)
+
+void u4rk_telemetry_reset(void);
+void u4rk_telemetry_record_frame(const u4rk_frame_timing_t *timing,
+                                 uint64_t tx_started_us,
+                                 uint64_t tx_finished_us);
+const u4rk_stage_histogram_t *u4rk_telemetry_stage(u4rk_stage_t stage);
+uint32_t u4rk_telemetry_percentile_us(u4rk_stage_t stage, uint32_t permille);
+const char *u4rk_telemetry_stage_name(u4rk_stage_t stage);
+/* Highest frame rate the measured bottleneck stage sustains for a payload
+ * type at now_us, or 0 before any frame of that type has been sent.  The
+ * stage time includes any wait for the host to read, so its peak decays
+ * with time rather than per frame, down to the latest frame's time. */
+uint32_t u4rk_telemetry_feasible_rate_hz(uint8_t payload_type,
+                                         uint64_t now_us);
+void u4rk_telemetry_serialize(uint8_t destination[U4RK_TELEMETRY_PAYLOAD_SIZE]);
+
+#endif
@@ -22,11 +22,18 @@
 #define CFG_TUD_MSC 0
 #define CFG_TUD_HID 0
 #define CFG_TUD_MIDI 0
-#define CFG_TUD_VENDOR 0
+#define CFG_TUD_VENDOR 1
 
 /* Keep USB writes non-blocking while a binary frame is in flight. */
 #define CFG_TUD_CDC_RX_BUFSIZE 512
 #define CFG_TUD_CDC_TX_BUFSIZE 2048
 #define CFG_TUD_CDC_EP_BUFSIZE 64
 
+/* Binary frames on the vendor bulk interface.  The FIFO holds a whole
+ * compressed or envelope frame, and each endpoint transfer queues up to
+ * 2 KB (32 full-speed packets) instead of one packet at a time. */
+#define CFG_TUD_VENDOR_RX_BUFSIZE 64
+#define CFG_TUD_VENDOR_TX_BUFSIZE 8192
+#define CFG_TUD_VENDOR_EPSIZE 2048
+
 #endif
@@ -11,13 +11,53 @@
 #define U4RK_HEADER_SIZE              64u
 #define U4RK_MAX_PAYLOAD_SIZE         (U4RK_SAMPLE_COUNT * sizeof(float))
 #define U4RK_MAX_FRAME_SIZE           (U4RK_HEADER_SIZE + U4RK_MAX_PAYLOAD_SIZE)
-#define U4RK_RAW_BUFFER_COUNT         2u
+#define U4RK_RAW_BUFFER_COUNT         3u
 #define U4RK_OUTPUT_SLOT_COUNT        2u
 #define U4RK_ALAW_DEFAULT_REFERENCE   512.0f
+/* uint16 envelope codes per ADC count; 65535 is about 2048 counts. */
+#define U4RK_ENVELOPE_U16_SCALE       32.0f
+/* Sparse envelope: {start, length, values[length]} uint16 records of the
+ * runs above the threshold.  Quiet gaps of up to U4RK_SPARSE_MERGE_GAP
+ * samples are sent inside a run, since a new record would cost as much. */
+#define U4RK_SPARSE_DEFAULT_THRESHOLD 20.0f
+#define U4RK_SPARSE_MERGE_GAP         2u
+#define U4RK_SPARSE_MAX_PAYLOAD_SIZE  (4u + U4RK_SAMPLE_COUNT * 2u)
+/* Set by the build for the RP2040, which has no FPU: the envelope then
+ * comes from the integer transform in hilbert_fixed.c. */
+#ifndef U4RK_DSP_FIXED_POINT
+#define U4RK_DSP_FIXED_POINT          0
+#endif
+#if U4RK_DSP_FIXED_POINT
+#define U4RK_DSP_BACKEND_NAME         "q30-fft-hilbert"
+#else
+#define U4RK_DSP_BACKEND_NAME         "f32-rfft-hilbert"
+#endif
+#if defined(PICO_RP2040) && PICO_RP2040
+#define U4RK_CHIP_NAME                "RP2040"
+#else
+#define U4RK_CHIP_NAME                "RP2350A"
+#endif
+/* The RP2040 has 264 KB of SRAM to the RP2350's 520 KB, so its build keeps
+ * a shorter resend history, one superframe and a raw-sized bench frame. */
+#ifndef U4RK_COMPACT_SRAM
+#if defined(PICO_RP2040) && PICO_RP2040
+#define U4RK_COMPACT_SRAM             1
+#else
+#define U4RK_COMPACT_SRAM             0
+#endif
+#endif
 #define U4RK_RAW_MAX_RATE_HZ          100u
+#if U4RK_DSP_FIXED_POINT
+#define U4RK_ENVELOPE_MAX_RATE_HZ     20u
+#define U4RK_ALAW_MAX_RATE_HZ         20u
+#define U4RK_DSP_TARGET_US            40000u
+#else
 #define U4RK_ENVELOPE_MAX_RATE_HZ     50u
 #define U4RK_ALAW_MAX_RATE_HZ         70u
 #define U4RK_DSP_TARGET_US            4500u
+#endif
+#define U4RK_CREDIT_MAX_RATE_HZ       1000u
+#define U4RK_CREDIT_LIMIT             65535u
 
 #define U4RK_ADC_CLOCK_PIN            0u
 #define U4RK_ADC_DATA_FIRST_PIN       1u
@@ -37,14 +77,29 @@ typedef enum {
     U4RK_PAYLOAD_RAW = 1,
     U4RK_PAYLOAD_ENVELOPE = 2,
     U4RK_PAYLOAD_ALAW = 3,
+    U4RK_PAYLOAD_TELEMETRY = 4,
+    U4RK_PAYLOAD_SUPERFRAME = 5,
+    U4RK_PAYLOAD_RAW_RICE = 6,
+    U4RK_PAYLOAD_ENVELOPE_F16 = 7,
+    U4RK_PAYLOAD_ENVELOPE_U16 = 8,
+    U4RK_PAYLOAD_ENVELOPE_SPARSE = 9,
+    /* OK/ERR text answering an "@<id>" request; sequence is the id. */
+    U4RK_PAYLOAD_RESPONSE = 10,
+    /* Synthetic "bench usb" frame; the payload is a fixed byte ramp. */
+    U4RK_PAYLOAD_BENCH = 11,
+    U4RK_PAYLOAD_TYPE_COUNT,
 } u4rk_payload_type_t;
 
 enum {
+    /* Also set when a uint16 envelope sample clipped at 65535. */
     U4RK_FLAG_ALAW_SATURATED = 1u << 0,
     U4RK_FLAG_PROCESSING_DROP = 1u << 1,
     U4RK_FLAG_USB_DROP = 1u << 2,
     U4RK_FLAG_SELFTEST = 1u << 3,
     U4RK_FLAG_PULSER_ARMED = 1u << 4,
+    U4RK_FLAG_RESPONSE_ERROR = 1u << 5,
+    /* Sent again from the history in answer to "resend". */
+    U4RK_FLAG_RESENT = 1u << 6,
     U4RK_FLAG_SELFTEST_CASE_SHIFT = 8,
 };
 
@@ -69,10 +124,21 @@ typedef struct {
     uint32_t session_id;
     uint32_t sample_rate_hz;
     uint64_t capture_timestamp_us;
+    /* Core 0 time at which the capture DMA was seen complete. */
+    uint64_t dma_done_us;
     float alaw_reference;
+    float sparse_threshold;
     u4rk_pulse_config_t pulse;
 } u4rk_capture_job_t;
 
+typedef struct {
+    uint8_t payload_type;
+    uint64_t trigger_us;
+    uint64_t dma_done_us;
+    uint64_t dsp_started_us;
+    uint64_t dsp_finished_us;
+} u4rk_frame_timing_t;
+
 typedef struct {
     uint32_t preprocess_us;
     uint32_t forward_fft_us;
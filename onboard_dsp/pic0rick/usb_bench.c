@@ -0,0 +1,108 @@
+#include "usb_bench.h"
+
+#include "hal.h"
+#include "protocol.h"
+#include "usb_transport.h"
+
+static uint8_t bench_frame[U4RK_HEADER_SIZE + U4RK_USB_BENCH_MAX_PAYLOAD];
+static u4rk_usb_bench_result_t result;
+static uint32_t payload_crc32;
+static bool active;
+static bool in_flight;
+static uint64_t first_started_us;
+static uint64_t tx_started_us;
+
+static bool finish_frame(bool failed, uint64_t now) {
+    if (failed) {
+        ++result.frames_failed;
+    } else {
+        ++result.frames_sent;
+    }
+    if (result.frames_sent + result.frames_failed <
+        result.frames_requested) {
+        return false;
+    }
+    active = false;
+    result.elapsed_us = first_started_us != 0u ? now - first_started_us : 0u;
+    return true;
+}
+
+bool u4rk_usb_bench_start(uint32_t payload_bytes, uint32_t frame_count) {
+    if (active || payload_bytes == 0u ||
+        payload_bytes > U4RK_USB_BENCH_MAX_PAYLOAD || frame_count == 0u ||
+        frame_count > U4RK_USB_BENCH_MAX_FRAMES) {
+        return false;
+    }
+    uint8_t *payload = bench_frame + U4RK_HEADER_SIZE;
+    for (uint32_t i = 0; i < payload_bytes; ++i) {
+        payload[i] = (uint8_t)i;
+    }
+    payload_crc32 = u4rk_crc32(payload, payload_bytes);
+    result = (u4rk_usb_bench_result_t){
+        .payload_bytes = payload_bytes,
+        .frames_requested = frame_count,
+    };
+    first_started_us = 0;
+    in_flight = false;
+    active = true;
+    return true;
+}
+
+bool u4rk_usb_bench_poll(void) {
+    if (!active) {
+        return false;
+    }
+    if (in_flight) {
+        if (u4rk_usb_tx_busy()) {
+            return false;
+        }
+        uint64_t now = u4rk_hal_time_us();
+        uint32_t tx_us = (uint32_t)(now - tx_started_us);
+        if (tx_us > result.max_tx_us) {
+            result.max_tx_us = tx_us;
+        }
+        in_flight = false;
+        if (finish_frame(u4rk_usb_tx_take_failed(), now)) {
+            return true;
+        }
+    }
+    if (u4rk_usb_tx_busy()) {
+        return false;
+    }
+
+    uint64_t now = u4rk_hal_time_us();
+    u4rk_frame_header_t header = {
+        .payload_type = U4RK_PAYLOAD_BENCH,
+        .sequence = result.frames_sent + result.frames_failed,
+        .sample_count = 0,
+        .sample_rate_hz = U4RK_SAMPLE_RATE_HZ,
+        .payload_bytes = result.payload_bytes,
+        .capture_timestamp_us = now,
+        .dropped_frames = result.frames_failed,
+        .payload_crc32 = payload_crc32,
+    };
+    u4rk_serialize_header(bench_frame, &header);
+    if (!u4rk_usb_tx_start(bench_frame,
+                           U4RK_HEADER_SIZE + result.payload_bytes)) {
+        return finish_frame(true, now);
+    }
+    if (first_started_us == 0u) {
+        first_started_us = now;
+    }
+    tx_started_us = now;
+    in_flight = true;
+    return false;
+}
+
+bool u4rk_usb_bench_active(void) {
+    return active;
+}
+
+void u4rk_usb_bench_cancel(void) {
+    active = false;
+    in_flight = false;
+}
+
+const u4rk_usb_bench_result_t *u4rk_usb_bench_result(void) {
+    return &result;
+}
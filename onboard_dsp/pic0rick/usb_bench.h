@@ -0,0 +1,37 @@
+#ifndef U4RK_USB_BENCH_H
+#define U4RK_USB_BENCH_H
+
+#include "u4rk.h"
+
+/*
+ * "bench usb": synthetic frames sent back to back through the normal
+ * u4rk_usb_tx_start path, so the host can measure what the transport
+ * sustains on its own.  Each frame's sequence is its index and its
+ * timestamp is the moment its transfer started; dropped_frames counts the
+ * transfers that have failed so far, including stall timeouts.
+ */
+#define U4RK_USB_BENCH_MAX_FRAMES 1000000u
+#if U4RK_COMPACT_SRAM
+#define U4RK_USB_BENCH_MAX_PAYLOAD (U4RK_SAMPLE_COUNT * sizeof(uint16_t))
+#else
+#define U4RK_USB_BENCH_MAX_PAYLOAD U4RK_MAX_PAYLOAD_SIZE
+#endif
+
+typedef struct {
+    uint32_t payload_bytes;
+    uint32_t frames_requested;
+    uint32_t frames_sent;
+    uint32_t frames_failed;
+    uint32_t max_tx_us;
+    uint64_t elapsed_us;    /* first transfer start -> last completion */
+} u4rk_usb_bench_result_t;
+
+bool u4rk_usb_bench_start(uint32_t payload_bytes, uint32_t frame_count);
+/* Drives the run from the main loop while the transmitter is free; returns
+ * true once, when the last frame has completed. */
+bool u4rk_usb_bench_poll(void);
+bool u4rk_usb_bench_active(void);
+void u4rk_usb_bench_cancel(void);
+const u4rk_usb_bench_result_t *u4rk_usb_bench_result(void);
+
+#endif
@@ -1,6 +1,7 @@
 #include <string.h>
 
 #include "tusb.h"
+#include "u4rk.h"
 
 #define U4RK_USB_VID 0xcafe
 #define U4RK_USB_PID 0x4011
@@ -9,7 +10,9 @@
 static tusb_desc_device_t const device_descriptor = {
     .bLength = sizeof(tusb_desc_device_t),
     .bDescriptorType = TUSB_DESC_DEVICE,
-    .bcdUSB = 0x0200,
+    /* 2.1 so Windows reads the BOS and binds WinUSB to the vendor
+     * interface without a driver install. */
+    .bcdUSB = 0x0210,
     .bDeviceClass = TUSB_CLASS_MISC,
     .bDeviceSubClass = MISC_SUBCLASS_COMMON,
     .bDeviceProtocol = MISC_PROTOCOL_IAD,
@@ -30,18 +33,24 @@ uint8_t const *tud_descriptor_device_cb(void) {
 enum {
     ITF_NUM_CDC = 0,
     ITF_NUM_CDC_DATA,
+    ITF_NUM_VENDOR,
     ITF_NUM_TOTAL,
 };
 
-#define EPNUM_CDC_NOTIF 0x81
-#define EPNUM_CDC_OUT   0x02
-#define EPNUM_CDC_IN    0x82
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+#define EPNUM_CDC_NOTIF   0x81
+#define EPNUM_CDC_OUT     0x02
+#define EPNUM_CDC_IN      0x82
+#define EPNUM_VENDOR_OUT  0x03
+#define EPNUM_VENDOR_IN   0x83
+#define CONFIG_TOTAL_LEN \
+    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_VENDOR_DESC_LEN)
 
 static uint8_t const configuration_descriptor[] = {
     TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8,
                        EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 5, EPNUM_VENDOR_OUT,
+                          EPNUM_VENDOR_IN, 64),
 };
 
 uint8_t const *tud_descriptor_configuration_cb(uint8_t index) {
@@ -52,9 +61,10 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index) {
 static char const *const string_descriptors[] = {
     (const char[]){0x09, 0x04},
     "pic0rick",
-    "pic0rick RP2350 Signal Processor",
+    "pic0rick " U4RK_CHIP_NAME " Signal Processor",
     "P0RK0001",
     "pic0rick control and data",
+    "pic0rick frames",
 };
 static uint16_t descriptor_string[64];
 
@@ -81,3 +91,65 @@ uint16_t const *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
         (uint16_t)((TUSB_DESC_STRING << 8) | (2u * count + 2u));
     return descriptor_string;
 }
+
+/* Microsoft OS 2.0 descriptors: mark the vendor interface WinUSB-compatible
+ * and give it a fixed interface GUID for host libraries to open. */
+#define U4RK_VENDOR_REQUEST_MICROSOFT 1
+#define MS_OS_20_DESC_LEN 0xB2
+#define BOS_TOTAL_LEN (TUD_BOS_DESC_LEN + TUD_BOS_MICROSOFT_OS_DESC_LEN)
+
+static uint8_t const bos_descriptor[] = {
+    TUD_BOS_DESCRIPTOR(BOS_TOTAL_LEN, 1),
+    TUD_BOS_MS_OS_20_DESCRIPTOR(MS_OS_20_DESC_LEN,
+                                U4RK_VENDOR_REQUEST_MICROSOFT),
+};
+
+uint8_t const *tud_descriptor_bos_cb(void) {
+    return bos_descriptor;
+}
+
+static uint8_t const ms_os_20_descriptor[] = {
+    /* Set header: Windows 8.1 and later. */
+    U16_TO_U8S_LE(0x000A), U16_TO_U8S_LE(MS_OS_20_SET_HEADER_DESCRIPTOR),
+    U32_TO_U8S_LE(0x06030000), U16_TO_U8S_LE(MS_OS_20_DESC_LEN),
+    /* Configuration subset. */
+    U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_CONFIGURATION),
+    0, 0, U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A),
+    /* Function subset for the vendor interface. */
+    U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION),
+    ITF_NUM_VENDOR, 0, U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A - 0x08),
+    /* Compatible ID "WINUSB". */
+    U16_TO_U8S_LE(0x0014), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID),
+    'W', 'I', 'N', 'U', 'S', 'B', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* Registry property DeviceInterfaceGUIDs (REG_MULTI_SZ, UTF-16LE). */
+    U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A - 0x08 - 0x08 - 0x14),
+    U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY),
+    U16_TO_U8S_LE(0x0007), U16_TO_U8S_LE(0x002A),
+    'D', 0, 'e', 0, 'v', 0, 'i', 0, 'c', 0, 'e', 0, 'I', 0, 'n', 0,
+    't', 0, 'e', 0, 'r', 0, 'f', 0, 'a', 0, 'c', 0, 'e', 0, 'G', 0,
+    'U', 0, 'I', 0, 'D', 0, 's', 0, 0, 0,
+    U16_TO_U8S_LE(0x0050),
+    '{', 0, '5', 0, 'B', 0, '3', 0, 'C', 0, '0', 0, 'E', 0, '1', 0,
+    'A', 0, '-', 0, '7', 0, 'D', 0, '4', 0, 'F', 0, '-', 0, '4', 0,
+    'C', 0, '2', 0, 'B', 0, '-', 0, '9', 0, 'E', 0, '6', 0, 'A', 0,
+    '-', 0, '3', 0, 'F', 0, '1', 0, 'D', 0, '2', 0, 'A', 0, '8', 0,
+    'C', 0, '4', 0, 'B', 0, '7', 0, '0', 0, '}', 0, 0, 0, 0, 0,
+};
+
+_Static_assert(sizeof(ms_os_20_descriptor) == MS_OS_20_DESC_LEN,
+               "MS OS 2.0 descriptor length");
+
+bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage,
+                                tusb_control_request_t const *request) {
+    if (stage != CONTROL_STAGE_SETUP) {
+        return true;
+    }
+    if (request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR &&
+        request->bRequest == U4RK_VENDOR_REQUEST_MICROSOFT &&
+        request->wIndex == 7u) {
+        return tud_control_xfer(rhport, request,
+                                (void *)(uintptr_t)ms_os_20_descriptor,
+                                sizeof(ms_os_20_descriptor));
+    }
+    return false;
+}
@@ -3,14 +3,47 @@
 #include "pico/stdlib.h"
 #include "tusb.h"
 
-#define U4RK_USB_TX_STALL_TIMEOUT_US 2000000u
-
 static const uint8_t *tx_data;
 static size_t tx_length;
 static size_t tx_offset;
 static bool tx_active;
 static bool tx_failed;
 static uint64_t tx_last_progress_us;
+static u4rk_usb_data_channel_t data_channel = U4RK_USB_DATA_CDC;
+
+/* The binary path is the only user of the data channel, so these small
+ * wrappers keep the transfer state machine independent of the class. */
+static bool data_ready(void) {
+    return data_channel == U4RK_USB_DATA_VENDOR ? tud_vendor_mounted()
+                                                : tud_cdc_ready();
+}
+
+static uint32_t data_write_available(void) {
+    return data_channel == U4RK_USB_DATA_VENDOR
+        ? tud_vendor_write_available() : tud_cdc_write_available();
+}
+
+static uint32_t data_write(const uint8_t *data, uint32_t length) {
+    return data_channel == U4RK_USB_DATA_VENDOR
+        ? tud_vendor_write(data, length) : tud_cdc_write(data, length);
+}
+
+static void data_flush(void) {
+    if (data_channel == U4RK_USB_DATA_VENDOR) {
+        tud_vendor_write_flush();
+    } else {
+        tud_cdc_write_flush();
+    }
+}
+
+static void data_clear(void) {
+    /* The vendor class has no portable TX clear.  A stalled vendor transfer
+     * leaves at most a partial frame, which the host skips by resyncing on
+     * the frame magic, and unmounting resets the FIFO. */
+    if (data_channel == U4RK_USB_DATA_CDC) {
+        tud_cdc_write_clear();
+    }
+}
 
 static void fail_async_tx(void) {
     tx_active = false;
@@ -18,7 +51,7 @@ static void fail_async_tx(void) {
     tx_data = NULL;
     tx_length = 0;
     tx_offset = 0;
-    tud_cdc_write_clear();
+    data_clear();
 }
 
 bool u4rk_usb_init(void) {
@@ -28,11 +61,19 @@ bool u4rk_usb_init(void) {
     };
     tx_active = false;
     tx_failed = false;
+    data_channel = U4RK_USB_DATA_CDC;
     return tusb_init(0, &device_init);
 }
 
 void u4rk_usb_task(void) {
     tud_task();
+    /* Nothing is ever read from the vendor OUT endpoint; discard anything a
+     * host writes there so its FIFO cannot hold the endpoint NAKed. */
+    if (tud_vendor_mounted() && tud_vendor_available() != 0u) {
+        uint8_t discard[64];
+        while (tud_vendor_read(discard, sizeof(discard)) != 0u) {
+        }
+    }
     if (!tx_active) {
         return;
     }
@@ -43,7 +84,7 @@ void u4rk_usb_task(void) {
         fail_async_tx();
         return;
     }
-    if (!tud_cdc_ready()) {
+    if (!data_ready()) {
         if ((time_us_64() - tx_last_progress_us) >=
             U4RK_USB_TX_STALL_TIMEOUT_US) {
             fail_async_tx();
@@ -51,17 +92,17 @@ void u4rk_usb_task(void) {
         return;
     }
 
-    uint32_t available = tud_cdc_write_available();
+    uint32_t available = data_write_available();
     size_t remaining = tx_length - tx_offset;
     if (available > remaining) {
         available = (uint32_t)remaining;
     }
     if (available != 0u) {
-        uint32_t written = tud_cdc_write(tx_data + tx_offset, available);
+        uint32_t written = data_write(tx_data + tx_offset, available);
         tx_offset += written;
         if (written != 0u) {
             tx_last_progress_us = time_us_64();
-            tud_cdc_write_flush();
+            data_flush();
         }
     }
     if (tx_offset == tx_length) {
@@ -92,7 +133,9 @@ int u4rk_usb_read_char(void) {
 
 bool u4rk_usb_write_blocking(const void *data, size_t length,
                              uint32_t timeout_ms) {
-    if (tx_active || !tud_cdc_ready()) {
+    /* Text only waits for a binary transfer sharing the CDC endpoint. */
+    if ((tx_active && data_channel == U4RK_USB_DATA_CDC) ||
+        !tud_cdc_ready()) {
         return false;
     }
 
@@ -121,7 +164,7 @@ bool u4rk_usb_write_blocking(const void *data, size_t length,
 }
 
 bool u4rk_usb_tx_start(const void *data, size_t length) {
-    if (tx_active || data == NULL || length == 0u || !tud_cdc_ready()) {
+    if (tx_active || data == NULL || length == 0u || !data_ready()) {
         return false;
     }
     tx_data = (const uint8_t *)data;
@@ -149,5 +192,24 @@ void u4rk_usb_tx_cancel(void) {
     tx_data = NULL;
     tx_length = 0;
     tx_offset = 0;
-    tud_cdc_write_clear();
+    data_clear();
+}
+
+bool u4rk_usb_set_data_channel(u4rk_usb_data_channel_t channel) {
+    if (tx_active) {
+        return false;
+    }
+    if (channel == U4RK_USB_DATA_VENDOR && !tud_vendor_mounted()) {
+        return false;
+    }
+    data_channel = channel;
+    return true;
+}
+
+u4rk_usb_data_channel_t u4rk_usb_data_channel(void) {
+    return data_channel;
+}
+
+const char *u4rk_usb_data_channel_name(u4rk_usb_data_channel_t channel) {
+    return channel == U4RK_USB_DATA_VENDOR ? "vendor" : "cdc";
 }
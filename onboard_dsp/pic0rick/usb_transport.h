@@ -5,6 +5,17 @@
 #include <stddef.h>
 #include <stdint.h>
 
+/* Binary frames go either over the CDC data endpoint shared with text
+ * responses, or over the dedicated vendor bulk interface. */
+typedef enum {
+    U4RK_USB_DATA_CDC = 0,
+    U4RK_USB_DATA_VENDOR = 1,
+} u4rk_usb_data_channel_t;
+
+/* A transfer that makes no progress for this long is abandoned and
+ * reported through u4rk_usb_tx_take_failed(). */
+#define U4RK_USB_TX_STALL_TIMEOUT_US 2000000u
+
 bool u4rk_usb_init(void);
 void u4rk_usb_task(void);
 bool u4rk_usb_connected(void);
@@ -18,4 +29,10 @@ bool u4rk_usb_tx_busy(void);
 bool u4rk_usb_tx_take_failed(void);
 void u4rk_usb_tx_cancel(void);
 
+/* Fails while a transfer is in flight or when the vendor interface is not
+ * configured by the host. */
+bool u4rk_usb_set_data_channel(u4rk_usb_data_channel_t channel);
+u4rk_usb_data_channel_t u4rk_usb_data_channel(void);
+const char *u4rk_usb_data_channel_name(u4rk_usb_data_channel_t channel);
+
 #endif
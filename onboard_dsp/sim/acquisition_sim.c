@@ -0,0 +1,167 @@
+#include "acquisition.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#include "dac.h"
+#include "hal.h"
+
+/*
+ * Simulated front end.  A capture completes after the time the real ADC
+ * needs for 4096 samples and holds a synthetic pulse-echo trace: with the
+ * pulser armed, Gaussian-windowed 5 MHz bursts for a front wall, a small
+ * flaw and two back-wall echoes, scaled by the DAC gain setting; always a
+ * few counts of noise around mid-scale.  Echo positions jitter by a sample
+ * from shot to shot so consecutive frames differ.
+ */
+#define U4RK_SIM_CAPTURE_US \
+    ((U4RK_SAMPLE_COUNT * 1000000u + U4RK_SAMPLE_RATE_HZ - 1u) / \
+     U4RK_SAMPLE_RATE_HZ)
+#define U4RK_SIM_MIDSCALE 512.0f
+#define U4RK_SIM_NOISE_COUNTS 3.0f
+#define U4RK_SIM_BURST_HZ 5000000.0f
+#define U4RK_SIM_BURST_SIGMA 10.0f
+#define U4RK_SIM_PI 3.14159265358979323846f
+/* Same tick rounding and minimum as the PIO pulser in acquisition.c. */
+#define U4RK_PULSE_TICK_NS 8u
+#define U4RK_PULSE_OVERHEAD_TICKS 5u
+
+typedef struct {
+    float position;
+    float amplitude;
+} sim_echo_t;
+
+static const sim_echo_t echoes[] = {
+    {600.0f, 420.0f},
+    {1350.0f, 60.0f},
+    {2100.0f, 260.0f},
+    {3600.0f, 120.0f},
+};
+
+static bool pulser_armed;
+static bool capture_active;
+static uint64_t capture_started_us;
+static uint32_t noise_state = 0x2545f491u;
+static u4rk_pulse_config_t pulse_config = {
+    .negative_ns = 96,
+    .damp_ns = 6000,
+    .positive_ns = 96,
+    .order = U4RK_PULSE_NEGATIVE_FIRST,
+};
+
+static uint32_t next_random(void) {
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return noise_state;
+}
+
+/* Triangular noise in [-1, 1). */
+static float next_noise(void) {
+    uint32_t a = next_random() >> 16;
+    uint32_t b = next_random() >> 16;
+    return ((float)a + (float)b) / 65536.0f - 1.0f;
+}
+
+static void synthesize_trace(uint16_t *destination) {
+    static float trace[U4RK_SAMPLE_COUNT];
+    for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
+        trace[i] = U4RK_SIM_MIDSCALE + U4RK_SIM_NOISE_COUNTS * next_noise();
+    }
+    if (pulser_armed) {
+        float gain = 0.1f + 0.9f * (float)u4rk_dac_last_value() / 1023.0f;
+        float jitter = (float)(next_random() % 3u) - 1.0f;
+        float phase_step =
+            2.0f * U4RK_SIM_PI * U4RK_SIM_BURST_HZ / U4RK_SAMPLE_RATE_HZ;
+        int32_t half_width = (int32_t)(4.0f * U4RK_SIM_BURST_SIGMA);
+        for (size_t e = 0; e < sizeof(echoes) / sizeof(echoes[0]); ++e) {
+            float center = echoes[e].position + jitter;
+            int32_t first = (int32_t)center - half_width;
+            int32_t last = (int32_t)center + half_width;
+            for (int32_t i = first < 0 ? 0 : first;
+                 i <= last && i < (int32_t)U4RK_SAMPLE_COUNT; ++i) {
+                float offset = ((float)i - center) / U4RK_SIM_BURST_SIGMA;
+                trace[i] += gain * echoes[e].amplitude *
+                            expf(-0.5f * offset * offset) *
+                            sinf(phase_step * ((float)i - center));
+            }
+        }
+    }
+    /* Stored in the DMA word layout u4rk_dsp_extract() unpacks. */
+    for (uint32_t i = 0; i < U4RK_SAMPLE_COUNT; ++i) {
+        float value = trace[i] + 0.5f;
+        uint16_t code = value <= 0.0f ? 0u
+                      : value >= 1023.0f ? 1023u : (uint16_t)value;
+        destination[i] = (uint16_t)(code << 1);
+    }
+}
+
+static uint32_t rounded_ticks(uint32_t duration_ns) {
+    return (duration_ns + U4RK_PULSE_TICK_NS / 2u) / U4RK_PULSE_TICK_NS;
+}
+
+void u4rk_acquisition_init(void) {
+    pulser_armed = false;
+    capture_active = false;
+}
+
+bool u4rk_pulser_configure(uint32_t negative_ns, uint32_t damp_ns,
+                           uint32_t positive_ns, u4rk_pulse_order_t order) {
+    uint32_t negative_ticks = rounded_ticks(negative_ns);
+    uint32_t damp_ticks = rounded_ticks(damp_ns);
+    uint32_t positive_ticks = rounded_ticks(positive_ns);
+
+    if (negative_ticks < U4RK_PULSE_OVERHEAD_TICKS ||
+        damp_ticks < U4RK_PULSE_OVERHEAD_TICKS ||
+        positive_ticks < U4RK_PULSE_OVERHEAD_TICKS) {
+        return false;
+    }
+
+    pulse_config.negative_ns = negative_ticks * U4RK_PULSE_TICK_NS;
+    pulse_config.damp_ns = damp_ticks * U4RK_PULSE_TICK_NS;
+    pulse_config.positive_ns = positive_ticks * U4RK_PULSE_TICK_NS;
+    pulse_config.order = order;
+    return true;
+}
+
+u4rk_pulse_config_t u4rk_pulser_get_config(void) {
+    return pulse_config;
+}
+
+void u4rk_pulser_arm(void) {
+    pulser_armed = true;
+}
+
+void u4rk_pulser_disarm(void) {
+    pulser_armed = false;
+}
+
+bool u4rk_pulser_is_armed(void) {
+    return pulser_armed;
+}
+
+bool u4rk_capture_start(uint16_t *destination) {
+    if (capture_active || destination == NULL) {
+        return false;
+    }
+    synthesize_trace(destination);
+    capture_started_us = u4rk_hal_time_us();
+    capture_active = true;
+    return true;
+}
+
+u4rk_capture_state_t u4rk_capture_poll(void) {
+    if (!capture_active) {
+        return U4RK_CAPTURE_IDLE;
+    }
+    if (u4rk_hal_time_us() - capture_started_us < U4RK_SIM_CAPTURE_US) {
+        return U4RK_CAPTURE_ACTIVE;
+    }
+    capture_active = false;
+    return U4RK_CAPTURE_DONE;
+}
+
+void u4rk_capture_abort(void) {
+    capture_active = false;
+    u4rk_pulser_disarm();
+}
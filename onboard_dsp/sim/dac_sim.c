@@ -0,0 +1,20 @@
+#include "dac.h"
+
+/* The simulated front end reads the last value back as its gain. */
+static uint16_t last_value;
+
+void u4rk_dac_init(void) {
+    last_value = 0;
+}
+
+bool u4rk_dac_write(uint16_t value) {
+    if (value > 1023u) {
+        return false;
+    }
+    last_value = value;
+    return true;
+}
+
+uint16_t u4rk_dac_last_value(void) {
+    return last_value;
+}
@@ -0,0 +1,58 @@
+#include "hal.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Main-loop pause per pass; short enough not to limit any stream rate. */
+#define U4RK_SIM_IDLE_NS 20000L
+
+static void (*core1_entry)(void);
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_changed = PTHREAD_COND_INITIALIZER;
+static bool event_pending;
+
+uint64_t u4rk_hal_time_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+static void *core1_thread(void *unused) {
+    (void)unused;
+    core1_entry();
+    return NULL;
+}
+
+void u4rk_hal_launch_core1(void (*entry)(void)) {
+    pthread_t thread;
+    core1_entry = entry;
+    if (pthread_create(&thread, NULL, core1_thread, NULL) != 0) {
+        perror("pic0rick-sim: core 1 thread");
+        exit(1);
+    }
+    pthread_detach(thread);
+}
+
+void u4rk_hal_signal_core1(void) {
+    pthread_mutex_lock(&event_lock);
+    event_pending = true;
+    pthread_cond_signal(&event_changed);
+    pthread_mutex_unlock(&event_lock);
+}
+
+void u4rk_hal_wait_for_event(void) {
+    pthread_mutex_lock(&event_lock);
+    while (!event_pending) {
+        pthread_cond_wait(&event_changed, &event_lock);
+    }
+    event_pending = false;
+    pthread_mutex_unlock(&event_lock);
+}
+
+void u4rk_hal_idle(void) {
+    struct timespec pause = {.tv_nsec = U4RK_SIM_IDLE_NS};
+    nanosleep(&pause, NULL);
+}
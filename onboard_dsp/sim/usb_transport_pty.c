@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+
+#include "usb_transport.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "hal.h"
+
+/*
+ * The CDC port is the slave side of a pseudo-terminal.  Its name is
+ * printed at start-up and, when U4RK_SIM_PTY is set, linked to that path.
+ * The port counts as mounted while a host holds the slave open, so closing
+ * it cancels the session as a USB disconnect does.  There is no vendor
+ * interface.  The transfer state machine follows usb_transport.c and
+ * shares its stall timeout from usb_transport.h.
+ */
+
+static int master_fd = -1;
+static bool mounted;
+static uint8_t rx_buffer[256];
+static size_t rx_length;
+static size_t rx_offset;
+static const uint8_t *tx_data;
+static size_t tx_length;
+static size_t tx_offset;
+static bool tx_active;
+static bool tx_failed;
+static uint64_t tx_last_progress_us;
+
+/* Bytes the pty accepted, 0 when it is full. */
+static size_t pty_write(const uint8_t *data, size_t length) {
+    ssize_t written = write(master_fd, data, length);
+    return written > 0 ? (size_t)written : 0u;
+}
+
+static void fail_async_tx(void) {
+    tx_active = false;
+    tx_failed = true;
+    tx_data = NULL;
+    tx_length = 0;
+    tx_offset = 0;
+    tcflush(master_fd, TCOFLUSH);
+}
+
+bool u4rk_usb_init(void) {
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (master_fd < 0 || grantpt(master_fd) != 0 ||
+        unlockpt(master_fd) != 0) {
+        perror("pic0rick-sim: pty");
+        return false;
+    }
+    struct termios settings;
+    if (tcgetattr(master_fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        tcsetattr(master_fd, TCSANOW, &settings);
+    }
+    const char *name = ptsname(master_fd);
+    const char *link = getenv("U4RK_SIM_PTY");
+    if (link != NULL) {
+        unlink(link);
+        if (symlink(name, link) != 0) {
+            perror("pic0rick-sim: U4RK_SIM_PTY");
+            return false;
+        }
+    }
+    printf("pic0rick-sim: CDC port %s\n", link != NULL ? link : name);
+    fflush(stdout);
+    tx_active = false;
+    tx_failed = false;
+    return true;
+}
+
+void u4rk_usb_task(void) {
+    /* The master reports a hangup while no process has the slave open. */
+    struct pollfd poll_fd = {.fd = master_fd, .events = POLLIN};
+    mounted = poll(&poll_fd, 1, 0) >= 0 && (poll_fd.revents & POLLHUP) == 0;
+    if (!tx_active) {
+        return;
+    }
+    if (!mounted) {
+        fail_async_tx();
+        return;
+    }
+
+    size_t written = pty_write(tx_data + tx_offset, tx_length - tx_offset);
+    tx_offset += written;
+    if (written != 0u) {
+        tx_last_progress_us = u4rk_hal_time_us();
+    }
+    if (tx_offset == tx_length) {
+        tx_active = false;
+        tx_data = NULL;
+        tx_length = 0;
+        tx_offset = 0;
+    } else if ((u4rk_hal_time_us() - tx_last_progress_us) >=
+               U4RK_USB_TX_STALL_TIMEOUT_US) {
+        fail_async_tx();
+    }
+}
+
+bool u4rk_usb_connected(void) {
+    return mounted;
+}
+
+bool u4rk_usb_mounted(void) {
+    return mounted;
+}
+
+int u4rk_usb_read_char(void) {
+    if (rx_offset == rx_length) {
+        ssize_t count = mounted ? read(master_fd, rx_buffer, sizeof(rx_buffer))
+                                : -1;
+        if (count <= 0) {
+            return -1;
+        }
+        rx_length = (size_t)count;
+        rx_offset = 0;
+    }
+    return rx_buffer[rx_offset++];
+}
+
+bool u4rk_usb_write_blocking(const void *data, size_t length,
+                             uint32_t timeout_ms) {
+    if (tx_active || !mounted) {
+        return false;
+    }
+    const uint8_t *source = (const uint8_t *)data;
+    size_t offset = 0;
+    uint64_t deadline = u4rk_hal_time_us() + (uint64_t)timeout_ms * 1000u;
+    while (offset < length) {
+        if (u4rk_hal_time_us() > deadline) {
+            return false;
+        }
+        offset += pty_write(source + offset, length - offset);
+    }
+    return true;
+}
+
+bool u4rk_usb_tx_start(const void *data, size_t length) {
+    if (tx_active || data == NULL || length == 0u || !mounted) {
+        return false;
+    }
+    tx_data = (const uint8_t *)data;
+    tx_length = length;
+    tx_offset = 0;
+    tx_active = true;
+    tx_failed = false;
+    tx_last_progress_us = u4rk_hal_time_us();
+    return true;
+}
+
+bool u4rk_usb_tx_busy(void) {
+    return tx_active;
+}
+
+bool u4rk_usb_tx_take_failed(void) {
+    bool failed = tx_failed;
+    tx_failed = false;
+    return failed;
+}
+
+void u4rk_usb_tx_cancel(void) {
+    tx_active = false;
+    tx_failed = false;
+    tx_data = NULL;
+    tx_length = 0;
+    tx_offset = 0;
+    tcflush(master_fd, TCOFLUSH);
+}
+
+bool u4rk_usb_set_data_channel(u4rk_usb_data_channel_t channel) {
+    return !tx_active && channel == U4RK_USB_DATA_CDC;
+}
+
+u4rk_usb_data_channel_t u4rk_usb_data_channel(void) {
+    return U4RK_USB_DATA_CDC;
+}
+
+const char *u4rk_usb_data_channel_name(u4rk_usb_data_channel_t channel) {
+    return channel == U4RK_USB_DATA_VENDOR ? "vendor" : "cdc";
+}
@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+"""Append-only pic0rick capture files (.p0rk) and their converters.
+
+Layout, all little-endian:
+
+    file header   8s magic "P0RKCAP1", u32 version, u32 reserved
+    frames        each data frame exactly as received: its 64-byte P0RK
+                  header and payload, superframes already unpacked
+    index         one INDEX_DTYPE record per frame
+    footer        u64 index offset, u32 frame count, 4s magic "PIDX"
+
+Frames are written as they arrive, one write per frame, so a crash loses
+at most the frame in flight.  The index and footer are added on close; a
+file without them is re-indexed by walking the frame headers, and a torn
+last frame is ignored.  CaptureFile memory-maps a finished or torn file
+and looks frames up by position, sequence or payload type.
+
+    python tools/capture_file.py captures/capture.p0rk --npy captures/out
+    python tools/capture_file.py captures/capture.p0rk --hdf5 capture.h5
+
+--hdf5 needs h5py.
+"""
+
+from __future__ import annotations
+
+import argparse
+import dataclasses
+import mmap
+import struct
+import sys
+import zlib
+from pathlib import Path
+from typing import Iterator
+
+import numpy as np
+
+from pic0rick_capture import (
+    HEADER,
+    MAGIC,
+    PAYLOAD_NAMES,
+    PAYLOAD_RAW_RICE,
+    PAYLOAD_SUPERFRAME,
+    PROTOCOL_VERSION,
+    Frame,
+    FrameHeader,
+    check_header_shape,
+    save_frames,
+)
+
+FILE_MAGIC = b"P0RKCAP1"
+FILE_VERSION = 1
+FILE_HEADER = struct.Struct("<8sII")
+FOOTER = struct.Struct("<QI4s")
+FOOTER_MAGIC = b"PIDX"
+INDEX_DTYPE = np.dtype([
+    ("offset", "<u8"),
+    ("capture_timestamp_us", "<u8"),
+    ("sequence", "<u4"),
+    ("payload_bytes", "<u4"),
+    ("flags", "<u2"),
+    ("payload_type", "u1"),
+    ("reserved", "V5"),
+])
+
+
+def pack_header(header: FrameHeader) -> bytes:
+    return HEADER.pack(MAGIC, *dataclasses.astuple(header))
+
+
+class CaptureWriter:
+    """Appends frames to a new capture file; close() adds the index."""
+
+    def __init__(self, path: Path):
+        self.path = path
+        # Unbuffered, so every frame reaches the OS in one write.
+        self.file = open(path, "wb", buffering=0)
+        self._write(FILE_HEADER.pack(FILE_MAGIC, FILE_VERSION, 0))
+        self.offset = FILE_HEADER.size
+        self.entries: list[tuple] = []
+
+    def _write(self, data: bytes) -> None:
+        # A raw write may be short; the index assumes every byte landed.
+        view = memoryview(data)
+        while view:
+            view = view[self.file.write(view):]
+
+    def append(self, frame: Frame) -> None:
+        header = frame.header
+        self._write(pack_header(header) + frame.payload)
+        self.entries.append((
+            self.offset, header.capture_timestamp_us, header.sequence,
+            header.payload_bytes, header.flags, header.payload_type, b"",
+        ))
+        self.offset += HEADER.size + header.payload_bytes
+
+    def __len__(self) -> int:
+        return len(self.entries)
+
+    def close(self) -> None:
+        if self.file.closed:
+            return
+        index = np.array(self.entries, dtype=INDEX_DTYPE)
+        self._write(index.tobytes())
+        self._write(FOOTER.pack(self.offset, len(index), FOOTER_MAGIC))
+        self.file.close()
+
+    def __enter__(self) -> "CaptureWriter":
+        return self
+
+    def __exit__(self, *exc: object) -> None:
+        self.close()
+
+
+def scan_frames(data: mmap.mmap, start: int, end: int) -> np.ndarray:
+    """Index a file without a footer; stops at the first torn frame."""
+    entries = []
+    offset = start
+    while offset + HEADER.size <= end:
+        values = HEADER.unpack_from(data, offset)
+        magic, version, payload_type, flags, sequence, sample_count = values[:6]
+        payload_bytes = values[7]
+        frame_end = offset + HEADER.size + payload_bytes
+        if magic != MAGIC or version != PROTOCOL_VERSION or frame_end > end:
+            break
+        try:
+            check_header_shape(payload_type, sample_count, payload_bytes)
+        except ValueError:
+            break
+        payload = memoryview(data)[offset + HEADER.size:frame_end]
+        crc_ok = zlib.crc32(payload) & 0xFFFFFFFF == values[-1]
+        payload.release()
+        if payload_type == PAYLOAD_SUPERFRAME or not crc_ok:
+            break
+        entries.append((offset, values[8], sequence, payload_bytes, flags,
+                        payload_type, b""))
+        offset = frame_end
+    return np.array(entries, dtype=INDEX_DTYPE)
+
+
+class CaptureFile:
+    """Read-only, memory-mapped view of a capture file."""
+
+    def __init__(self, path: Path):
+        self.path = path
+        with open(path, "rb") as file:
+            size = file.seek(0, 2)
+            if size < FILE_HEADER.size:
+                raise ValueError(f"{path}: not a capture file")
+            self.data = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, _ = FILE_HEADER.unpack_from(self.data)
+        if magic != FILE_MAGIC or version != FILE_VERSION:
+            self.data.close()
+            raise ValueError(f"{path}: not a version {FILE_VERSION} capture file")
+        self.index, self.complete = self._read_index(size)
+
+    def _read_index(self, size: int) -> tuple[np.ndarray, bool]:
+        if size >= FILE_HEADER.size + FOOTER.size:
+            index_offset, count, magic = FOOTER.unpack_from(
+                self.data, size - FOOTER.size
+            )
+            if (
+                magic == FOOTER_MAGIC
+                and index_offset + count * INDEX_DTYPE.itemsize + FOOTER.size == size
+            ):
+                index = np.frombuffer(self.data, INDEX_DTYPE, count, index_offset)
+                return index, True
+        return scan_frames(self.data, FILE_HEADER.size, size), False
+
+    def close(self) -> None:
+        # Views handed out by payload() keep the mapping alive until freed.
+        self.index = self.index.copy()
+        try:
+            self.data.close()
+        except BufferError:
+            pass
+
+    def __enter__(self) -> "CaptureFile":
+        return self
+
+    def __exit__(self, *exc: object) -> None:
+        self.close()
+
+    def __len__(self) -> int:
+        return len(self.index)
+
+    def header(self, position: int) -> FrameHeader:
+        offset = int(self.index["offset"][position])
+        return FrameHeader(*HEADER.unpack_from(self.data, offset)[1:])
+
+    def payload(self, position: int) -> np.ndarray:
+        """uint8 view of a payload inside the mapping (no copy)."""
+        start = int(self.index["offset"][position]) + HEADER.size
+        length = int(self.index["payload_bytes"][position])
+        return np.frombuffer(self.data, np.uint8, length, start)
+
+    def frame(self, position: int) -> Frame:
+        return Frame(self.header(position), self.payload(position).tobytes())
+
+    def __getitem__(self, position: int) -> Frame:
+        return self.frame(position)
+
+    def frames(self, positions: Iterator[int] | None = None) -> Iterator[Frame]:
+        for position in range(len(self)) if positions is None else positions:
+            yield self.frame(int(position))
+
+    def find_sequence(self, sequence: int) -> np.ndarray:
+        """Positions of the frames with this sequence, resends included."""
+        return np.flatnonzero(self.index["sequence"] == sequence)
+
+    def select(self, payload_type: int) -> np.ndarray:
+        """Positions of the frames of one payload type, in file order."""
+        return np.flatnonzero(self.index["payload_type"] == payload_type)
+
+
+def convert_npy(capture: CaptureFile, output: Path,
+                final_status: str | None = None) -> None:
+    """Write the per-type .npy files and headers.json of a capture."""
+    save_frames(capture.frames(), output, final_status)
+
+
+def convert_hdf5(capture: CaptureFile, output: Path) -> None:
+    """One group per payload type with samples and the header fields."""
+    try:
+        import h5py
+    except ImportError as exc:
+        raise RuntimeError("h5py is required for HDF5 output") from exc
+    header_dtype = np.dtype([
+        (field.name, "<f4" if field.type == "float" else "<u8")
+        for field in dataclasses.fields(FrameHeader)
+    ])
+    grouped: dict[int, np.ndarray] = {}
+    for payload_type in np.unique(capture.index["payload_type"]):
+        # Compressed and fallback raw frames of one stream share one group.
+        key = 1 if payload_type == PAYLOAD_RAW_RICE else int(payload_type)
+        positions = grouped.get(key, np.empty(0, dtype=np.int64))
+        grouped[key] = np.union1d(positions, capture.select(payload_type))
+    with h5py.File(output, "w") as file:
+        for payload_type, positions in grouped.items():
+            group = file.create_group(PAYLOAD_NAMES[payload_type])
+            first = capture.frame(int(positions[0])).samples()
+            samples = group.create_dataset(
+                "samples", (len(positions),) + first.shape, dtype=first.dtype
+            )
+            headers = np.empty(len(positions), dtype=header_dtype)
+            for row, position in enumerate(positions):
+                frame = capture.frame(int(position))
+                samples[row] = frame.samples()
+                headers[row] = dataclasses.astuple(frame.header)
+            group.create_dataset("headers", data=headers)
+
+
+def print_summary(capture: CaptureFile) -> None:
+    state = "complete" if capture.complete else "re-indexed (no footer)"
+    print(f"{capture.path}: {len(capture)} frames, {state}")
+    for payload_type in np.unique(capture.index["payload_type"]):
+        sequences = capture.index["sequence"][capture.select(payload_type)]
+        print(f"  {PAYLOAD_NAMES[int(payload_type)]}: {len(sequences)} frames, "
+              f"seq {sequences.min()}..{sequences.max()}")
+
+
+def parse_args(argv: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+    )
+    parser.add_argument("capture", type=Path)
+    parser.add_argument("--npy", type=Path, metavar="DIR",
+                        help="write .npy arrays and headers.json to DIR")
+    parser.add_argument("--hdf5", type=Path, metavar="FILE")
+    return parser.parse_args(argv)
+
+
+def main(args: argparse.Namespace) -> int:
+    with CaptureFile(args.capture) as capture:
+        print_summary(capture)
+        if args.npy is not None:
+            convert_npy(capture, args.npy)
+        if args.hdf5 is not None:
+            convert_hdf5(capture, args.hdf5)
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        raise SystemExit(main(parse_args(sys.argv[1:])))
+    except (OSError, RuntimeError, ValueError) as error:
+        print(f"ERROR: {error}", file=sys.stderr)
+        raise SystemExit(1)
@@ -0,0 +1,99 @@
+/*
+ * Host check and benchmark for the firmware frame CRC.
+ *
+ * Compares u4rk_crc32 from pic0rick/protocol.c with zlib's crc32 over
+ * random lengths, alignments and chained updates, then times it against
+ * the bit-at-a-time loop it replaced on a 16 KiB envelope payload.
+ *
+ *   cc -O2 -I../pic0rick crc32_bench.c ../pic0rick/protocol.c -lz \
+ *       -o crc32_bench && ./crc32_bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "protocol.h"
+
+#define BUFFER_SIZE (U4RK_MAX_PAYLOAD_SIZE + 16u)
+#define RANDOM_CASES 20000u
+#define BENCH_ROUNDS 2000u
+
+static uint8_t buffer[BUFFER_SIZE];
+
+static uint32_t crc32_bitwise(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= data[i];
+        for (uint32_t bit = 0; bit < 8u; ++bit) {
+            uint32_t mask = 0u - (crc & 1u);
+            crc = (crc >> 1) ^ (0xedb88320u & mask);
+        }
+    }
+    return ~crc;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int check_equivalence(void) {
+    for (size_t i = 0; i < BUFFER_SIZE; ++i) {
+        buffer[i] = (uint8_t)rand();
+    }
+    for (uint32_t n = 0; n < RANDOM_CASES; ++n) {
+        size_t offset = (size_t)rand() % 16u;
+        size_t length = (size_t)rand() % (BUFFER_SIZE - offset + 1u);
+        if (n < 64u) {
+            length = n;
+        }
+        const uint8_t *data = buffer + offset;
+        uint32_t expected = (uint32_t)crc32(0L, data, (uInt)length);
+        uint32_t actual = u4rk_crc32(data, length);
+        size_t split = length == 0u ? 0u : (size_t)rand() % length;
+        uint32_t chained = u4rk_crc32_update(
+            u4rk_crc32(data, split), data + split, length - split);
+        if (actual != expected || chained != expected) {
+            fprintf(stderr,
+                    "mismatch offset=%zu length=%zu zlib=%08x "
+                    "u4rk=%08x chained=%08x\n",
+                    offset, length, expected, actual, chained);
+            return 1;
+        }
+    }
+    if (u4rk_crc32((const uint8_t *)"123456789", 9u) != 0xcbf43926u) {
+        fprintf(stderr, "check value mismatch\n");
+        return 1;
+    }
+    printf("equivalence: %u random cases match zlib\n", RANDOM_CASES);
+    return 0;
+}
+
+static void benchmark(const char *name,
+                      uint32_t (*function)(const uint8_t *, size_t)) {
+    volatile uint32_t sink = 0;
+    double start = now_seconds();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; ++i) {
+        sink ^= function(buffer, U4RK_MAX_PAYLOAD_SIZE);
+    }
+    double elapsed = now_seconds() - start;
+    double bytes = (double)U4RK_MAX_PAYLOAD_SIZE * BENCH_ROUNDS;
+    printf("%-10s %8.1f MB/s  %7.2f us per %u-byte payload\n", name,
+           bytes / elapsed / 1e6, elapsed / BENCH_ROUNDS * 1e6,
+           (unsigned)U4RK_MAX_PAYLOAD_SIZE);
+    (void)sink;
+}
+
+int main(void) {
+    u4rk_crc32_init();
+    srand(1u);
+    if (check_equivalence() != 0) {
+        return 1;
+    }
+    benchmark("bitwise", crc32_bitwise);
+    benchmark("slice-by-8", u4rk_crc32);
+    return 0;
+}
@@ -0,0 +1,382 @@
+#!/usr/bin/env python3
+"""Shared-memory frame bus: one process owns the port, many can read.
+
+`serve` opens the port, starts a stream and publishes every validated
+frame (superframes unpacked) into a ring of fixed slots in /dev/shm.
+Any number of local processes attach with FrameBusReader and see the
+frames as NumPy views of the shared memory, without a second open of the
+serial port.  The publisher never waits for readers: a reader that falls
+more than a ring behind skips ahead, and counts what it missed.
+
+    python tools/frame_bus.py serve --port /dev/ttyACM0 --mode alaw --credits 16
+    python tools/frame_bus.py watch
+    python tools/frame_bus.py record captures/bus.p0rk --frames 10000
+
+Segment layout, little-endian: a 64-byte header (8s magic "P0RKBUS1",
+u32 version, u32 slot count, u32 slot size, u32 publisher PID, u64 frames
+published), then the slots.  Each slot is u64 stamp, u32 frame length,
+u32 reserved and the frame's 64-byte P0RK header and payload.  A slot's
+stamp is the number of the frame it holds (from 1) and 0 while it is
+being rewritten, so a reader that sees the same stamp before and after
+using a slot knows the frame was not overwritten meanwhile.  Linux only.
+"""
+
+from __future__ import annotations
+
+import argparse
+import dataclasses
+import mmap
+import os
+import signal
+import struct
+import sys
+import time
+from pathlib import Path
+from typing import Iterator
+
+import numpy as np
+
+from pic0rick_capture import (
+    CAPTURE_POLL_S,
+    CAPTURE_RING_BYTES,
+    EXPECTED_FIRMWARE,
+    HEADER,
+    MAGIC,
+    MAX_PAYLOAD_BYTES,
+    ByteRing,
+    Frame,
+    FrameHeader,
+    FrameReader,
+    PortReader,
+    read_response_line,
+)
+
+BUS_MAGIC = b"P0RKBUS1"
+BUS_VERSION = 1
+BUS_HEADER = struct.Struct("<8sIIII")
+BUS_HEADER_SIZE = 64
+BUS_PUBLISHED_OFFSET = 24
+SLOT_HEADER = struct.Struct("<QII")
+# Room for the largest unpacked frame, rounded to a cache line.
+SLOT_SIZE = (SLOT_HEADER.size + HEADER.size + MAX_PAYLOAD_BYTES + 63) // 64 * 64
+DEFAULT_NAME = "p0rk-bus"
+DEFAULT_SLOTS = 512
+WAIT_POLL_S = 0.001
+
+
+def segment_path(name: str) -> Path:
+    return Path("/dev/shm") / name
+
+
+class FrameBus:
+    """Publisher side; creates the segment and removes it on close."""
+
+    def __init__(self, name: str = DEFAULT_NAME, slots: int = DEFAULT_SLOTS):
+        self.path = segment_path(name)
+        self.slots = slots
+        size = BUS_HEADER_SIZE + slots * SLOT_SIZE
+        fd = os.open(self.path, os.O_RDWR | os.O_CREAT | os.O_TRUNC, 0o644)
+        try:
+            os.ftruncate(fd, size)
+            self.data = mmap.mmap(fd, size)
+        finally:
+            os.close(fd)
+        BUS_HEADER.pack_into(
+            self.data, 0, BUS_MAGIC, BUS_VERSION, slots, SLOT_SIZE, os.getpid()
+        )
+        self.published = np.ndarray((1,), "<u8", self.data, BUS_PUBLISHED_OFFSET)
+        self.stamps = np.ndarray(
+            (slots,), "<u8", self.data, BUS_HEADER_SIZE, (SLOT_SIZE,)
+        )
+        self.count = 0
+
+    def publish(self, frame: Frame) -> None:
+        self.count += 1
+        slot = (self.count - 1) % self.slots
+        base = BUS_HEADER_SIZE + slot * SLOT_SIZE
+        # Readers treat a zero stamp as "being rewritten".
+        self.stamps[slot] = 0
+        length = HEADER.size + len(frame.payload)
+        struct.pack_into("<I", self.data, base + 8, length)
+        start = base + SLOT_HEADER.size
+        HEADER.pack_into(self.data, start, MAGIC, *dataclasses.astuple(frame.header))
+        self.data[start + HEADER.size:start + length] = frame.payload
+        self.stamps[slot] = self.count
+        self.published[0] = self.count
+
+    def close(self) -> None:
+        self.published = self.stamps = None
+        self.data.close()
+        self.path.unlink(missing_ok=True)
+
+    def __enter__(self) -> "FrameBus":
+        return self
+
+    def __exit__(self, *exc: object) -> None:
+        self.close()
+
+
+@dataclasses.dataclass(frozen=True)
+class BusFrame:
+    """A frame in a bus slot; payload is a view of the shared memory."""
+
+    number: int
+    header: FrameHeader
+    payload: np.ndarray
+    reader: "FrameBusReader"
+
+    def intact(self) -> bool:
+        """False once the publisher has started to reuse the slot."""
+        return self.reader.stamp(self.number) == self.number
+
+    def frame(self) -> Frame | None:
+        """A copy that outlives the slot, or None if it was overwritten."""
+        payload = self.payload.tobytes()
+        return Frame(self.header, payload) if self.intact() else None
+
+
+class FrameBusReader:
+    """Attaches to a running publisher; starts with the next new frame."""
+
+    def __init__(self, name: str = DEFAULT_NAME):
+        path = segment_path(name)
+        with open(path, "rb") as file:
+            self.data = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, slots, slot_size, self.publisher_pid = (
+            BUS_HEADER.unpack_from(self.data)
+        )
+        if magic != BUS_MAGIC or version != BUS_VERSION or slot_size != SLOT_SIZE:
+            self.data.close()
+            raise ValueError(f"{path} is not a version {BUS_VERSION} frame bus")
+        self.slots = slots
+        self.published = np.ndarray((1,), "<u8", self.data, BUS_PUBLISHED_OFFSET)
+        self.stamps = np.ndarray(
+            (slots,), "<u8", self.data, BUS_HEADER_SIZE, (SLOT_SIZE,)
+        )
+        self.next = int(self.published[0]) + 1
+        self.skipped = 0
+
+    def close(self) -> None:
+        self.published = self.stamps = None
+        try:
+            self.data.close()
+        except BufferError:
+            # Payload views still in use keep the mapping until freed.
+            pass
+
+    def __enter__(self) -> "FrameBusReader":
+        return self
+
+    def __exit__(self, *exc: object) -> None:
+        self.close()
+
+    def stamp(self, number: int) -> int:
+        return int(self.stamps[(number - 1) % self.slots])
+
+    def publisher_alive(self) -> bool:
+        try:
+            os.kill(self.publisher_pid, 0)
+        except ProcessLookupError:
+            return False
+        except PermissionError:
+            pass
+        return True
+
+    def poll(self) -> Iterator[BusFrame]:
+        """Yield the frames published since the last call, oldest first."""
+        head = int(self.published[0])
+        # The oldest slot may be the next one rewritten, so keep clear of it.
+        oldest = head - self.slots + 2
+        if self.next < oldest:
+            self.skipped += oldest - self.next
+            self.next = oldest
+        while self.next <= head:
+            number = self.next
+            self.next += 1
+            if self.stamp(number) != number:
+                self.skipped += 1
+                continue
+            base = BUS_HEADER_SIZE + (number - 1) % self.slots * SLOT_SIZE
+            _, length, _ = SLOT_HEADER.unpack_from(self.data, base)
+            if not HEADER.size <= length <= SLOT_SIZE - SLOT_HEADER.size:
+                self.skipped += 1
+                continue
+            start = base + SLOT_HEADER.size
+            header = FrameHeader(*HEADER.unpack_from(self.data, start)[1:])
+            payload = np.frombuffer(
+                self.data, np.uint8, length - HEADER.size, start + HEADER.size
+            )
+            if self.stamp(number) != number:
+                self.skipped += 1
+                continue
+            yield BusFrame(number, header, payload, self)
+
+    def wait(self, timeout: float | None = None) -> Iterator[BusFrame]:
+        """Like poll(), but first waits up to timeout for a new frame."""
+        deadline = None if timeout is None else time.monotonic() + timeout
+        while int(self.published[0]) < self.next:
+            if deadline is not None and time.monotonic() >= deadline:
+                return iter(())
+            time.sleep(WAIT_POLL_S)
+        return self.poll()
+
+
+def serve(args: argparse.Namespace) -> int:
+    import serial
+
+    port = serial.Serial(args.port, 115200, timeout=args.timeout, exclusive=True)
+    port_reader = None
+    try:
+        try:
+            port.dtr = True
+        except OSError:
+            pass
+        time.sleep(0.2)
+        port.reset_input_buffer()
+        port.write(b"status\n")
+        port.flush()
+        status = read_response_line(port)
+        if f"firmware={EXPECTED_FIRMWARE}" not in status:
+            raise RuntimeError(f"expected firmware {EXPECTED_FIRMWARE}: {status}")
+
+        ring = ByteRing(CAPTURE_RING_BYTES, args.timeout)
+        port.timeout = CAPTURE_POLL_S
+        port_reader = PortReader(port, ring, 4096)
+        port_reader.start()
+        reader = FrameReader(ring, recover=port)
+        rate = args.rate if args.rate else "max"
+        command = f"stream start {args.mode} {rate}"
+        if args.credits:
+            command += f" credit {args.credits}"
+        if args.batch > 1:
+            command += f" batch {args.batch}"
+        response = reader.request(port, command)
+        print(response)
+        if response.startswith("ERR"):
+            return 2
+
+        # Stop cleanly on SIGTERM as well, so the segment is removed.
+        signal.signal(signal.SIGTERM, signal.default_int_handler)
+        with FrameBus(args.name, args.slots) as bus:
+            print(f"publishing on {bus.path}")
+            granted = args.credits
+            last_report = time.monotonic()
+            try:
+                while True:
+                    frame = reader.read_frame()
+                    bus.publish(frame)
+                    # Keep credit topped up; readers never slow the stream.
+                    if args.credits and granted - bus.count <= args.credits // 2:
+                        grant = args.credits - (granted - bus.count)
+                        port.write(f"credit {grant}\n".encode("ascii"))
+                        port.flush()
+                        granted += grant
+                    now = time.monotonic()
+                    if now - last_report >= 1.0:
+                        last_report = now
+                        print(
+                            f"published={bus.count} seq={frame.header.sequence} "
+                            f"device_drops={frame.header.dropped_frames} "
+                            f"lost={reader.frames_lost} ring={ring.in_waiting >> 10} KiB"
+                        )
+            except KeyboardInterrupt:
+                pass
+        port_reader.stop()
+        port_reader = None
+        port.timeout = args.timeout
+        port.write(b"stream stop\n")
+        port.flush()
+        return 0
+    finally:
+        if port_reader is not None:
+            port_reader.stop()
+        port.close()
+
+
+def consume(args: argparse.Namespace) -> int:
+    writer = None
+    if args.command == "record":
+        from capture_file import CaptureWriter
+
+        writer = CaptureWriter(args.output)
+    received = 0
+    try:
+        with FrameBusReader(args.name) as bus:
+            last_report = time.monotonic()
+            while args.frames == 0 or received < args.frames:
+                for view in bus.wait(1.0):
+                    if writer is not None:
+                        frame = view.frame()
+                        if frame is None:
+                            bus.skipped += 1
+                            continue
+                        writer.append(frame)
+                    else:
+                        print(
+                            f"#{view.number} seq={view.header.sequence} "
+                            f"type={view.header.payload_name} "
+                            f"peak={view.header.envelope_peak:.5g}"
+                        )
+                    received += 1
+                    if received == args.frames:
+                        break
+                now = time.monotonic()
+                if now - last_report >= 1.0:
+                    last_report = now
+                    print(f"received={received} skipped={bus.skipped}")
+                    if not bus.publisher_alive():
+                        print("publisher exited")
+                        break
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if writer is not None:
+            writer.close()
+    print(f"received={received}")
+    return 0
+
+
+def parse_args(argv: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+    )
+    parser.add_argument("--name", default=DEFAULT_NAME,
+                        help="segment name under /dev/shm")
+    commands = parser.add_subparsers(dest="command", required=True)
+    server = commands.add_parser("serve", help="own the port and publish")
+    server.add_argument("--port", required=True)
+    server.add_argument(
+        "--mode", default="alaw",
+        choices=("raw", "rawz", "envelope", "envelope-f16", "envelope-u16",
+                 "sparse", "alaw"),
+    )
+    server.add_argument("--rate", type=int, default=0,
+                        help="stream rate; 0 paces by credits only")
+    server.add_argument("--credits", type=int, default=16)
+    server.add_argument("--batch", type=int, default=1)
+    server.add_argument("--slots", type=int, default=DEFAULT_SLOTS)
+    server.add_argument("--timeout", type=float, default=5.0)
+    watch = commands.add_parser("watch", help="print frames as they arrive")
+    watch.add_argument("--frames", type=int, default=0)
+    record = commands.add_parser("record", help="append frames to a .p0rk file")
+    record.add_argument("output", type=Path)
+    record.add_argument("--frames", type=int, default=0)
+    args = parser.parse_args(argv)
+    if args.command == "serve":
+        if args.rate == 0 and args.credits == 0:
+            parser.error("--rate 0 needs --credits")
+        if args.slots < 4:
+            parser.error("--slots must be at least 4")
+    return args
+
+
+if __name__ == "__main__":
+    arguments = parse_args(sys.argv[1:])
+    try:
+        if arguments.command == "serve":
+            raise SystemExit(serve(arguments))
+        raise SystemExit(consume(arguments))
+    except (OSError, RuntimeError, TimeoutError, ValueError) as error:
+        print(f"ERROR: {error}", file=sys.stderr)
+        raise SystemExit(1)
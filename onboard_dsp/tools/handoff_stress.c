@@ -0,0 +1,227 @@
+/*
+ * Host stress test for the core 0 / core 1 handoff primitives.
+ *
+ * Runs pic0rick/handoff.h on two pthreads the way the pipeline does:
+ * buffer indices circulate through a free ring and a ready ring, the
+ * producer fills each buffer before pushing it and the consumer checks it
+ * after popping it, so a lost, duplicated, reordered or early descriptor
+ * shows up as a bad sequence or a torn buffer.  A second pair of threads
+ * checks that seqlock readers never accept a half-written record; the
+ * reader pauses inside some of its copies so the writer is sure to
+ * overlap them, and the run fails unless reads were retried.
+ *
+ * Waiting threads yield, so the test also finishes on a single CPU.
+ *
+ *   cc -O2 -pthread -I../pic0rick handoff_stress.c -o handoff_stress \
+ *       && ./handoff_stress [iterations]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "handoff.h"
+
+#define DEFAULT_ITERATIONS 200000u
+#define BUFFER_WORDS 64u
+#define RECORD_WORDS 16u
+/* One read in this many yields halfway through its copy. */
+#define READER_PAUSE_INTERVAL 64u
+/* The writer yields after this many writes so readers get to run. */
+#define WRITER_YIELD_INTERVAL 16u
+
+typedef struct {
+    uint32_t sequence;
+    uint32_t words[BUFFER_WORDS];
+} buffer_t;
+
+static uint32_t iterations = DEFAULT_ITERATIONS;
+
+static u4rk_ring_t free_ring;
+static u4rk_ring_t ready_ring;
+static buffer_t buffers[U4RK_RING_CAPACITY];
+static uint64_t ring_errors;
+static uint64_t producer_waits;
+
+static u4rk_seqlock_t record_lock;
+static uint32_t record[RECORD_WORDS];
+static bool writer_done;
+static uint64_t seqlock_errors;
+static uint64_t seqlock_reads;
+static uint64_t seqlock_retries;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t pattern(uint32_t sequence, uint32_t word) {
+    return sequence * 2654435761u + word;
+}
+
+static void *ring_producer(void *unused) {
+    (void)unused;
+    for (uint32_t sequence = 0; sequence < iterations; ++sequence) {
+        uint32_t index;
+        if (!u4rk_ring_pop(&free_ring, &index)) {
+            ++producer_waits;
+            while (!u4rk_ring_pop(&free_ring, &index)) {
+                sched_yield();
+            }
+        }
+        buffer_t *buffer = &buffers[index];
+        buffer->sequence = sequence;
+        for (uint32_t word = 0; word < BUFFER_WORDS; ++word) {
+            buffer->words[word] = pattern(sequence, word);
+        }
+        while (!u4rk_ring_push(&ready_ring, index)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *ring_consumer(void *unused) {
+    (void)unused;
+    for (uint32_t expected = 0; expected < iterations; ++expected) {
+        uint32_t index;
+        uint32_t peeked;
+        while (!u4rk_ring_peek(&ready_ring, &peeked)) {
+            sched_yield();
+        }
+        if (!u4rk_ring_pop(&ready_ring, &index) || index != peeked ||
+            index >= U4RK_RING_CAPACITY) {
+            ++ring_errors;
+            return NULL;
+        }
+        const buffer_t *buffer = &buffers[index];
+        bool intact = buffer->sequence == expected;
+        for (uint32_t word = 0; intact && word < BUFFER_WORDS; ++word) {
+            intact = buffer->words[word] == pattern(expected, word);
+        }
+        if (!intact) {
+            ++ring_errors;
+        }
+        while (!u4rk_ring_push(&free_ring, index)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *seqlock_writer(void *unused) {
+    (void)unused;
+    for (uint32_t value = 1; value <= iterations; ++value) {
+        u4rk_seqlock_write_begin(&record_lock);
+        for (uint32_t word = 0; word < RECORD_WORDS; ++word) {
+            __atomic_store_n(&record[word], value, __ATOMIC_RELAXED);
+        }
+        u4rk_seqlock_write_end(&record_lock);
+        if (value % WRITER_YIELD_INTERVAL == 0u) {
+            sched_yield();
+        }
+    }
+    __atomic_store_n(&writer_done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *seqlock_reader(void *unused) {
+    (void)unused;
+    uint32_t copy[RECORD_WORDS];
+    uint32_t last = 0;
+    while (!__atomic_load_n(&writer_done, __ATOMIC_ACQUIRE)) {
+        bool pause = seqlock_reads % READER_PAUSE_INTERVAL == 0u;
+        uint32_t sequence;
+        bool retried = false;
+        do {
+            if (retried) {
+                ++seqlock_retries;
+            }
+            sequence = u4rk_seqlock_read_begin(&record_lock);
+            for (uint32_t word = 0; word < RECORD_WORDS; ++word) {
+                copy[word] = __atomic_load_n(&record[word], __ATOMIC_RELAXED);
+                if (pause && !retried && word == RECORD_WORDS / 2u) {
+                    sched_yield();
+                }
+            }
+            retried = true;
+        } while (u4rk_seqlock_read_retry(&record_lock, sequence));
+        ++seqlock_reads;
+        /* Every word from one write, and never older than the last read. */
+        for (uint32_t word = 1; word < RECORD_WORDS; ++word) {
+            if (copy[word] != copy[0]) {
+                ++seqlock_errors;
+                break;
+            }
+        }
+        if (copy[0] < last) {
+            ++seqlock_errors;
+        }
+        last = copy[0];
+        sched_yield();
+    }
+    return NULL;
+}
+
+static bool run_pair(void *(*first)(void *), void *(*second)(void *),
+                     double *elapsed) {
+    pthread_t threads[2];
+    double start = now_seconds();
+    if (pthread_create(&threads[0], NULL, first, NULL) != 0 ||
+        pthread_create(&threads[1], NULL, second, NULL) != 0) {
+        perror("pthread_create");
+        return false;
+    }
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    *elapsed = now_seconds() - start;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        iterations = (uint32_t)strtoul(argv[1], NULL, 10);
+    }
+    if (iterations == 0u) {
+        fprintf(stderr, "usage: %s [iterations > 0]\n", argv[0]);
+        return 2;
+    }
+
+    u4rk_ring_init(&free_ring);
+    u4rk_ring_init(&ready_ring);
+    for (uint32_t index = 0; index < U4RK_RING_CAPACITY; ++index) {
+        u4rk_ring_push(&free_ring, index);
+    }
+    double ring_seconds;
+    if (!run_pair(ring_producer, ring_consumer, &ring_seconds)) {
+        return 1;
+    }
+    bool ring_ok = ring_errors == 0u &&
+                   u4rk_ring_level(&free_ring) == U4RK_RING_CAPACITY &&
+                   u4rk_ring_level(&ready_ring) == 0u;
+    printf("rings:   %u descriptors, %llu errors, %llu producer waits, "
+           "%.3f s, %.2f M/s  %s\n",
+           iterations, (unsigned long long)ring_errors,
+           (unsigned long long)producer_waits, ring_seconds,
+           iterations / ring_seconds * 1e-6, ring_ok ? "ok" : "FAIL");
+
+    u4rk_seqlock_init(&record_lock);
+    double seqlock_seconds;
+    if (!run_pair(seqlock_writer, seqlock_reader, &seqlock_seconds)) {
+        return 1;
+    }
+    /* A run that never read, or never overlapped a write, proves nothing. */
+    bool seqlock_ok = seqlock_errors == 0u && seqlock_reads != 0u &&
+                      seqlock_retries != 0u;
+    printf("seqlock: %u writes, %llu reads, %llu retries, %llu torn, "
+           "%.3f s, %.2f M writes/s  %s\n",
+           iterations, (unsigned long long)seqlock_reads,
+           (unsigned long long)seqlock_retries,
+           (unsigned long long)seqlock_errors, seqlock_seconds,
+           iterations / seqlock_seconds * 1e-6,
+           seqlock_ok ? "ok" : "FAIL");
+
+    return ring_ok && seqlock_ok ? 0 : 1;
+}
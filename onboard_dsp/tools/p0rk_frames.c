@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+
+#include "p0rk_frames.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "superframe.h"
+#include "telemetry.h"
+
+#define P0RK_FRAMES_MIN_CAPACITY  (1u << 16)
+/* The firmware's 512-byte response buffer minus room for CR LF and NUL. */
+#define P0RK_FRAMES_RESPONSE_MAX  509u
+
+struct p0rk_frames {
+    uint8_t *ring;
+    size_t capacity;
+    /* Stream offsets: bytes written, parsed, and still held by views. */
+    uint64_t head;
+    uint64_t scan;
+    uint64_t tail;
+    /* Superframe whose inner frames are being returned. */
+    uint64_t superframe_start;
+    uint32_t superframe_payload;
+    uint32_t superframe_count;
+    uint32_t superframe_next;
+    p0rk_frames_stats_t stats;
+};
+
+static uint32_t get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) |
+           ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static uint16_t get_u16(const uint8_t *in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+/* Maps a shared-memory object of capacity bytes twice, back to back. */
+static uint8_t *map_mirrored(size_t capacity) {
+    int fd;
+#ifdef __linux__
+    fd = memfd_create("p0rk_frames", MFD_CLOEXEC);
+#else
+    char name[64];
+    snprintf(name, sizeof(name), "/p0rk_frames.%ld.%p", (long)getpid(),
+             (void *)&name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        shm_unlink(name);
+    }
+#endif
+    if (fd < 0) {
+        return NULL;
+    }
+    uint8_t *ring = NULL;
+    if (ftruncate(fd, (off_t)capacity) == 0) {
+        void *area = mmap(NULL, 2u * capacity, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area != MAP_FAILED) {
+            ring = area;
+            if (mmap(ring, capacity, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+                mmap(ring + capacity, capacity, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                munmap(ring, 2u * capacity);
+                ring = NULL;
+            }
+        }
+    }
+    close(fd);
+    return ring;
+}
+
+p0rk_frames_t *p0rk_frames_create(size_t capacity) {
+    if (capacity == 0) {
+        capacity = P0RK_FRAMES_DEFAULT_CAPACITY;
+    }
+    size_t size = P0RK_FRAMES_MIN_CAPACITY;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    while (page > 0 && size % (size_t)page != 0) {
+        size <<= 1;
+    }
+    p0rk_frames_t *frames = calloc(1, sizeof(*frames));
+    if (frames == NULL) {
+        return NULL;
+    }
+    frames->ring = map_mirrored(size);
+    if (frames->ring == NULL) {
+        free(frames);
+        return NULL;
+    }
+    frames->capacity = size;
+    u4rk_crc32_init();
+    return frames;
+}
+
+void p0rk_frames_destroy(p0rk_frames_t *frames) {
+    if (frames == NULL) {
+        return;
+    }
+    munmap(frames->ring, 2u * frames->capacity);
+    free(frames);
+}
+
+const uint8_t *p0rk_frames_base(const p0rk_frames_t *frames) {
+    return frames->ring;
+}
+
+size_t p0rk_frames_capacity(const p0rk_frames_t *frames) {
+    return frames->capacity;
+}
+
+static uint8_t *at(const p0rk_frames_t *frames, uint64_t offset) {
+    return frames->ring + (offset & (frames->capacity - 1u));
+}
+
+uint8_t *p0rk_frames_write_space(p0rk_frames_t *frames, size_t *available) {
+    *available = frames->capacity - (size_t)(frames->head - frames->tail);
+    return at(frames, frames->head);
+}
+
+void p0rk_frames_commit(p0rk_frames_t *frames, size_t length) {
+    frames->head += length;
+    frames->stats.bytes_received += length;
+}
+
+int p0rk_frames_push(p0rk_frames_t *frames, const void *data, size_t length) {
+    size_t available;
+    uint8_t *space = p0rk_frames_write_space(frames, &available);
+    if (length > available) {
+        return -1;
+    }
+    memcpy(space, data, length);
+    p0rk_frames_commit(frames, length);
+    return 0;
+}
+
+/* Same rules as check_header_shape() in pic0rick_capture.py. */
+static bool header_shape_valid(uint8_t payload_type, uint32_t sample_count,
+                               uint32_t payload_bytes) {
+    switch (payload_type) {
+    case U4RK_PAYLOAD_SUPERFRAME:
+        return sample_count >= 1u &&
+               sample_count <= U4RK_SUPERFRAME_MAX_FRAMES &&
+               payload_bytes >= sample_count * (U4RK_HEADER_SIZE +
+                                                U4RK_SUPERFRAME_INDEX_ENTRY) &&
+               payload_bytes <= U4RK_SUPERFRAME_SIZE - U4RK_HEADER_SIZE;
+    case U4RK_PAYLOAD_RAW_RICE:
+        /* Sent as plain raw unless coding shrank it. */
+        return sample_count == U4RK_SAMPLE_COUNT && payload_bytes > 0u &&
+               payload_bytes < U4RK_SAMPLE_COUNT * 2u;
+    case U4RK_PAYLOAD_ENVELOPE_SPARSE:
+        return sample_count == U4RK_SAMPLE_COUNT &&
+               payload_bytes <= U4RK_SPARSE_MAX_PAYLOAD_SIZE &&
+               payload_bytes % 2u == 0u;
+    case U4RK_PAYLOAD_BENCH:
+        return sample_count == 0u && payload_bytes > 0u &&
+               payload_bytes <= U4RK_MAX_PAYLOAD_SIZE;
+    case U4RK_PAYLOAD_RESPONSE:
+        return sample_count == 0u && payload_bytes > 0u &&
+               payload_bytes <= P0RK_FRAMES_RESPONSE_MAX;
+    case U4RK_PAYLOAD_RAW:
+    case U4RK_PAYLOAD_ENVELOPE_F16:
+    case U4RK_PAYLOAD_ENVELOPE_U16:
+        return sample_count == U4RK_SAMPLE_COUNT &&
+               payload_bytes == U4RK_SAMPLE_COUNT * 2u;
+    case U4RK_PAYLOAD_ENVELOPE:
+        return sample_count == U4RK_SAMPLE_COUNT &&
+               payload_bytes == U4RK_SAMPLE_COUNT * 4u;
+    case U4RK_PAYLOAD_ALAW:
+        return sample_count == U4RK_SAMPLE_COUNT &&
+               payload_bytes == U4RK_SAMPLE_COUNT;
+    case U4RK_PAYLOAD_TELEMETRY:
+        return sample_count == U4RK_TELEMETRY_BUCKETS &&
+               payload_bytes == U4RK_TELEMETRY_PAYLOAD_SIZE;
+    default:
+        return false;
+    }
+}
+
+static bool header_valid(const uint8_t *header) {
+    return header[4] == U4RK_PROTOCOL_VERSION &&
+           header_shape_valid(header[5], get_u32(header + 12),
+                              get_u32(header + 20));
+}
+
+static void fill_view(p0rk_frame_view_t *view, const uint8_t *frame,
+                      bool in_superframe) {
+    view->frame = frame;
+    view->payload = frame + U4RK_HEADER_SIZE;
+    view->payload_type = frame[5];
+    view->flags = get_u16(frame + 6);
+    view->sequence = get_u32(frame + 8);
+    view->sample_count = get_u32(frame + 12);
+    view->payload_bytes = get_u32(frame + 20);
+    view->payload_crc32 = get_u32(frame + 60);
+    view->in_superframe = in_superframe ? 1u : 0u;
+}
+
+/* Returns the next inner frame of the current superframe, validated like
+ * parse_frame() in pic0rick_capture.py. */
+static int next_inner(p0rk_frames_t *frames, p0rk_frame_view_t *view) {
+    const uint8_t *payload =
+        at(frames, frames->superframe_start) + U4RK_HEADER_SIZE;
+    uint32_t index_start = frames->superframe_payload -
+                           frames->superframe_count *
+                               U4RK_SUPERFRAME_INDEX_ENTRY;
+    const uint8_t *entry = payload + index_start +
+                           frames->superframe_next *
+                               U4RK_SUPERFRAME_INDEX_ENTRY;
+    uint32_t offset = get_u32(entry);
+    uint32_t length = get_u32(entry + 4);
+    frames->superframe_next++;
+    if (frames->superframe_next == frames->superframe_count) {
+        frames->superframe_count = 0;
+    }
+
+    const uint8_t *frame = payload + offset;
+    if (offset > index_start || length > index_start - offset ||
+        length < U4RK_HEADER_SIZE || memcmp(frame, "P0RK", 4) != 0 ||
+        frame[5] == U4RK_PAYLOAD_SUPERFRAME || !header_valid(frame) ||
+        length != U4RK_HEADER_SIZE + get_u32(frame + 20) ||
+        u4rk_crc32(frame + U4RK_HEADER_SIZE, length - U4RK_HEADER_SIZE) !=
+            get_u32(frame + 60)) {
+        frames->stats.bad_entries++;
+        return P0RK_FRAMES_BAD_ENTRY;
+    }
+    fill_view(view, frame, true);
+    frames->stats.frames++;
+    return P0RK_FRAMES_READY;
+}
+
+int p0rk_frames_next(p0rk_frames_t *frames, p0rk_frame_view_t *view) {
+    for (;;) {
+        if (frames->superframe_count != 0u) {
+            return next_inner(frames, view);
+        }
+
+        /* Skip to the next magic; a partial magic at the end waits. */
+        const uint8_t *start = at(frames, frames->scan);
+        size_t available = (size_t)(frames->head - frames->scan);
+        const uint8_t *candidate = start;
+        const uint8_t *end = start + available;
+        while ((candidate = memchr(candidate, 'P', (size_t)(end - candidate)))
+               != NULL) {
+            size_t left = (size_t)(end - candidate);
+            if (left < 4u || memcmp(candidate, "P0RK", 4) == 0) {
+                break;
+            }
+            candidate++;
+        }
+        if (candidate == NULL) {
+            candidate = end;
+        }
+        frames->stats.bytes_skipped += (uint64_t)(candidate - start);
+        frames->scan += (uint64_t)(candidate - start);
+        available = (size_t)(end - candidate);
+        if (available < U4RK_HEADER_SIZE) {
+            return P0RK_FRAMES_NEED_DATA;
+        }
+
+        if (!header_valid(candidate)) {
+            frames->stats.bad_headers++;
+            frames->stats.bytes_skipped++;
+            frames->scan++;
+            continue;
+        }
+        uint32_t payload_bytes = get_u32(candidate + 20);
+        size_t frame_size = U4RK_HEADER_SIZE + payload_bytes;
+        if (available < frame_size) {
+            return P0RK_FRAMES_NEED_DATA;
+        }
+
+        uint64_t frame_start = frames->scan;
+        frames->scan += frame_size;
+        fill_view(view, candidate, false);
+        if (u4rk_crc32(view->payload, payload_bytes) != view->payload_crc32) {
+            frames->stats.crc_errors++;
+            return P0RK_FRAMES_CRC_ERROR;
+        }
+        if (view->payload_type != U4RK_PAYLOAD_SUPERFRAME) {
+            frames->stats.frames++;
+            return P0RK_FRAMES_READY;
+        }
+        frames->stats.superframes++;
+        frames->superframe_start = frame_start;
+        frames->superframe_payload = payload_bytes;
+        frames->superframe_count = view->sample_count;
+        frames->superframe_next = 0;
+    }
+}
+
+void p0rk_frames_release(p0rk_frames_t *frames) {
+    /* Inner frames still to come live in the current superframe. */
+    frames->tail = frames->superframe_count != 0u ? frames->superframe_start
+                                                  : frames->scan;
+}
+
+void p0rk_frames_stats(const p0rk_frames_t *frames,
+                       p0rk_frames_stats_t *stats) {
+    *stats = frames->stats;
+}
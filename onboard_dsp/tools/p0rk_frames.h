@@ -0,0 +1,87 @@
+/*
+ * Zero-copy P0RK frame parser for hosts.
+ *
+ * Received bytes go straight into a ring buffer that is mapped twice back
+ * to back, so every frame is contiguous in memory however the ring has
+ * wrapped.  p0rk_frames_next() finds the next magic, validates the header
+ * shape and the payload CRC and returns a view into the ring; superframes
+ * are split into their inner frames the same way.  Views stay valid until
+ * p0rk_frames_release(), which hands their bytes back to the writer.  One
+ * writer and one reader, not thread-safe.  Linux and macOS.
+ *
+ *   cc -O2 -shared -fPIC -I../pic0rick p0rk_frames.c ../pic0rick/protocol.c \
+ *       -o libp0rk_frames.so
+ */
+#ifndef P0RK_FRAMES_H
+#define P0RK_FRAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct p0rk_frames p0rk_frames_t;
+
+#define P0RK_FRAMES_DEFAULT_CAPACITY (1u << 20)
+
+/* Result of p0rk_frames_next(). */
+enum {
+    P0RK_FRAMES_READY = 1,
+    P0RK_FRAMES_NEED_DATA = 0,
+    /* The header was intact but the payload CRC was not; the view holds the
+     * header fields and the frame has been consumed. */
+    P0RK_FRAMES_CRC_ERROR = -1,
+    /* A superframe index entry did not hold a valid frame; it is skipped. */
+    P0RK_FRAMES_BAD_ENTRY = -2,
+};
+
+typedef struct {
+    const uint8_t *frame;   /* the 64-byte wire header, then the payload */
+    const uint8_t *payload;
+    uint32_t payload_bytes;
+    uint32_t sequence;
+    uint32_t sample_count;
+    uint32_t payload_crc32;
+    uint16_t flags;
+    uint8_t payload_type;
+    uint8_t in_superframe;
+} p0rk_frame_view_t;
+
+typedef struct {
+    uint64_t bytes_received;
+    uint64_t bytes_skipped;     /* noise and text between frames */
+    uint64_t frames;
+    uint64_t superframes;
+    uint64_t crc_errors;
+    uint64_t bad_headers;       /* magic followed by an invalid header */
+    uint64_t bad_entries;
+} p0rk_frames_stats_t;
+
+/* capacity is rounded up to a power of two of at least 64 KiB; 0 selects
+ * P0RK_FRAMES_DEFAULT_CAPACITY. */
+p0rk_frames_t *p0rk_frames_create(size_t capacity);
+void p0rk_frames_destroy(p0rk_frames_t *frames);
+/* Start of the doubled mapping: 2 * capacity readable bytes. */
+const uint8_t *p0rk_frames_base(const p0rk_frames_t *frames);
+size_t p0rk_frames_capacity(const p0rk_frames_t *frames);
+
+/* Where the next received bytes go and how many fit there contiguously;
+ * read() into it and p0rk_frames_commit() the count. */
+uint8_t *p0rk_frames_write_space(p0rk_frames_t *frames, size_t *available);
+void p0rk_frames_commit(p0rk_frames_t *frames, size_t length);
+/* Copies length bytes in; returns 0, or -1 when they do not fit. */
+int p0rk_frames_push(p0rk_frames_t *frames, const void *data, size_t length);
+
+int p0rk_frames_next(p0rk_frames_t *frames, p0rk_frame_view_t *view);
+/* Invalidates every view returned so far. */
+void p0rk_frames_release(p0rk_frames_t *frames);
+void p0rk_frames_stats(const p0rk_frames_t *frames,
+                       p0rk_frames_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+"""Python binding for the zero-copy P0RK frame parser (p0rk_frames.c).
+
+Build the shared library first (see p0rk_frames.h).  Frames come back as
+NumPy arrays over the parser's ring buffer; they stay valid until the
+next release(), so copy anything kept longer:
+
+    parser = FrameParser()
+    while parser.read_from(port):
+        for view in parser.frames():
+            handle(view.header, view.samples())
+        parser.release()
+
+--bench compares it with FrameReader on a synthetic stream at the
+maximum rates the firmware can send:
+
+    python tools/p0rk_frames.py --bench
+
+The library is found next to this file or through P0RK_FRAMES_LIB.
+"""
+
+from __future__ import annotations
+
+import argparse
+import ctypes
+import dataclasses
+import io
+import os
+import sys
+import time
+import zlib
+from pathlib import Path
+from typing import BinaryIO, Iterator
+
+import numpy as np
+
+from pic0rick_capture import (
+    HEADER,
+    MAGIC,
+    PAYLOAD_ENVELOPE_F16,
+    PAYLOAD_ENVELOPE_U16,
+    PAYLOAD_SUPERFRAME,
+    PAYLOAD_TELEMETRY,
+    PROTOCOL_VERSION,
+    SAMPLE_COUNT,
+    SUPERFRAME_INDEX,
+    Frame,
+    FrameHeader,
+    FrameReader,
+)
+
+READY = 1
+NEED_DATA = 0
+CRC_ERROR = -1
+BAD_ENTRY = -2
+# Payloads NumPy can view in place; the others decode through Frame.
+VIEW_DTYPES = {1: "<u2", 2: "<f4", 3: "u1", PAYLOAD_TELEMETRY: "<u4"}
+# Bulk transfers on a full-speed link carry at most 19 64-byte packets per
+# 1 ms frame.
+USB_FULL_SPEED_BYTES_PER_S = 19 * 64 * 1000
+
+
+class View(ctypes.Structure):
+    _fields_ = [
+        ("frame", ctypes.c_void_p),
+        ("payload", ctypes.c_void_p),
+        ("payload_bytes", ctypes.c_uint32),
+        ("sequence", ctypes.c_uint32),
+        ("sample_count", ctypes.c_uint32),
+        ("payload_crc32", ctypes.c_uint32),
+        ("flags", ctypes.c_uint16),
+        ("payload_type", ctypes.c_uint8),
+        ("in_superframe", ctypes.c_uint8),
+    ]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in (
+        "bytes_received", "bytes_skipped", "frames", "superframes",
+        "crc_errors", "bad_headers", "bad_entries",
+    )]
+
+
+def load_library() -> ctypes.CDLL:
+    path = os.environ.get("P0RK_FRAMES_LIB")
+    if path is None:
+        path = str(Path(__file__).with_name("libp0rk_frames.so"))
+    library = ctypes.CDLL(path)
+    library.p0rk_frames_create.restype = ctypes.c_void_p
+    library.p0rk_frames_create.argtypes = [ctypes.c_size_t]
+    library.p0rk_frames_destroy.argtypes = [ctypes.c_void_p]
+    library.p0rk_frames_base.restype = ctypes.c_void_p
+    library.p0rk_frames_base.argtypes = [ctypes.c_void_p]
+    library.p0rk_frames_capacity.restype = ctypes.c_size_t
+    library.p0rk_frames_capacity.argtypes = [ctypes.c_void_p]
+    library.p0rk_frames_write_space.restype = ctypes.c_void_p
+    library.p0rk_frames_write_space.argtypes = [
+        ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t)
+    ]
+    library.p0rk_frames_commit.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+    library.p0rk_frames_push.restype = ctypes.c_int
+    library.p0rk_frames_push.argtypes = [
+        ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t
+    ]
+    library.p0rk_frames_next.restype = ctypes.c_int
+    library.p0rk_frames_next.argtypes = [ctypes.c_void_p, ctypes.POINTER(View)]
+    library.p0rk_frames_release.argtypes = [ctypes.c_void_p]
+    library.p0rk_frames_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(Stats)]
+    return library
+
+
+@dataclasses.dataclass(frozen=True)
+class FrameView:
+    """A frame inside the parser's ring; payload is a uint8 array view."""
+
+    header: FrameHeader
+    payload: np.ndarray
+
+    def samples(self) -> np.ndarray:
+        """Like Frame.samples(), but a view wherever the wire format allows."""
+        dtype = VIEW_DTYPES.get(self.header.payload_type)
+        if dtype is not None:
+            return self.payload.view(dtype)
+        if self.header.payload_type == PAYLOAD_ENVELOPE_F16:
+            return self.payload.view("<f2").astype(np.float32)
+        if self.header.payload_type == PAYLOAD_ENVELOPE_U16:
+            codes = self.payload.view("<u2").astype(np.float32)
+            return codes / np.float32(self.header.alaw_reference)
+        return self.frame().samples()
+
+    def frame(self) -> Frame:
+        """Copy out as a Frame that outlives release()."""
+        return Frame(self.header, self.payload.tobytes())
+
+
+class FrameParser:
+    """Feeds bytes into a native ring buffer and yields validated frames.
+
+    Superframes are split into their inner frames.  Text and noise between
+    frames are skipped; counters for everything dropped are in stats().
+    """
+
+    def __init__(self, capacity: int = 0):
+        self.lib = load_library()
+        self.handle = self.lib.p0rk_frames_create(capacity)
+        if not self.handle:
+            raise OSError("cannot map the frame ring")
+        self.capacity = self.lib.p0rk_frames_capacity(self.handle)
+        base = self.lib.p0rk_frames_base(self.handle)
+        self.ring = np.ctypeslib.as_array(
+            (ctypes.c_uint8 * (2 * self.capacity)).from_address(base)
+        )
+        self.base = base
+        self.view = View()
+        self.crc_errors: list[FrameHeader] = []
+        self.available = ctypes.c_size_t()
+
+    def close(self) -> None:
+        if self.handle:
+            self.ring = None
+            self.lib.p0rk_frames_destroy(self.handle)
+            self.handle = None
+
+    def __enter__(self) -> "FrameParser":
+        return self
+
+    def __exit__(self, *exc: object) -> None:
+        self.close()
+
+    def feed(self, data: bytes) -> None:
+        if self.lib.p0rk_frames_push(self.handle, data, len(data)) != 0:
+            raise BufferError("frame ring full; release() frames first")
+
+    def read_from(self, stream: BinaryIO, size: int = 65536) -> int:
+        """Read from stream straight into the ring; returns the byte count."""
+        address = self.lib.p0rk_frames_write_space(
+            self.handle, ctypes.byref(self.available)
+        )
+        size = min(size, self.available.value)
+        if size == 0:
+            raise BufferError("frame ring full; release() frames first")
+        start = address - self.base
+        count = stream.readinto(memoryview(self.ring[start:start + size])) or 0
+        self.lib.p0rk_frames_commit(self.handle, count)
+        return count
+
+    def frames(self) -> Iterator[FrameView]:
+        """Yield every complete frame received so far.
+
+        Headers of frames whose payload CRC failed are collected in
+        crc_errors instead.
+        """
+        view = self.view
+        next_frame = self.lib.p0rk_frames_next
+        view_pointer = ctypes.byref(view)
+        while True:
+            status = next_frame(self.handle, view_pointer)
+            if status == NEED_DATA:
+                return
+            if status == BAD_ENTRY:
+                continue
+            offset = view.frame - self.base
+            header = FrameHeader(*HEADER.unpack_from(self.ring, offset)[1:])
+            if status == CRC_ERROR:
+                self.crc_errors.append(header)
+                continue
+            start = offset + HEADER.size
+            yield FrameView(header, self.ring[start:start + view.payload_bytes])
+
+    def release(self) -> None:
+        """Return the bytes of every frame yielded so far to the writer."""
+        self.lib.p0rk_frames_release(self.handle)
+
+    def stats(self) -> dict[str, int]:
+        stats = Stats()
+        self.lib.p0rk_frames_stats(self.handle, ctypes.byref(stats))
+        return {name: getattr(stats, name) for name, _ in Stats._fields_}
+
+
+def pack_frame(payload_type: int, sequence: int, payload: bytes,
+               sample_count: int = SAMPLE_COUNT) -> bytes:
+    return HEADER.pack(
+        MAGIC, PROTOCOL_VERSION, payload_type, 0, sequence, sample_count,
+        60_000_000, len(payload), sequence * 1000, 512.0, 100.0, 512.0,
+        200, 2000, 200, 0, zlib.crc32(payload),
+    ) + payload
+
+
+def pack_superframe(frames: list[bytes], sequence: int) -> bytes:
+    index = b""
+    offset = 0
+    for frame in frames:
+        index += SUPERFRAME_INDEX.pack(offset, len(frame))
+        offset += len(frame)
+    return pack_frame(PAYLOAD_SUPERFRAME, sequence, b"".join(frames) + index,
+                      len(frames))
+
+
+# Top rate of each benchmarked mode and the frames per USB transfer: raw and
+# envelope at their compiled limits, A-law credit-paced in superframes of 7.
+BENCH_MODES = {"raw": (1, 100, 1), "envelope": (2, 50, 1), "alaw": (3, 1000, 7)}
+
+
+def bench_stream(mode: str, count: int) -> bytes:
+    """count frames of mode as the firmware sends them, with some text."""
+    payload_type, _, batch = BENCH_MODES[mode]
+    rng = np.random.default_rng(1)
+    if payload_type == 1:
+        payload = rng.integers(0, 1024, SAMPLE_COUNT, dtype="<u2").tobytes()
+    elif payload_type == 2:
+        payload = rng.random(SAMPLE_COUNT, dtype=np.float32).tobytes()
+    else:
+        payload = rng.integers(0, 256, SAMPLE_COUNT, dtype=np.uint8).tobytes()
+    chunks = []
+    for sequence in range(0, count, batch):
+        frames = [
+            pack_frame(payload_type, sequence + k, payload)
+            for k in range(min(batch, count - sequence))
+        ]
+        chunks.append(frames[0] if batch == 1 else pack_superframe(frames, sequence))
+        if sequence % (10 * batch) == 0:
+            chunks.append(b"OK stream\r\n")
+    return b"".join(chunks)
+
+
+def bench_python(data: bytes, count: int, read_size: int) -> float:
+    reader = FrameReader(io.BytesIO(data), read_size=read_size)
+    started = time.perf_counter()
+    for _ in range(count):
+        reader.read_frame().samples()
+    return time.perf_counter() - started
+
+
+def bench_native(data: bytes, count: int, read_size: int) -> float:
+    stream = io.BytesIO(data)
+    received = 0
+    with FrameParser() as parser:
+        started = time.perf_counter()
+        while parser.read_from(stream, read_size):
+            for view in parser.frames():
+                view.samples()
+                received += 1
+            parser.release()
+        elapsed = time.perf_counter() - started
+    if received != count:
+        raise RuntimeError(f"native parser returned {received}/{count} frames")
+    return elapsed
+
+
+def run_bench(args: argparse.Namespace) -> int:
+    print(f"USB full-speed bulk ceiling {USB_FULL_SPEED_BYTES_PER_S / 1e6:.3f} MB/s, "
+          f"{args.frames} frames per run, {args.read_size}-byte reads")
+    for mode, (_, rate, _) in BENCH_MODES.items():
+        data = bench_stream(mode, args.frames)
+        stream_bytes_s = len(data) / args.frames * rate
+        print(f"{mode}: {rate} frames/s max, {stream_bytes_s / 1e6:.3f} MB/s")
+        for name, bench in (("FrameReader", bench_python), ("native", bench_native)):
+            elapsed = min(
+                bench(data, args.frames, args.read_size) for _ in range(args.repeat)
+            )
+            bytes_s = len(data) / elapsed
+            print(f"  {name:12s} {bytes_s / 1e6:8.1f} MB/s "
+                  f"{args.frames / elapsed:9.0f} frames/s "
+                  f"{bytes_s / stream_bytes_s:7.0f}x stream "
+                  f"{bytes_s / USB_FULL_SPEED_BYTES_PER_S:6.0f}x link")
+    return 0
+
+
+def parse_args(argv: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+    )
+    parser.add_argument("--bench", action="store_true", required=True,
+                        help="compare with FrameReader on a synthetic stream")
+    parser.add_argument("--frames", type=int, default=20000)
+    parser.add_argument("--read-size", type=int, default=16384,
+                        help="bytes per read from the synthetic port")
+    parser.add_argument("--repeat", type=int, default=3)
+    return parser.parse_args(argv)
+
+
+if __name__ == "__main__":
+    try:
+        raise SystemExit(run_bench(parse_args(sys.argv[1:])))
+    except (OSError, RuntimeError) as error:
+        print(f"ERROR: {error}", file=sys.stderr)
+        raise SystemExit(1)
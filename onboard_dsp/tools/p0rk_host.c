@@ -0,0 +1,385 @@
+#include "p0rk_host.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define P0RK_HOST_MAX_FRAME      32768u
+#define P0RK_HOST_RX_SIZE        (2u * P0RK_HOST_MAX_FRAME)
+#define P0RK_HOST_FRAME_QUEUE    32u
+#define P0RK_HOST_RESPONSES      64u
+#define P0RK_HOST_RESPONSE_TEXT  512u
+
+typedef struct {
+    bool valid;
+    uint32_t request_id;
+    int status;
+    char text[P0RK_HOST_RESPONSE_TEXT];
+} stored_response_t;
+
+struct p0rk_host {
+    int control_fd;
+    int data_fd;
+    bool owns_fds;
+    uint32_t next_request_id;
+    uint8_t rx[P0RK_HOST_RX_SIZE];
+    size_t rx_length;
+    /* Data frames that arrived while waiting for a response.  When it is
+     * full the oldest is dropped, so a stream cannot fail a reply wait. */
+    uint8_t *queued[P0RK_HOST_FRAME_QUEUE];
+    size_t queued_sizes[P0RK_HOST_FRAME_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_count;
+    uint32_t queue_drops;
+    /* Responses that arrived while reading frames or another response. */
+    stored_response_t responses[P0RK_HOST_RESPONSES];
+};
+
+static uint32_t get_u32(const uint8_t *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) |
+           ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static p0rk_host_t *create(int control_fd, int data_fd, bool owns_fds) {
+    p0rk_host_t *host = calloc(1, sizeof(*host));
+    if (host == NULL) {
+        return NULL;
+    }
+    u4rk_crc32_init();
+    host->control_fd = control_fd;
+    host->data_fd = data_fd;
+    host->owns_fds = owns_fds;
+    host->next_request_id = 1;
+    return host;
+}
+
+p0rk_host_t *p0rk_open(const char *path) {
+    int fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    p0rk_host_t *host = create(fd, fd, true);
+    if (host == NULL) {
+        close(fd);
+    }
+    return host;
+}
+
+p0rk_host_t *p0rk_open_fds(int control_fd, int data_fd) {
+    return create(control_fd, data_fd, false);
+}
+
+void p0rk_close(p0rk_host_t *host) {
+    if (host == NULL) {
+        return;
+    }
+    while (host->queue_count != 0u) {
+        free(host->queued[host->queue_head]);
+        host->queue_head = (host->queue_head + 1u) % P0RK_HOST_FRAME_QUEUE;
+        --host->queue_count;
+    }
+    if (host->owns_fds) {
+        close(host->control_fd);
+    }
+    free(host);
+}
+
+int64_t p0rk_send(p0rk_host_t *host, uint8_t opcode, const void *args,
+                  size_t length) {
+    uint8_t packet[U4RK_COMMAND_MAX_SIZE];
+    uint32_t request_id = host->next_request_id;
+    size_t size = u4rk_command_encode(opcode, request_id, args, length,
+                                      packet);
+    if (size == 0u) {
+        return -1;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t count = write(host->control_fd, packet + written,
+                              size - written);
+        if (count < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+        written += (size_t)count;
+    }
+    host->next_request_id = request_id + 1u;
+    return request_id;
+}
+
+/* Reads more bytes into rx; returns false on timeout or error. */
+static bool fill(p0rk_host_t *host, int64_t deadline_ms, bool *failed) {
+    if (host->rx_length == sizeof(host->rx)) {
+        /* Only reachable with garbage input: keep the tail for the magic. */
+        memmove(host->rx, host->rx + sizeof(host->rx) - 3u, 3u);
+        host->rx_length = 3u;
+    }
+    int64_t remaining = deadline_ms - now_ms();
+    if (remaining < 0) {
+        return false;
+    }
+    struct pollfd pfd = {.fd = host->data_fd, .events = POLLIN};
+    int ready = poll(&pfd, 1, (int)remaining);
+    if (ready < 0) {
+        *failed = errno != EINTR;
+        return false;
+    }
+    if (ready == 0) {
+        return false;
+    }
+    ssize_t count = read(host->data_fd, host->rx + host->rx_length,
+                         sizeof(host->rx) - host->rx_length);
+    if (count <= 0) {
+        *failed = count == 0 || (errno != EINTR && errno != EAGAIN);
+        return false;
+    }
+    host->rx_length += (size_t)count;
+    return true;
+}
+
+static void consume(p0rk_host_t *host, size_t count) {
+    memmove(host->rx, host->rx + count, host->rx_length - count);
+    host->rx_length -= count;
+}
+
+/* Finds the next valid wire frame at the start of rx and returns its size,
+ * 0 on timeout or P0RK_HOST_FAILED. */
+static int next_wire_frame(p0rk_host_t *host, int64_t deadline_ms) {
+    static const uint8_t magic[4] = {'P', '0', 'R', 'K'};
+    bool failed = false;
+    while (true) {
+        size_t start = 0;
+        while (start + 4u <= host->rx_length &&
+               memcmp(host->rx + start, magic, 4u) != 0) {
+            ++start;
+        }
+        consume(host, start);
+        if (host->rx_length >= U4RK_HEADER_SIZE) {
+            uint32_t payload_bytes = get_u32(host->rx + 20);
+            if (host->rx[4] != U4RK_PROTOCOL_VERSION ||
+                payload_bytes > P0RK_HOST_MAX_FRAME - U4RK_HEADER_SIZE) {
+                consume(host, 1u);
+                continue;
+            }
+            size_t size = U4RK_HEADER_SIZE + payload_bytes;
+            if (host->rx_length >= size) {
+                if (u4rk_crc32(host->rx + U4RK_HEADER_SIZE, payload_bytes) !=
+                    get_u32(host->rx + 60)) {
+                    consume(host, 1u);
+                    continue;
+                }
+                return (int)size;
+            }
+        }
+        if (!fill(host, deadline_ms, &failed)) {
+            return failed ? P0RK_HOST_FAILED : 0;
+        }
+    }
+}
+
+static bool store_response(p0rk_host_t *host, size_t size) {
+    stored_response_t *slot = NULL;
+    for (uint32_t i = 0; i < P0RK_HOST_RESPONSES; ++i) {
+        if (!host->responses[i].valid) {
+            slot = &host->responses[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        return false;
+    }
+    size_t length = size - U4RK_HEADER_SIZE;
+    if (length >= sizeof(slot->text)) {
+        length = sizeof(slot->text) - 1u;
+    }
+    memcpy(slot->text, host->rx + U4RK_HEADER_SIZE, length);
+    slot->text[length] = '\0';
+    slot->request_id = get_u32(host->rx + 8);
+    slot->status = (host->rx[6] & U4RK_FLAG_RESPONSE_ERROR) != 0u
+        ? P0RK_HOST_ERR : P0RK_HOST_OK;
+    slot->valid = true;
+    return true;
+}
+
+static void queue_frame(p0rk_host_t *host, size_t size) {
+    uint8_t *copy = malloc(size);
+    if (copy == NULL) {
+        ++host->queue_drops;
+        return;
+    }
+    if (host->queue_count == P0RK_HOST_FRAME_QUEUE) {
+        free(host->queued[host->queue_head]);
+        host->queue_head = (host->queue_head + 1u) % P0RK_HOST_FRAME_QUEUE;
+        --host->queue_count;
+        ++host->queue_drops;
+    }
+    memcpy(copy, host->rx, size);
+    uint32_t index =
+        (host->queue_head + host->queue_count) % P0RK_HOST_FRAME_QUEUE;
+    host->queued[index] = copy;
+    host->queued_sizes[index] = size;
+    ++host->queue_count;
+}
+
+static int take_response(p0rk_host_t *host, uint32_t request_id, char *text,
+                         size_t capacity) {
+    for (uint32_t i = 0; i < P0RK_HOST_RESPONSES; ++i) {
+        stored_response_t *slot = &host->responses[i];
+        if (slot->valid && slot->request_id == request_id) {
+            if (text != NULL && capacity != 0u) {
+                strncpy(text, slot->text, capacity - 1u);
+                text[capacity - 1u] = '\0';
+            }
+            slot->valid = false;
+            return slot->status;
+        }
+    }
+    return P0RK_HOST_TIMEOUT;
+}
+
+int p0rk_wait(p0rk_host_t *host, uint32_t request_id, char *text,
+              size_t capacity, int timeout_ms) {
+    int64_t deadline_ms = now_ms() + timeout_ms;
+    while (true) {
+        int status = take_response(host, request_id, text, capacity);
+        if (status != P0RK_HOST_TIMEOUT) {
+            return status;
+        }
+        int size = next_wire_frame(host, deadline_ms);
+        if (size <= 0) {
+            return size == 0 ? P0RK_HOST_TIMEOUT : P0RK_HOST_FAILED;
+        }
+        bool kept = true;
+        if (host->rx[5] == U4RK_PAYLOAD_RESPONSE) {
+            kept = store_response(host, (size_t)size);
+        } else {
+            queue_frame(host, (size_t)size);
+        }
+        consume(host, (size_t)size);
+        if (!kept) {
+            return P0RK_HOST_FAILED;
+        }
+    }
+}
+
+uint32_t p0rk_queue_drops(const p0rk_host_t *host) {
+    return host->queue_drops;
+}
+
+int p0rk_read_frame(p0rk_host_t *host, uint8_t *frame, size_t capacity,
+                    int timeout_ms) {
+    if (host->queue_count != 0u) {
+        uint8_t *queued = host->queued[host->queue_head];
+        size_t size = host->queued_sizes[host->queue_head];
+        if (size > capacity) {
+            return P0RK_HOST_FAILED;
+        }
+        memcpy(frame, queued, size);
+        free(queued);
+        host->queue_head = (host->queue_head + 1u) % P0RK_HOST_FRAME_QUEUE;
+        --host->queue_count;
+        return (int)size;
+    }
+    int64_t deadline_ms = now_ms() + timeout_ms;
+    while (true) {
+        int size = next_wire_frame(host, deadline_ms);
+        if (size <= 0) {
+            return size;
+        }
+        if (host->rx[5] == U4RK_PAYLOAD_RESPONSE) {
+            bool kept = store_response(host, (size_t)size);
+            consume(host, (size_t)size);
+            if (!kept) {
+                return P0RK_HOST_FAILED;
+            }
+            continue;
+        }
+        if ((size_t)size > capacity) {
+            return P0RK_HOST_FAILED;
+        }
+        memcpy(frame, host->rx, (size_t)size);
+        consume(host, (size_t)size);
+        return size;
+    }
+}
+
+static void put_u16(uint8_t *out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+int64_t p0rk_dac_write(p0rk_host_t *host, uint16_t value) {
+    uint8_t args[2];
+    put_u16(args, value);
+    return p0rk_send(host, U4RK_OP_DAC_WRITE, args, sizeof(args));
+}
+
+int64_t p0rk_pulse_config(p0rk_host_t *host, uint32_t negative_ns,
+                          uint32_t damp_ns, uint32_t positive_ns,
+                          uint8_t order) {
+    uint8_t args[13];
+    put_u32(args, negative_ns);
+    put_u32(args + 4, damp_ns);
+    put_u32(args + 8, positive_ns);
+    args[12] = order;
+    return p0rk_send(host, U4RK_OP_PULSE_CONFIG, args, sizeof(args));
+}
+
+int64_t p0rk_acq(p0rk_host_t *host, uint8_t payload_type) {
+    return p0rk_send(host, U4RK_OP_ACQ, &payload_type, 1u);
+}
+
+int64_t p0rk_stream_start(p0rk_host_t *host, uint8_t payload_type,
+                          uint32_t rate_hz, int32_t credits,
+                          uint16_t batch) {
+    uint8_t args[12];
+    args[0] = payload_type;
+    args[1] = (uint8_t)((rate_hz == 0u ? U4RK_STREAM_OPTION_MAX_RATE : 0u) |
+                        (credits >= 0 ? U4RK_STREAM_OPTION_CREDIT : 0u));
+    put_u16(args + 2, batch);
+    put_u32(args + 4, rate_hz);
+    put_u32(args + 8, credits >= 0 ? (uint32_t)credits : 0u);
+    return p0rk_send(host, U4RK_OP_STREAM_START, args, sizeof(args));
+}
+
+int64_t p0rk_credit(p0rk_host_t *host, uint32_t credits) {
+    uint8_t args[4];
+    put_u32(args, credits);
+    return p0rk_send(host, U4RK_OP_CREDIT, args, sizeof(args));
+}
+
+int64_t p0rk_resend(p0rk_host_t *host, uint32_t sequence) {
+    uint8_t args[4];
+    put_u32(args, sequence);
+    return p0rk_send(host, U4RK_OP_RESEND, args, sizeof(args));
+}
@@ -0,0 +1,76 @@
+/*
+ * Host library for the pic0rick binary command protocol.
+ *
+ * Commands are encoded as pic0rick/command_protocol.h packets and may be
+ * sent back to back; the device runs them in order and answers each with a
+ * response frame carrying its request ID.  p0rk_wait() collects those
+ * answers while p0rk_read_frame() returns the data frames around them, so
+ * a parameter sweep costs one USB round trip in total rather than one per
+ * command.  POSIX only (termios serial ports, pipes and ptys).
+ *
+ *   cc -O2 -shared -fPIC -I../pic0rick p0rk_host.c \
+ *       ../pic0rick/command_protocol.c ../pic0rick/protocol.c \
+ *       -o libp0rk_host.so
+ */
+#ifndef P0RK_HOST_H
+#define P0RK_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "command_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct p0rk_host p0rk_host_t;
+
+/* Response status returned by p0rk_wait(). */
+enum {
+    P0RK_HOST_OK = 0,
+    P0RK_HOST_ERR = 1,     /* the device answered "ERR ..." */
+    P0RK_HOST_TIMEOUT = -1,
+    P0RK_HOST_FAILED = -2, /* I/O error, bad frame or full response table */
+};
+
+/* Opens a CDC serial device; frames are read from the same port. */
+p0rk_host_t *p0rk_open(const char *path);
+/* Uses existing descriptors, e.g. a pty or the vendor-channel reader's
+ * pipe.  The descriptors are not closed by p0rk_close(). */
+p0rk_host_t *p0rk_open_fds(int control_fd, int data_fd);
+void p0rk_close(p0rk_host_t *host);
+
+/* Queues one command without waiting.  Returns its request ID, or -1. */
+int64_t p0rk_send(p0rk_host_t *host, uint8_t opcode, const void *args,
+                  size_t length);
+/* Waits for the answer to request_id and copies its text (NUL-terminated,
+ * "OK ..." or "ERR ...") into text when it is not NULL. */
+int p0rk_wait(p0rk_host_t *host, uint32_t request_id, char *text,
+              size_t capacity, int timeout_ms);
+/* Copies the next data frame (header and payload, superframes whole) into
+ * frame.  Returns its size, 0 on timeout, or P0RK_HOST_FAILED. */
+int p0rk_read_frame(p0rk_host_t *host, uint8_t *frame, size_t capacity,
+                    int timeout_ms);
+/* Data frames dropped, oldest first, because more arrived during
+ * p0rk_wait() calls than the frame queue holds. */
+uint32_t p0rk_queue_drops(const p0rk_host_t *host);
+
+/* Typed wrappers around p0rk_send(). */
+int64_t p0rk_dac_write(p0rk_host_t *host, uint16_t value);
+int64_t p0rk_pulse_config(p0rk_host_t *host, uint32_t negative_ns,
+                          uint32_t damp_ns, uint32_t positive_ns,
+                          uint8_t order);
+int64_t p0rk_acq(p0rk_host_t *host, uint8_t payload_type);
+int64_t p0rk_stream_start(p0rk_host_t *host, uint8_t payload_type,
+                          uint32_t rate_hz, int32_t credits,
+                          uint16_t batch);
+int64_t p0rk_credit(p0rk_host_t *host, uint32_t credits);
+/* The frame comes back from the device's history with U4RK_FLAG_RESENT. */
+int64_t p0rk_resend(p0rk_host_t *host, uint32_t sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,237 @@
+#!/usr/bin/env python3
+"""Python binding for the pic0rick binary command library (p0rk_host.c).
+
+Build the shared library first (see p0rk_host.h), then for example sweep
+the DAC with one acquisition per step, all commands sent up front:
+
+    python tools/p0rk_host.py --port /dev/ttyACM0 --sweep 0 1023 64
+
+The library is found next to this file or through P0RK_HOST_LIB.
+"""
+
+from __future__ import annotations
+
+import argparse
+import ctypes
+import os
+import struct
+import sys
+import time
+from pathlib import Path
+
+from pic0rick_capture import PAYLOAD_NAMES, Frame, parse_frame
+
+OP_STATUS = 1
+OP_PULSER_ARM = 2
+OP_PULSER_DISARM = 3
+OP_PULSE_CONFIG = 4
+OP_DAC_WRITE = 5
+OP_DSP_SCALE = 6
+OP_DSP_THRESHOLD = 7
+OP_DSP_SELFTEST = 8
+OP_ACQ = 9
+OP_STREAM_START = 10
+OP_CREDIT = 11
+OP_STREAM_STOP = 12
+OP_STATS = 13
+OP_STATS_RESET = 14
+OP_STATS_FRAME = 15
+OP_DATA = 16
+OP_RESEND = 17
+
+STATUS_OK = 0
+STATUS_ERR = 1
+STATUS_TIMEOUT = -1
+MAX_FRAME = 32768
+PAYLOAD_TYPES = {name: value for value, name in PAYLOAD_NAMES.items()}
+ACQUISITION_MODES = (
+    "raw", "rawz", "envelope", "envelope-f16", "envelope-u16", "sparse", "alaw"
+)
+
+
+class CommandError(RuntimeError):
+    pass
+
+
+def load_library() -> ctypes.CDLL:
+    path = os.environ.get("P0RK_HOST_LIB")
+    if path is None:
+        path = str(Path(__file__).with_name("libp0rk_host.so"))
+    library = ctypes.CDLL(path)
+    library.p0rk_open.restype = ctypes.c_void_p
+    library.p0rk_open.argtypes = [ctypes.c_char_p]
+    library.p0rk_open_fds.restype = ctypes.c_void_p
+    library.p0rk_open_fds.argtypes = [ctypes.c_int, ctypes.c_int]
+    library.p0rk_close.argtypes = [ctypes.c_void_p]
+    library.p0rk_send.restype = ctypes.c_int64
+    library.p0rk_send.argtypes = [
+        ctypes.c_void_p, ctypes.c_uint8, ctypes.c_char_p, ctypes.c_size_t
+    ]
+    library.p0rk_wait.restype = ctypes.c_int
+    library.p0rk_wait.argtypes = [
+        ctypes.c_void_p, ctypes.c_uint32, ctypes.c_char_p, ctypes.c_size_t,
+        ctypes.c_int,
+    ]
+    library.p0rk_read_frame.restype = ctypes.c_int
+    library.p0rk_read_frame.argtypes = [
+        ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int
+    ]
+    library.p0rk_queue_drops.restype = ctypes.c_uint32
+    library.p0rk_queue_drops.argtypes = [ctypes.c_void_p]
+    return library
+
+
+class Host:
+    """Pipelined command session; every send returns a request ID."""
+
+    def __init__(self, port: str | None = None, fds: tuple[int, int] | None = None,
+                 timeout: float = 5.0):
+        self.lib = load_library()
+        if fds is not None:
+            self.handle = self.lib.p0rk_open_fds(*fds)
+        elif port is not None:
+            self.handle = self.lib.p0rk_open(port.encode())
+        else:
+            raise ValueError("need a port or a descriptor pair")
+        if not self.handle:
+            raise OSError(f"cannot open {port or fds}")
+        self.timeout_ms = int(timeout * 1000)
+        self.frame_buffer = ctypes.create_string_buffer(MAX_FRAME)
+        self.text_buffer = ctypes.create_string_buffer(512)
+
+    def close(self) -> None:
+        if self.handle:
+            self.lib.p0rk_close(self.handle)
+            self.handle = None
+
+    def __enter__(self) -> "Host":
+        return self
+
+    def __exit__(self, *exc: object) -> None:
+        self.close()
+
+    def send(self, opcode: int, args: bytes = b"") -> int:
+        request_id = self.lib.p0rk_send(self.handle, opcode, args, len(args))
+        if request_id < 0:
+            raise OSError("command write failed")
+        return request_id
+
+    def wait(self, request_id: int, check: bool = True) -> str:
+        status = self.lib.p0rk_wait(
+            self.handle, request_id, self.text_buffer,
+            len(self.text_buffer), self.timeout_ms,
+        )
+        if status == STATUS_TIMEOUT:
+            raise TimeoutError(f"no response to request {request_id}")
+        if status < 0:
+            raise OSError("frame stream failed")
+        text = self.text_buffer.value.decode("ascii", errors="replace")
+        if check and status == STATUS_ERR:
+            raise CommandError(text)
+        return text
+
+    def call(self, opcode: int, args: bytes = b"") -> str:
+        return self.wait(self.send(opcode, args))
+
+    def read_frame(self) -> Frame:
+        size = self.lib.p0rk_read_frame(
+            self.handle, self.frame_buffer, MAX_FRAME, self.timeout_ms
+        )
+        if size == 0:
+            raise TimeoutError("timed out waiting for a frame")
+        if size < 0:
+            raise OSError("frame stream failed")
+        return parse_frame(self.frame_buffer.raw[:size])
+
+    @property
+    def queue_drops(self) -> int:
+        """Data frames dropped because they piled up during wait()."""
+        return self.lib.p0rk_queue_drops(self.handle)
+
+    # Argument packing mirrors pic0rick/command_protocol.h.
+    def dac_write(self, value: int) -> int:
+        return self.send(OP_DAC_WRITE, struct.pack("<H", value))
+
+    def pulse_config(self, negative_ns: int, damp_ns: int, positive_ns: int,
+                     negative_first: bool = True) -> int:
+        return self.send(OP_PULSE_CONFIG, struct.pack(
+            "<IIIB", negative_ns, damp_ns, positive_ns,
+            0 if negative_first else 1))
+
+    def dsp_scale(self, reference: float) -> int:
+        return self.send(OP_DSP_SCALE, struct.pack("<f", reference))
+
+    def dsp_threshold(self, counts: float) -> int:
+        return self.send(OP_DSP_THRESHOLD, struct.pack("<f", counts))
+
+    def acq(self, mode: str) -> int:
+        return self.send(OP_ACQ, bytes([PAYLOAD_TYPES[mode]]))
+
+    def stream_start(self, mode: str, rate_hz: int = 0,
+                     credits: int | None = None, batch: int = 1) -> int:
+        options = (2 if rate_hz == 0 else 0) | (1 if credits is not None else 0)
+        return self.send(OP_STREAM_START, struct.pack(
+            "<BBHII", PAYLOAD_TYPES[mode], options, batch, rate_hz,
+            credits or 0))
+
+    def credit(self, count: int) -> int:
+        return self.send(OP_CREDIT, struct.pack("<I", count))
+
+    def data_channel(self, vendor: bool) -> int:
+        return self.send(OP_DATA, bytes([1 if vendor else 0]))
+
+    def resend(self, sequence: int) -> int:
+        return self.send(OP_RESEND, struct.pack("<I", sequence))
+
+
+def run_sweep(args: argparse.Namespace) -> int:
+    start, stop, step = args.sweep
+    values = list(range(start, stop + 1, step))
+    with Host(args.port, timeout=args.timeout) as host:
+        started = time.perf_counter()
+        requests = []
+        for value in values:
+            requests.append(host.dac_write(value))
+            requests.append(host.acq(args.mode))
+        # Each acquisition's frame follows its reply, so reading in step
+        # order keeps the library's queue of early frames short.
+        frames = []
+        for dac_request, acq_request in zip(requests[::2], requests[1::2]):
+            host.wait(dac_request)
+            host.wait(acq_request)
+            frames.append(host.read_frame())
+        elapsed = time.perf_counter() - started
+    for value, frame in zip(values, frames):
+        print(f"dac={value} seq={frame.header.sequence} "
+              f"peak={frame.header.envelope_peak:.5g}")
+    print(f"{len(values)} steps in {elapsed * 1e3:.1f} ms "
+          f"({elapsed * 1e3 / len(values):.2f} ms/step)")
+    return 0
+
+
+def parse_args(argv: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+    )
+    parser.add_argument("--port", required=True, help="CDC serial device")
+    parser.add_argument(
+        "--sweep", type=int, nargs=3, metavar=("START", "STOP", "STEP"),
+        required=True, help="DAC values to step through",
+    )
+    parser.add_argument(
+        "--mode", choices=ACQUISITION_MODES, default="envelope"
+    )
+    parser.add_argument("--timeout", type=float, default=5.0)
+    args = parser.parse_args(argv)
+    if args.sweep[2] <= 0:
+        parser.error("STEP must be positive")
+    return args
+
+
+if __name__ == "__main__":
+    try:
+        raise SystemExit(run_sweep(parse_args(sys.argv[1:])))
+    except (CommandError, OSError, TimeoutError, ValueError) as error:
+        print(f"ERROR: {error}", file=sys.stderr)
+        raise SystemExit(1)
@@ -1,28 +1,107 @@
 #!/usr/bin/env python3
-"""Capture and validate pic0rick USB CDC binary frames."""
+"""Capture and validate pic0rick USB binary frames (CDC or vendor bulk)."""
 
 from __future__ import annotations
 
 import argparse
+import ctypes
 import dataclasses
 import json
+import os
 import struct
+import queue
 import sys
+import threading
 import time
 import zlib
+from collections import deque
 from pathlib import Path
-from typing import BinaryIO, Iterable
+from typing import TYPE_CHECKING, BinaryIO, Callable, Iterable
 
 import numpy as np
 
+if TYPE_CHECKING:
+    from capture_file import CaptureWriter
+
 MAGIC = b"P0RK"
 PROTOCOL_VERSION = 1
 SAMPLE_COUNT = 4096
 HEADER = struct.Struct("<4sBBHIIIIQfffIIIII")
-PAYLOAD_NAMES = {1: "raw", 2: "envelope", 3: "alaw"}
-PAYLOAD_BYTES = {1: SAMPLE_COUNT * 2, 2: SAMPLE_COUNT * 4, 3: SAMPLE_COUNT}
+PAYLOAD_TELEMETRY = 4
+TELEMETRY_STAGES = (
+    "acquire",
+    "job_wait",
+    "dsp",
+    "output_wait",
+    "usb",
+    "total",
+)
+TELEMETRY_BUCKETS = 24
+TELEMETRY_BYTES = (len(TELEMETRY_STAGES) * (3 + TELEMETRY_BUCKETS) + 4) * 4
+PAYLOAD_SUPERFRAME = 5
+PAYLOAD_RAW_RICE = 6
+PAYLOAD_ENVELOPE_F16 = 7
+PAYLOAD_ENVELOPE_U16 = 8
+PAYLOAD_ENVELOPE_SPARSE = 9
+PAYLOAD_RESPONSE = 10
+PAYLOAD_BENCH = 11
+FLAG_RESPONSE_ERROR = 1 << 5
+FLAG_RESENT = 1 << 6
+# The firmware's 512-byte response buffer minus room for CR LF and NUL.
+RESPONSE_MAX_BYTES = 509
+MAX_PAYLOAD_BYTES = 16384
+SPARSE_MAX_BYTES = 4 + SAMPLE_COUNT * 2
+RAW_BYTES = SAMPLE_COUNT * 2
+RICE_BLOCK = 64
+RICE_ESCAPE = 16
+RICE_RESIDUAL_BITS = 11
+RICE_MAX_K = 11
+RICE_PREDICTOR_START = 512
+SUPERFRAME_MAX_FRAMES = 16
+SUPERFRAME_MAX_BYTES = 32768 - 64
+SUPERFRAME_INDEX = struct.Struct("<II")
+PAYLOAD_NAMES = {
+    1: "raw",
+    2: "envelope",
+    3: "alaw",
+    4: "telemetry",
+    5: "superframe",
+    6: "rawz",
+    7: "envelope-f16",
+    8: "envelope-u16",
+    9: "sparse",
+    10: "response",
+    11: "bench",
+}
+PAYLOAD_BYTES = {
+    1: SAMPLE_COUNT * 2,
+    2: SAMPLE_COUNT * 4,
+    3: SAMPLE_COUNT,
+    4: TELEMETRY_BYTES,
+    7: SAMPLE_COUNT * 2,
+    8: SAMPLE_COUNT * 2,
+}
+# Frames numbered by the capture sequence, which "resend" can recover from
+# the firmware's history of U4RK_HISTORY_ENTRIES frames, at most
+# U4RK_RESEND_QUEUE_DEPTH queued at a time.
+SEQUENCED_TYPES = frozenset({1, 2, 3, 6, 7, 8, 9})
+HISTORY_ENTRIES = 32
+RESEND_QUEUE_DEPTH = 8
+# Telemetry frames report their histogram bucket count as the sample count.
+SAMPLE_COUNTS = {PAYLOAD_TELEMETRY: TELEMETRY_BUCKETS}
 A_LAW_A = 87.6
 EXPECTED_FIRMWARE = "1.5"
+CAPTURE_FILE_NAME = "capture.p0rk"
+# Threaded capture: bytes buffered between the port and the frame parser,
+# frames queued for disk and console, and how often statistics are shown.
+CAPTURE_RING_BYTES = 16 << 20
+CAPTURE_DISK_QUEUE = 1024
+CAPTURE_CONSOLE_QUEUE = 256
+CAPTURE_STATS_INTERVAL_S = 1.0
+# The reader thread polls the port this often so that it can be stopped,
+# and stop() gives up waiting for it after CAPTURE_STOP_S.
+CAPTURE_POLL_S = 0.1
+CAPTURE_STOP_S = 2.0
 FLAG_SELFTEST = 1 << 3
 SELFTEST_CASE_SHIFT = 8
 SELFTEST_NAMES = (
@@ -36,6 +115,103 @@ SELFTEST_NAMES = (
 )
 
 
+def decode_sparse(payload: bytes, scale: float, count: int = SAMPLE_COUNT) -> np.ndarray:
+    """Expand {start, length, values} runs; samples outside runs are zero."""
+    words = np.frombuffer(payload, dtype="<u2")
+    envelope = np.zeros(count, dtype=np.float32)
+    position = 0
+    while position < len(words):
+        if position + 2 > len(words):
+            raise ValueError("truncated sparse run header")
+        start, length = int(words[position]), int(words[position + 1])
+        position += 2
+        if length == 0 or start + length > count or position + length > len(words):
+            raise ValueError(f"invalid sparse run start={start} length={length}")
+        envelope[start:start + length] = words[position:position + length]
+        position += length
+    return envelope / np.float32(scale)
+
+
+_rice_library: ctypes.CDLL | None | bool = None
+
+
+def rice_library() -> ctypes.CDLL | None:
+    """The firmware's own decoder from pic0rick/rice.c, or None if unbuilt.
+
+    Build it from the onboard_dsp directory (P0RK_RICE_LIB overrides the
+    path):
+
+        cc -O2 -shared -fPIC -Ipic0rick pic0rick/rice.c -o tools/libp0rk_rice.so
+    """
+    global _rice_library
+    if _rice_library is None:
+        path = os.environ.get("P0RK_RICE_LIB")
+        if path is None:
+            path = str(Path(__file__).with_name("libp0rk_rice.so"))
+        try:
+            library = ctypes.CDLL(path)
+        except OSError:
+            _rice_library = False
+        else:
+            library.u4rk_rice_decode.restype = ctypes.c_bool
+            library.u4rk_rice_decode.argtypes = [
+                ctypes.c_char_p, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_uint16), ctypes.c_uint32,
+            ]
+            _rice_library = library
+    return _rice_library or None
+
+
+def decode_rice(payload: bytes, count: int = SAMPLE_COUNT) -> np.ndarray:
+    """Decode a rawz payload; see pic0rick/rice.h for the bit layout."""
+    library = rice_library()
+    if library is None:
+        return decode_rice_python(payload, count)
+    samples = np.empty(count, dtype=np.uint16)
+    if not library.u4rk_rice_decode(
+        payload, len(payload),
+        samples.ctypes.data_as(ctypes.POINTER(ctypes.c_uint16)), count,
+    ):
+        raise ValueError("corrupt or truncated rawz payload")
+    return samples
+
+
+def decode_rice_python(payload: bytes, count: int = SAMPLE_COUNT) -> np.ndarray:
+    """Pure-Python decode_rice, used when libp0rk_rice.so is not built."""
+    bits = bin(int.from_bytes(b"\x01" + payload, "big"))[3:]
+    position = 0
+
+    def take(width: int) -> int:
+        nonlocal position
+        if position + width > len(bits):
+            raise ValueError("truncated rawz payload")
+        value = int(bits[position:position + width], 2) if width else 0
+        position += width
+        return value
+
+    samples = np.empty(count, dtype=np.uint16)
+    previous = RICE_PREDICTOR_START
+    k = 0
+    for index in range(count):
+        if index % RICE_BLOCK == 0:
+            k = take(4)
+            if k > RICE_MAX_K:
+                raise ValueError(f"invalid Rice parameter {k}")
+        zero = bits.find("0", position, position + RICE_ESCAPE)
+        if zero < 0:
+            take(RICE_ESCAPE)
+            residual = take(RICE_RESIDUAL_BITS)
+        else:
+            quotient = zero - position
+            position = zero + 1
+            residual = (quotient << k) | take(k)
+        previous += (residual >> 1) ^ -(residual & 1)
+        if not 0 <= previous <= 0x3FF:
+            raise ValueError(f"corrupt rawz payload at sample {index}")
+        samples[index] = previous
+    return samples
+
+
 @dataclasses.dataclass(frozen=True)
 class FrameHeader:
     version: int
@@ -74,18 +250,302 @@ class Frame:
     def samples(self) -> np.ndarray:
         if self.header.payload_type == 1:
             return np.frombuffer(self.payload, dtype="<u2").copy()
+        if self.header.payload_type == PAYLOAD_RAW_RICE:
+            return decode_rice(self.payload, self.header.sample_count)
         if self.header.payload_type == 2:
             return np.frombuffer(self.payload, dtype="<f4").copy()
+        # Both 16-bit envelopes decode to float32 in ADC counts; the uint16
+        # form stores its fixed scale in the alaw_reference header field.
+        if self.header.payload_type == PAYLOAD_ENVELOPE_F16:
+            return np.frombuffer(self.payload, dtype="<f2").astype(np.float32)
+        if self.header.payload_type == PAYLOAD_ENVELOPE_U16:
+            codes = np.frombuffer(self.payload, dtype="<u2").astype(np.float32)
+            return codes / np.float32(self.header.alaw_reference)
+        if self.header.payload_type == PAYLOAD_ENVELOPE_SPARSE:
+            return decode_sparse(
+                self.payload, self.header.alaw_reference, self.header.sample_count
+            )
+        if self.header.payload_type == PAYLOAD_TELEMETRY:
+            return np.frombuffer(self.payload, dtype="<u4").copy()
         return np.frombuffer(self.payload, dtype=np.uint8).copy()
 
 
+def check_header_shape(payload_type: int, sample_count: int, payload_bytes: int) -> None:
+    if payload_type == PAYLOAD_SUPERFRAME:
+        if not 1 <= sample_count <= SUPERFRAME_MAX_FRAMES:
+            raise ValueError(f"invalid superframe frame count {sample_count}")
+        if not (
+            sample_count * (HEADER.size + SUPERFRAME_INDEX.size)
+            <= payload_bytes
+            <= SUPERFRAME_MAX_BYTES
+        ):
+            raise ValueError(f"invalid superframe size {payload_bytes}")
+        return
+    if payload_type == PAYLOAD_RAW_RICE:
+        if sample_count != SAMPLE_COUNT:
+            raise ValueError(f"invalid sample count {sample_count}")
+        # The firmware sends a frame as plain raw unless coding shrank it.
+        if not 0 < payload_bytes < RAW_BYTES:
+            raise ValueError(f"invalid rawz payload size {payload_bytes}")
+        return
+    if payload_type == PAYLOAD_ENVELOPE_SPARSE:
+        if sample_count != SAMPLE_COUNT:
+            raise ValueError(f"invalid sample count {sample_count}")
+        if payload_bytes > SPARSE_MAX_BYTES or payload_bytes % 2:
+            raise ValueError(f"invalid sparse payload size {payload_bytes}")
+        return
+    if payload_type == PAYLOAD_BENCH:
+        if sample_count != 0 or not 0 < payload_bytes <= MAX_PAYLOAD_BYTES:
+            raise ValueError(f"invalid bench payload size {payload_bytes}")
+        return
+    if payload_type == PAYLOAD_RESPONSE:
+        if sample_count != 0 or not 0 < payload_bytes <= RESPONSE_MAX_BYTES:
+            raise ValueError(f"invalid response size {payload_bytes}")
+        return
+    if payload_type not in PAYLOAD_BYTES:
+        raise ValueError(f"invalid payload type {payload_type}")
+    if sample_count != SAMPLE_COUNTS.get(payload_type, SAMPLE_COUNT):
+        raise ValueError(f"invalid sample count {sample_count}")
+    if payload_bytes != PAYLOAD_BYTES[payload_type]:
+        raise ValueError(
+            f"invalid {PAYLOAD_NAMES[payload_type]} payload size {payload_bytes}"
+        )
+
+
+class CrcError(ValueError):
+    """Payload CRC mismatch in a frame whose header was intact."""
+
+    def __init__(self, message: str, header: FrameHeader):
+        super().__init__(message)
+        self.header = header
+
+
+def parse_frame(data: bytes) -> Frame:
+    """Decode one complete frame held in memory (a superframe entry)."""
+    if len(data) < HEADER.size:
+        raise ValueError(f"truncated frame of {len(data)} bytes")
+    values = HEADER.unpack_from(data)
+    magic, version, payload_type, _, _, sample_count, _, payload_bytes = values[:8]
+    if magic != MAGIC or version != PROTOCOL_VERSION:
+        raise ValueError("superframe entry does not start with a P0RK header")
+    if payload_type == PAYLOAD_SUPERFRAME:
+        raise ValueError("nested superframe")
+    check_header_shape(payload_type, sample_count, payload_bytes)
+    if len(data) != HEADER.size + payload_bytes:
+        raise ValueError(f"superframe entry length {len(data)} does not match header")
+    payload = data[HEADER.size:]
+    actual_crc = zlib.crc32(payload) & 0xFFFFFFFF
+    if actual_crc != values[-1]:
+        raise ValueError(
+            f"inner CRC mismatch: header={values[-1]:08x} actual={actual_crc:08x}"
+        )
+    return Frame(FrameHeader(*values[1:]), payload)
+
+
+def split_superframe(frame: Frame) -> list[Frame]:
+    """Return the inner frames of a superframe using its trailing index."""
+    count = frame.header.sample_count
+    payload = frame.payload
+    index_start = len(payload) - count * SUPERFRAME_INDEX.size
+    frames = []
+    for entry in range(count):
+        offset, length = SUPERFRAME_INDEX.unpack_from(
+            payload, index_start + entry * SUPERFRAME_INDEX.size
+        )
+        if offset + length > index_start:
+            raise ValueError(f"superframe entry {entry} overruns the index")
+        frames.append(parse_frame(payload[offset:offset + length]))
+    return frames
+
+
 class FrameReader:
-    """Buffered reader that discards text/noise until the next P0RK magic."""
+    """Buffered reader that discards text/noise until the next P0RK magic.
+
+    Superframes are unpacked transparently: read_frame() returns their inner
+    frames one at a time, in order.  Response frames answering "@<id>"
+    requests are set aside for read_response() and never returned as data.
+
+    Given the control port as ``recover``, the reader asks the device to
+    resend a data frame that arrived corrupted or is missing from the
+    sequence, and returns it in its place.  Frames the device no longer
+    holds are counted in ``frames_lost`` and leave a gap as before.
+    """
 
-    def __init__(self, stream: BinaryIO, read_size: int = 4096):
+    MAX_UNCLAIMED_RESPONSES = 256
+
+    def __init__(self, stream: BinaryIO, read_size: int = 4096,
+                 recover: BinaryIO | None = None):
         self.stream = stream
         self.read_size = read_size
         self.buffer = bytearray()
+        self.pending: deque[Frame] = deque()
+        self.superframes = 0
+        self.responses: dict[int, str | CrcError] = {}
+        self.next_request_id = 1
+        self.recover = recover
+        self.expected_sequence: int | None = None
+        self.resent: dict[int, Frame | None] = {}
+        self.recovered: deque[Frame] = deque()
+        self.given_up: set[int] = set()
+        self.crc_errors = 0
+        self.frames_recovered = 0
+        self.frames_lost = 0
+
+    def read_frame(self) -> Frame:
+        if self.recovered:
+            return self._deliver(self.recovered.popleft())
+        while not self.pending:
+            self._pump()
+        frame = self.pending.popleft()
+        if (
+            self.recover is not None
+            and frame.header.payload_type in SEQUENCED_TYPES
+            and self.expected_sequence is not None
+        ):
+            gap = (frame.header.sequence - self.expected_sequence) & 0xFFFFFFFF
+            if 0 < gap < 0x80000000:
+                self.recovered.extend(self._recover_gap(gap))
+                self.recovered.append(frame)
+                frame = self.recovered.popleft()
+        return self._deliver(frame)
+
+    def read_response(self, request_id: int) -> str:
+        """Wait for the OK/ERR text of a framed request.
+
+        Data frames arriving first stay queued for read_frame().
+        """
+        while request_id not in self.responses:
+            self._pump()
+        return self._take_response(request_id)
+
+    def read_frame_or_response(self, request_id: int) -> Frame | str:
+        """Return the next data frame, or the reply to request_id once every
+        data frame that arrived before it has been returned."""
+        while not self.pending and request_id not in self.responses:
+            self._pump()
+        if self.pending:
+            return self.pending.popleft()
+        return self._take_response(request_id)
+
+    def _take_response(self, request_id: int) -> str:
+        response = self.responses.pop(request_id)
+        if isinstance(response, CrcError):
+            raise response
+        return response
+
+    def request(self, port: BinaryIO, command: str) -> str:
+        """Send a framed request on the control port and return its reply."""
+        return self.read_response(self.send_request(port, command))
+
+    def send_request(self, port: BinaryIO, command: str) -> int:
+        """Send a framed request without waiting; returns its request ID."""
+        request_id = self.next_request_id
+        self.next_request_id = (self.next_request_id + 1) & 0xFFFFFFFF
+        port.write(f"@{request_id} {command}\n".encode("ascii"))
+        port.flush()
+        return request_id
+
+    def _deliver(self, frame: Frame) -> Frame:
+        if frame.header.payload_type in SEQUENCED_TYPES:
+            self.expected_sequence = (frame.header.sequence + 1) & 0xFFFFFFFF
+        return frame
+
+    def _recover_gap(self, gap: int) -> list[Frame]:
+        first = self.expected_sequence
+        missing = [(first + offset) & 0xFFFFFFFF for offset in range(gap)]
+        # Anything older than the device's history is gone for good, and
+        # frames already asked for once are not asked for again.
+        wanted = [
+            sequence for sequence in missing[-HISTORY_ENTRIES:]
+            if sequence not in self.given_up
+        ]
+        self.frames_lost += gap - len(missing[-HISTORY_ENTRIES:])
+        self.given_up.difference_update(missing)
+        return self._resend(wanted)
+
+    def _resend(self, sequences: list[int]) -> list[Frame]:
+        """Ask for frames again; returns those that came back, in order."""
+        frames = []
+        for start in range(0, len(sequences), RESEND_QUEUE_DEPTH):
+            batch = sequences[start:start + RESEND_QUEUE_DEPTH]
+            requests = [
+                (sequence, self.send_request(self.recover, f"resend {sequence}"))
+                for sequence in batch
+            ]
+            # Each accepted resend follows its OK on the data stream.
+            accepted = [
+                sequence for sequence, request_id in requests
+                if self._resend_accepted(request_id)
+            ]
+            try:
+                while any(sequence not in self.resent for sequence in accepted):
+                    self._pump()
+            except TimeoutError:
+                pass
+            for sequence in batch:
+                frame = self.resent.pop(sequence, None)
+                if frame is None:
+                    self.frames_lost += 1
+                    self.given_up.add(sequence)
+                else:
+                    frames.append(frame)
+                    self.frames_recovered += 1
+        return frames
+
+    def _resend_accepted(self, request_id: int) -> bool:
+        try:
+            return self.read_response(request_id).startswith("OK")
+        except CrcError:
+            # Treated as refused: the frame, if it comes, counts as lost.
+            return False
+
+    def _pump(self) -> None:
+        """Read one wire frame and file it where it belongs."""
+        try:
+            frame = self._read_wire_frame()
+        except CrcError as error:
+            if self.recover is None:
+                raise
+            self.crc_errors += 1
+            header = error.header
+            if header.payload_type == PAYLOAD_RESPONSE:
+                # The request ID survives in the intact header, so the
+                # caller waiting for it fails now instead of timing out.
+                self.responses[header.sequence] = error
+                return
+            if header.payload_type not in SEQUENCED_TYPES:
+                # A superframe's inner frames show up as a gap instead.
+                return
+            if header.flags & FLAG_RESENT:
+                self.resent[header.sequence] = None
+                return
+            # Frames read while waiting are newer, so the replacement goes
+            # where the corrupted frame would have been.
+            position = len(self.pending)
+            for frame in self._resend([header.sequence]):
+                self.pending.insert(position, frame)
+            return
+        self._demultiplex(frame)
+
+    def _demultiplex(self, frame: Frame) -> None:
+        payload_type = frame.header.payload_type
+        if (
+            self.recover is not None
+            and frame.header.flags & FLAG_RESENT
+            and payload_type in SEQUENCED_TYPES
+        ):
+            self.resent[frame.header.sequence] = frame
+        elif payload_type == PAYLOAD_RESPONSE:
+            if len(self.responses) >= self.MAX_UNCLAIMED_RESPONSES:
+                del self.responses[next(iter(self.responses))]
+            self.responses[frame.header.sequence] = frame.payload.decode(
+                "ascii", errors="replace"
+            )
+        elif payload_type == PAYLOAD_SUPERFRAME:
+            self.pending.extend(split_superframe(frame))
+            self.superframes += 1
+        else:
+            self.pending.append(frame)
 
     def _fill(self, needed: int) -> None:
         while len(self.buffer) < needed:
@@ -100,7 +560,7 @@ class FrameReader:
                 raise TimeoutError(f"timed out with {len(self.buffer)}/{needed} bytes")
             self.buffer.extend(chunk)
 
-    def read_frame(self) -> Frame:
+    def _read_wire_frame(self) -> Frame:
         while True:
             location = self.buffer.find(MAGIC)
             if location >= 0:
@@ -137,28 +597,16 @@ class FrameReader:
         if version != PROTOCOL_VERSION:
             del self.buffer[0]
             raise ValueError(f"unsupported protocol version {version}")
-        if payload_type not in PAYLOAD_BYTES:
+        try:
+            check_header_shape(payload_type, sample_count, payload_bytes)
+        except ValueError:
             del self.buffer[0]
-            raise ValueError(f"invalid payload type {payload_type}")
-        if sample_count != SAMPLE_COUNT:
-            del self.buffer[0]
-            raise ValueError(f"invalid sample count {sample_count}")
-        if payload_bytes != PAYLOAD_BYTES[payload_type]:
-            del self.buffer[0]
-            raise ValueError(
-                f"invalid {PAYLOAD_NAMES[payload_type]} payload size {payload_bytes}"
-            )
+            raise
 
         frame_size = HEADER.size + payload_bytes
         self._fill(frame_size)
         payload = bytes(self.buffer[HEADER.size:frame_size])
         del self.buffer[:frame_size]
-        actual_crc = zlib.crc32(payload) & 0xFFFFFFFF
-        if actual_crc != payload_crc32:
-            raise ValueError(
-                f"CRC mismatch: header={payload_crc32:08x} actual={actual_crc:08x}"
-            )
-
         header = FrameHeader(
             version=version,
             payload_type=payload_type,
@@ -177,9 +625,270 @@ class FrameReader:
             dropped_frames=dropped_frames,
             payload_crc32=payload_crc32,
         )
+        actual_crc = zlib.crc32(payload) & 0xFFFFFFFF
+        if actual_crc != payload_crc32:
+            raise CrcError(
+                f"CRC mismatch: header={payload_crc32:08x} actual={actual_crc:08x}",
+                header,
+            )
         return Frame(header, payload)
 
 
+class ByteRing:
+    """Bounded byte FIFO between the port reader thread and FrameReader.
+
+    It offers the read()/in_waiting subset of a serial port that FrameReader
+    uses; read() waits up to `timeout` for data like the port itself.
+    """
+
+    def __init__(self, capacity: int, timeout: float):
+        self.capacity = capacity
+        self.timeout = timeout
+        self.buffer = bytearray()
+        self.condition = threading.Condition()
+        self.error: BaseException | None = None
+        self.closed = False
+        self.high_water = 0
+        self.full_waits = 0
+
+    @property
+    def in_waiting(self) -> int:
+        return len(self.buffer)
+
+    def write(self, data: bytes) -> None:
+        """Append data, waiting while the ring is full; after close() the
+        data is dropped instead, so a writer never outlives its reader."""
+        with self.condition:
+            if len(self.buffer) + len(data) > self.capacity:
+                self.full_waits += 1
+                self.condition.wait_for(
+                    lambda: self.closed
+                    or len(self.buffer) + len(data) <= self.capacity
+                )
+            if self.closed:
+                return
+            self.buffer.extend(data)
+            self.high_water = max(self.high_water, len(self.buffer))
+            self.condition.notify_all()
+
+    def fail(self, error: BaseException) -> None:
+        with self.condition:
+            self.error = error
+            self.condition.notify_all()
+
+    def close(self) -> None:
+        """Release a write() waiting for space that will never come."""
+        with self.condition:
+            self.closed = True
+            self.condition.notify_all()
+
+    def read(self, size: int) -> bytes:
+        with self.condition:
+            self.condition.wait_for(
+                lambda: self.buffer or self.error is not None, self.timeout
+            )
+            if not self.buffer and self.error is not None:
+                raise self.error
+            chunk = bytes(self.buffer[:size])
+            del self.buffer[:size]
+            self.condition.notify_all()
+            return chunk
+
+
+class PortReader(threading.Thread):
+    """Drains a serial port or vendor stream into a ByteRing.
+
+    Nothing else runs on this thread, so console and disk stalls no longer
+    leave data sitting in the CDC buffer.  The source must have a short
+    read timeout for stop() to return promptly.
+    """
+
+    def __init__(self, source: BinaryIO, ring: ByteRing, read_size: int):
+        super().__init__(name="port-reader", daemon=True)
+        self.source = source
+        self.ring = ring
+        self.read_size = read_size
+        self.stopping = threading.Event()
+        self.bytes_read = 0
+
+    def run(self) -> None:
+        try:
+            while not self.stopping.is_set():
+                waiting = int(getattr(self.source, "in_waiting", 0) or 0)
+                chunk = self.source.read(max(1, min(self.read_size, waiting)))
+                if chunk:
+                    self.bytes_read += len(chunk)
+                    self.ring.write(chunk)
+        except Exception as error:
+            self.ring.fail(error)
+            return
+        self.ring.fail(EOFError("port reader stopped"))
+
+    def stop(self) -> None:
+        self.stopping.set()
+        cancel_read = getattr(self.source, "cancel_read", None)
+        if cancel_read is not None:
+            cancel_read()
+        # Nothing reads the ring any more; a write blocked on it must end.
+        self.ring.close()
+        self.join(CAPTURE_STOP_S)
+
+
+class FrameConsumer(threading.Thread):
+    """Runs handle() for each frame on its own thread.
+
+    A lossless consumer makes put() wait for queue space; a lossy one drops
+    the frame and counts it, so a slow console never holds up the capture.
+    """
+
+    def __init__(self, name: str, depth: int, lossless: bool):
+        super().__init__(name=name, daemon=True)
+        self.queue: queue.Queue[Frame | None] = queue.Queue(depth)
+        self.lossless = lossless
+        self.skipped = 0
+        self.high_water = 0
+        self.error: BaseException | None = None
+
+    def put(self, frame: Frame) -> None:
+        if self.error is not None:
+            raise RuntimeError(f"{self.name} failed") from self.error
+        if self.lossless:
+            self.queue.put(frame)
+        else:
+            try:
+                self.queue.put_nowait(frame)
+            except queue.Full:
+                self.skipped += 1
+        self.high_water = max(self.high_water, self.queue.qsize())
+
+    def finish(self) -> None:
+        self.queue.put(None)
+        self.join()
+        if self.error is not None:
+            raise RuntimeError(f"{self.name} failed") from self.error
+
+    def run(self) -> None:
+        try:
+            while (frame := self.queue.get()) is not None:
+                self.handle(frame)
+        except Exception as error:
+            self.error = error
+            # Keep draining so a lossless producer cannot block forever.
+            while self.queue.get() is not None:
+                pass
+
+    def handle(self, frame: Frame) -> None:
+        raise NotImplementedError
+
+
+class DiskConsumer(FrameConsumer):
+    def __init__(self, writer: "CaptureWriter"):
+        super().__init__("disk", CAPTURE_DISK_QUEUE, lossless=True)
+        self.writer = writer
+
+    def handle(self, frame: Frame) -> None:
+        self.writer.append(frame)
+
+
+class ConsoleConsumer(FrameConsumer):
+    """Prints a line per frame and, every second, the pipeline statistics."""
+
+    def __init__(self, frame_count: int, stats: Callable[[], str]):
+        super().__init__("console", CAPTURE_CONSOLE_QUEUE, lossless=False)
+        self.frame_count = frame_count
+        self.stats = stats
+        self.printed = 0
+        self.next_stats = time.monotonic() + CAPTURE_STATS_INTERVAL_S
+
+    def handle(self, frame: Frame) -> None:
+        self.printed += 1
+        print(
+            f"{self.printed + self.skipped}/{self.frame_count}: "
+            f"seq={frame.header.sequence} "
+            f"type={frame.header.payload_name} flags=0x{frame.header.flags:04x} "
+            f"bytes={frame.header.payload_bytes} "
+            f"drops={frame.header.dropped_frames} "
+            f"peak={frame.header.envelope_peak:.5g}"
+        )
+        now = time.monotonic()
+        if now >= self.next_stats:
+            self.next_stats = now + CAPTURE_STATS_INTERVAL_S
+            print(self.stats())
+
+
+def decode_telemetry(frame: Frame) -> dict[str, object]:
+    """Unpack a telemetry frame into per-stage histograms and counters.
+
+    Bucket k of each histogram counts latencies of 2**(k-1) .. 2**k - 1 us;
+    bucket 0 counts zero and the last bucket also absorbs longer ones.
+    """
+    if frame.header.payload_type != PAYLOAD_TELEMETRY:
+        raise ValueError("not a telemetry frame")
+    words = frame.samples()
+    stages: dict[str, object] = {}
+    stride = 3 + TELEMETRY_BUCKETS
+    for index, name in enumerate(TELEMETRY_STAGES):
+        record = words[index * stride:(index + 1) * stride]
+        stages[name] = {
+            "count": int(record[0]),
+            "last_us": int(record[1]),
+            "max_us": int(record[2]),
+            "buckets": [int(value) for value in record[3:]],
+        }
+    tail = words[len(TELEMETRY_STAGES) * stride:]
+    return {
+        "stages": stages,
+        "jobs_high_water": int(tail[0]),
+        "ready_high_water": int(tail[1]),
+        "processing_drops": int(tail[2]),
+        "usb_drops": int(tail[3]),
+    }
+
+
+def telemetry_percentile_us(buckets: list[int], fraction: float) -> int:
+    """Upper bucket edge holding the requested rank of a stage histogram."""
+    total = sum(buckets)
+    if total == 0:
+        return 0
+    rank = max(1, int(np.ceil(total * fraction)))
+    seen = 0
+    for index, count in enumerate(buckets):
+        seen += count
+        if seen >= rank:
+            return 0 if index == 0 else (1 << index) - 1
+    return (1 << (len(buckets) - 1)) - 1
+
+
+def request_telemetry(port: BinaryIO, reader: "FrameReader") -> dict[str, object]:
+    """Ask for a telemetry frame, skipping any data frames still arriving."""
+    response = reader.request(port, "stats frame")
+    if response.startswith("ERR"):
+        raise RuntimeError(response)
+    while True:
+        frame = reader.read_frame()
+        if frame.header.payload_type == PAYLOAD_TELEMETRY:
+            return decode_telemetry(frame)
+
+
+def print_telemetry(telemetry: dict[str, object]) -> None:
+    stages = telemetry["stages"]
+    assert isinstance(stages, dict)
+    for name in TELEMETRY_STAGES:
+        stage = stages[name]
+        p50 = min(telemetry_percentile_us(stage["buckets"], 0.5), stage["max_us"])
+        p99 = min(telemetry_percentile_us(stage["buckets"], 0.99), stage["max_us"])
+        print(
+            f"{name:12s} n={stage['count']} p50<={p50}us p99<={p99}us "
+            f"max={stage['max_us']}us"
+        )
+    print(
+        f"jobs_hwm={telemetry['jobs_high_water']} "
+        f"ready_hwm={telemetry['ready_high_water']} "
+        f"processing_drops={telemetry['processing_drops']} "
+        f"usb_drops={telemetry['usb_drops']}"
+    )
+
+
 def alaw_encode(envelope: np.ndarray, reference: float) -> np.ndarray:
     """Positive-envelope A-law reference encoder (A=87.6)."""
     if not np.isfinite(reference) or reference <= 0:
@@ -222,13 +931,17 @@ def check_sequences(frames: Iterable[Frame]) -> None:
 
 
 def save_frames(
-    frames: list[Frame], output: Path, final_status: str | None = None
+    frames: Iterable[Frame], output: Path, final_status: str | None = None
 ) -> None:
     output.mkdir(parents=True, exist_ok=True)
     metadata: list[dict[str, object]] = []
     grouped: dict[int, list[Frame]] = {}
     for frame in frames:
-        grouped.setdefault(frame.header.payload_type, []).append(frame)
+        # Compressed and fallback raw frames of one stream share raw.npy.
+        payload_type = frame.header.payload_type
+        if payload_type == PAYLOAD_RAW_RICE:
+            payload_type = 1
+        grouped.setdefault(payload_type, []).append(frame)
 
     for payload_type, group in grouped.items():
         payload_name = PAYLOAD_NAMES[payload_type]
@@ -364,13 +1077,22 @@ def run(args: argparse.Namespace) -> int:
         # Prevent ModemManager or a second terminal from sharing ttyACM while
         # a binary frame sequence is active.
         serial_options["exclusive"] = True
+    from capture_file import CaptureFile, CaptureWriter, convert_npy
+
     port = serial.Serial(
         args.port, 115200, timeout=args.timeout, **serial_options
     )
+    bulk = None
+    capture = None
+    port_reader = None
     try:
         # Assert the conventional CDC terminal state and let Linux complete
-        # its ACM control requests before sending the first command.
-        port.dtr = True
+        # its ACM control requests before sending the first command.  The
+        # simulator's pseudo-terminal has no modem lines.
+        try:
+            port.dtr = True
+        except OSError:
+            pass
         time.sleep(0.2)
         port.reset_input_buffer()
         port.reset_output_buffer()
@@ -385,12 +1107,36 @@ def run(args: argparse.Namespace) -> int:
                 "included with this tool"
             )
 
+        if args.data == "vendor":
+            port.write(b"data vendor\n")
+            port.flush()
+            response = read_response_line(port)
+            print(response)
+            if response.startswith("ERR"):
+                return 2
+            from usb_vendor import BULK_READ_SIZE, VendorBulkStream
+
+            bulk = VendorBulkStream(args.timeout)
+            bulk.drain()
+
         if args.selftest:
             command = "dsp selftest"
             frame_count = len(SELFTEST_NAMES) * 3
             streaming = False
+        elif args.credits:
+            # Credit mode never grants more frames than will be read, so the
+            # device stops on its own and nothing is dropped on either side.
+            rate = args.rate if args.rate else "max"
+            granted = min(args.credits, args.frames)
+            command = f"stream start {args.mode} {rate} credit {granted}"
+            if args.batch > 1:
+                command += f" batch {args.batch}"
+            frame_count = args.frames
+            streaming = True
         elif args.rate:
             command = f"stream start {args.mode} {args.rate}"
+            if args.batch > 1:
+                command += f" batch {args.batch}"
             frame_count = args.frames
             streaming = True
         else:
@@ -398,26 +1144,88 @@ def run(args: argparse.Namespace) -> int:
             frame_count = args.frames
             streaming = False
 
-        port.write((command + "\n").encode("ascii"))
-        port.flush()
-        response = read_response_line(port)
+        recover = None if args.no_resend else port
+        # A dedicated thread drains the data channel into a ring that
+        # FrameReader parses on this thread; frames then go to separate
+        # disk and console consumers, so neither can stall the port.
+        ring = ByteRing(CAPTURE_RING_BYTES, args.timeout)
+        if bulk is not None:
+            bulk.timeout_ms = int(CAPTURE_POLL_S * 1000)
+            port_reader = PortReader(bulk, ring, BULK_READ_SIZE)
+        else:
+            port.timeout = CAPTURE_POLL_S
+            port_reader = PortReader(port, ring, 4096)
+        port_reader.start()
+        reader = FrameReader(ring, recover=recover)
+        # The reply comes back as a response frame ahead of the data, so no
+        # text can be confused with the binary stream that follows.
+        response = reader.request(port, command)
         print(response)
         if response.startswith("ERR"):
             return 2
 
-        reader = FrameReader(port)
-        frames: list[Frame] = []
-        for index in range(frame_count):
-            frame = reader.read_frame()
-            frames.append(frame)
-            print(
-                f"{index + 1}/{frame_count}: seq={frame.header.sequence} "
-                f"type={frame.header.payload_name} flags=0x{frame.header.flags:04x} "
-                f"drops={frame.header.dropped_frames} "
-                f"peak={frame.header.envelope_peak:.5g}"
+        # Frames go to disk as they arrive; everything after the capture
+        # reads them back from the file.
+        args.output.mkdir(parents=True, exist_ok=True)
+        capture_path = args.output / CAPTURE_FILE_NAME
+        received = 0
+        last_frame: Frame | None = None
+
+        def pipeline_stats() -> str:
+            drops = last_frame.header.dropped_frames if last_frame else 0
+            return (
+                f"stats: frames={received}/{frame_count} device_drops={drops} "
+                f"recovered={reader.frames_recovered} lost={reader.frames_lost} "
+                f"crc_errors={reader.crc_errors} "
+                f"ring={ring.in_waiting >> 10}/{ring.high_water >> 10} KiB "
+                f"ring_full={ring.full_waits} "
+                f"disk_queue={disk.queue.qsize()}/{disk.high_water} "
+                f"console_skipped={console.skipped}"
             )
 
-        check_sequences(frames)
+        with CaptureWriter(capture_path) as writer:
+            disk = DiskConsumer(writer)
+            console = ConsoleConsumer(frame_count, pipeline_stats)
+            disk.start()
+            console.start()
+            try:
+                while received < frame_count:
+                    last_frame = reader.read_frame()
+                    received += 1
+                    disk.put(last_frame)
+                    console.put(last_frame)
+                    if streaming and args.credits and granted < frame_count:
+                        outstanding = granted - received
+                        if outstanding <= args.credits // 2:
+                            grant = min(
+                                args.credits - outstanding, frame_count - granted
+                            )
+                            port.write(f"credit {grant}\n".encode("ascii"))
+                            port.flush()
+                            granted += grant
+            finally:
+                console.finish()
+                disk.finish()
+        print(pipeline_stats())
+        capture = CaptureFile(capture_path)
+
+        if reader.superframes:
+            print(f"unpacked {len(capture)} frames from {reader.superframes} superframes")
+        if reader.crc_errors or reader.frames_recovered or reader.frames_lost:
+            print(
+                f"resend: recovered={reader.frames_recovered} "
+                f"lost={reader.frames_lost} crc_errors={reader.crc_errors}"
+            )
+        check_sequences(capture.frames())
+        telemetry = None
+        if args.telemetry:
+            # Requested while a stream is still running so the histograms
+            # describe the stream itself.
+            telemetry = request_telemetry(port, reader)
+            print_telemetry(telemetry)
+        port_reader.stop()
+        port_reader = None
+        port.timeout = args.timeout
         final_status = None
         if streaming:
             port.write(b"stream stop\n")
@@ -426,16 +1234,28 @@ def run(args: argparse.Namespace) -> int:
             # obtain the firmware's accumulated timing/drop counters.
             time.sleep(0.25)
             port.reset_input_buffer()
+            if bulk is not None:
+                bulk.drain()
             port.write(b"status\n")
             port.flush()
             final_status = read_response_line(port)
             print(final_status)
 
-        save_frames(frames, args.output, final_status)
+        convert_npy(capture, args.output, final_status)
+        if telemetry is not None:
+            (args.output / "telemetry.json").write_text(
+                json.dumps(telemetry, indent=2), encoding="utf-8"
+            )
         if args.selftest:
-            validate_selftest(frames)
+            validate_selftest(list(capture.frames()))
         return 0
     finally:
+        if port_reader is not None:
+            port_reader.stop()
+        if capture is not None:
+            capture.close()
+        if bulk is not None:
+            bulk.close()
         port.close()
 
 
@@ -443,19 +1263,59 @@ def parse_args(argv: list[str]) -> argparse.Namespace:
     parser = argparse.ArgumentParser(description=__doc__)
     parser.add_argument("--port", required=True, help="CDC serial port, e.g. COM7")
     parser.add_argument(
-        "--mode", choices=("raw", "envelope", "alaw"), default="alaw"
+        "--mode",
+        choices=(
+            "raw",
+            "rawz",
+            "envelope",
+            "envelope-f16",
+            "envelope-u16",
+            "sparse",
+            "alaw",
+        ),
+        default="alaw",
     )
     parser.add_argument(
         "--rate", type=int, default=0, help="stream rate; 0 requests one-shot"
     )
     parser.add_argument("--frames", type=int, default=1)
+    parser.add_argument(
+        "--data",
+        choices=("cdc", "vendor"),
+        default="cdc",
+        help="carry binary frames on the CDC port or the vendor bulk "
+        "interface (needs pyusb)",
+    )
+    parser.add_argument(
+        "--credits",
+        type=int,
+        default=0,
+        help="stream with N frames of credit outstanding (no drops); "
+        "--rate 0 then means as fast as the device can go",
+    )
+    parser.add_argument(
+        "--batch",
+        type=int,
+        default=1,
+        help="pack up to N stream frames into each USB superframe",
+    )
     parser.add_argument(
         "--timeout",
         type=float,
         default=30.0,
         help="per-read timeout in seconds (default: 30 for the self-test)",
     )
+    parser.add_argument(
+        "--no-resend",
+        action="store_true",
+        help="do not ask the device to resend corrupted or missing frames",
+    )
     parser.add_argument("--output", type=Path, default=Path("captures"))
+    parser.add_argument(
+        "--telemetry",
+        action="store_true",
+        help="request the pipeline latency histograms after capturing",
+    )
     parser.add_argument(
         "--selftest",
         action="store_true",
@@ -466,6 +1326,10 @@ def parse_args(argv: list[str]) -> argparse.Namespace:
         parser.error("--frames must be positive")
     if args.rate < 0:
         parser.error("--rate cannot be negative")
+    if args.credits < 0:
+        parser.error("--credits cannot be negative")
+    if not 1 <= args.batch <= 16:
+        parser.error("--batch must be between 1 and 16")
     if args.timeout <= 0:
         parser.error("--timeout must be positive")
     return args
@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+"""Measure pic0rick USB transport throughput and latency with "bench usb".
+
+The firmware sends COUNT synthetic frames of BYTES payload back to back
+through its normal transmit path.  This tool reports sustained MB/s, the
+one-way latency distribution (host arrival minus device send time, relative
+to the fastest frame), inter-arrival gaps, stalls and drops:
+
+    python tools/usb_bench.py --port COM7 --bytes 8192 --count 2000
+
+``--pty`` runs the same measurement against an in-process stand-in device on
+a pseudo-terminal (Linux/macOS), so the host half can be checked without a
+board; it can pace the link and inject stalls and drops.
+"""
+
+from __future__ import annotations
+
+import argparse
+import os
+import re
+import sys
+import threading
+import time
+
+import numpy as np
+
+from pic0rick_capture import (
+    HEADER,
+    PAYLOAD_BENCH,
+    PAYLOAD_RESPONSE,
+    FrameReader,
+    read_response_line,
+)
+from usb_vendor import BULK_READ_SIZE, VendorBulkStream, encode_frame
+
+# Firmware U4RK_USB_TX_STALL_TIMEOUT_US: a transfer making no progress for
+# this long is abandoned and counted as failed.
+FIRMWARE_STALL_MS = 2000.0
+MAX_PAYLOAD_BYTES = 16384
+MAX_FRAMES = 1_000_000
+
+
+class PtyStandIn:
+    """Answers "bench usb" on a pty the way the firmware does.
+
+    Frames leave at ``link_mbps``; every ``drop_every``-th frame is counted
+    as a failed transfer and not sent, and every ``stall_every``-th frame is
+    held back for ``stall_ms`` first.
+    """
+
+    def __init__(self, link_mbps: float, drop_every: int, stall_every: int,
+                 stall_ms: float):
+        import tty
+
+        self.master, slave = os.openpty()
+        tty.setraw(slave)
+        self.path = os.ttyname(slave)
+        self.slave = slave
+        self.link_mbps = link_mbps
+        self.drop_every = drop_every
+        self.stall_every = stall_every
+        self.stall_ms = stall_ms
+        self.thread = threading.Thread(target=self._serve, daemon=True)
+        self.thread.start()
+
+    def close(self) -> None:
+        os.close(self.master)
+        os.close(self.slave)
+
+    def _reply(self, request_id: int | None, text: str) -> None:
+        if request_id is None:
+            os.write(self.master, (text + "\r\n").encode("ascii"))
+        else:
+            os.write(self.master, encode_frame(
+                PAYLOAD_RESPONSE, request_id, text.encode("ascii"),
+                sample_count=0))
+
+    def _serve(self) -> None:
+        line = b""
+        while True:
+            try:
+                chunk = os.read(self.master, 256)
+            except OSError:
+                return
+            line += chunk
+            while b"\n" in line:
+                text, line = line.split(b"\n", 1)
+                self._command(text.decode("ascii", errors="replace").strip())
+
+    def _command(self, text: str) -> None:
+        request_id = None
+        match = re.fullmatch(r"@(\d+) (.*)", text)
+        if match:
+            request_id, text = int(match.group(1)), match.group(2)
+        match = re.fullmatch(r"bench usb (\d+) (\d+)", text)
+        if not match:
+            self._reply(request_id, "ERR COMMAND unknown command")
+            return
+        size, count = int(match.group(1)), int(match.group(2))
+        self._reply(request_id, f"OK bench usb bytes={size} count={count} data=pty")
+        payload = bytes(i & 0xFF for i in range(size))
+        frame_seconds = (HEADER.size + size) / (self.link_mbps * 1e6)
+        failed = sent = 0
+        started = time.monotonic()
+        deadline = started
+        max_tx_us = 0
+        for sequence in range(count):
+            if self.stall_every and sequence % self.stall_every == self.stall_every - 1:
+                time.sleep(self.stall_ms / 1000)
+                deadline = time.monotonic()
+            if self.drop_every and sequence % self.drop_every == self.drop_every - 1:
+                failed += 1
+                continue
+            tx_started = time.monotonic()
+            frame = encode_frame(
+                PAYLOAD_BENCH, sequence, payload, sample_count=0,
+                timestamp_us=time.monotonic_ns() // 1000,
+            )
+            os.write(self.master, frame)
+            deadline += frame_seconds
+            delay = deadline - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            max_tx_us = max(max_tx_us, int((time.monotonic() - tx_started) * 1e6))
+            sent += 1
+        elapsed_us = int((time.monotonic() - started) * 1e6)
+        total = sent * (HEADER.size + size)
+        self._reply(
+            request_id,
+            f"OK bench done frames={sent} failed={failed} bytes={total} "
+            f"elapsed_us={elapsed_us} "
+            f"kb_per_s={total * 1000 // max(elapsed_us, 1)} max_tx_us={max_tx_us}",
+        )
+
+
+def percentiles(values: np.ndarray) -> str:
+    if values.size == 0:
+        return "n/a"
+    p50, p90, p99 = np.percentile(values, (50, 90, 99))
+    return f"p50={p50:.0f} p90={p90:.0f} p99={p99:.0f} max={values.max():.0f}"
+
+
+def measure(port, reader: FrameReader, size: int, count: int,
+            stall_ms: float) -> dict[str, object]:
+    request_id = reader.send_request(port, f"bench usb {size} {count}")
+    response = reader.read_response(request_id)
+    print(response)
+    if response.startswith("ERR"):
+        raise RuntimeError(response)
+
+    arrivals: list[int] = []
+    device_us: list[int] = []
+    sequences: list[int] = []
+    while True:
+        item = reader.read_frame_or_response(request_id)
+        if isinstance(item, str):
+            summary = item
+            break
+        if item.header.payload_type != PAYLOAD_BENCH:
+            continue
+        arrivals.append(time.perf_counter_ns() // 1000)
+        device_us.append(item.header.capture_timestamp_us)
+        sequences.append(item.header.sequence)
+    print(summary)
+
+    received = len(sequences)
+    fields = dict(re.findall(r"(\w+)=(\d+)", summary))
+    device_failed = int(fields.get("failed", 0))
+    missing = count - received
+    result: dict[str, object] = {
+        "frames": received,
+        "missing": missing,
+        "device_failed": device_failed,
+        "out_of_order": int(np.count_nonzero(np.diff(sequences) <= 0))
+        if received > 1 else 0,
+    }
+    if received < 2:
+        return result
+
+    host = np.asarray(arrivals, dtype=np.int64)
+    device = np.asarray(device_us, dtype=np.int64)
+    span_s = (host[-1] - host[0]) / 1e6
+    # The first frame's bytes arrived before the span starts.
+    frame_bytes = HEADER.size + size
+    result["mb_per_s"] = (received - 1) * frame_bytes / span_s / 1e6
+    delay = host - device
+    result["latency_us"] = delay - delay.min()
+    gaps = np.diff(host)
+    result["gap_us"] = gaps
+    result["stalls"] = int(np.count_nonzero(gaps >= stall_ms * 1000))
+    result["device_kb_per_s"] = int(fields.get("kb_per_s", 0))
+    result["device_max_tx_us"] = int(fields.get("max_tx_us", 0))
+    return result
+
+
+def report(result: dict[str, object], stall_ms: float) -> None:
+    print(
+        f"frames={result['frames']} missing={result['missing']} "
+        f"device_failed={result['device_failed']} "
+        f"out_of_order={result['out_of_order']}"
+    )
+    if "mb_per_s" not in result:
+        return
+    print(
+        f"throughput host={result['mb_per_s']:.3f} MB/s "
+        f"device={result['device_kb_per_s'] / 1000:.3f} MB/s "
+        f"device_max_tx_us={result['device_max_tx_us']}"
+    )
+    print(f"latency_us {percentiles(result['latency_us'])}")
+    print(f"gap_us     {percentiles(result['gap_us'])}")
+    print(f"stalls>={stall_ms:g}ms {result['stalls']}")
+
+
+def run(args: argparse.Namespace) -> int:
+    import serial
+
+    standin = None
+    bulk = None
+    path = args.port
+    if args.pty:
+        standin = PtyStandIn(args.link_mbps, args.inject_drop, args.inject_stall,
+                             args.stall_ms * 1.5)
+        path = standin.path
+    port = serial.Serial(path, 115200, timeout=args.timeout)
+    try:
+        if not args.pty:
+            # The simulator's pseudo-terminal has no modem lines.
+            try:
+                port.dtr = True
+            except OSError:
+                pass
+            time.sleep(0.2)
+            port.reset_input_buffer()
+        if args.data == "vendor":
+            # Answered in text on CDC; later replies follow the frames.
+            port.write(b"data vendor\n")
+            port.flush()
+            response = read_response_line(port)
+            if response.startswith("ERR"):
+                raise RuntimeError(response)
+            bulk = VendorBulkStream(args.timeout)
+            bulk.drain()
+            reader = FrameReader(bulk, read_size=BULK_READ_SIZE)
+        else:
+            reader = FrameReader(port, read_size=BULK_READ_SIZE)
+        result = measure(port, reader, args.bytes, args.count, args.stall_ms)
+        report(result, args.stall_ms)
+        return 0
+    finally:
+        if bulk is not None:
+            bulk.close()
+        port.close()
+        if standin is not None:
+            standin.close()
+
+
+def parse_args(argv: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+    )
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--port", help="CDC serial port, e.g. COM7")
+    target.add_argument(
+        "--pty", action="store_true", help="measure an in-process stand-in"
+    )
+    parser.add_argument("--bytes", type=int, default=8192, help="payload bytes")
+    parser.add_argument("--count", type=int, default=1000)
+    parser.add_argument("--data", choices=("cdc", "vendor"), default="cdc")
+    parser.add_argument(
+        "--stall-ms",
+        type=float,
+        default=FIRMWARE_STALL_MS,
+        help="gap counted as a stall (default: the firmware's TX timeout)",
+    )
+    parser.add_argument("--timeout", type=float, default=5.0)
+    standin = parser.add_argument_group("pty stand-in")
+    standin.add_argument("--link-mbps", type=float, default=1.0)
+    standin.add_argument("--inject-drop", type=int, default=0, metavar="N",
+                         help="fail every Nth frame")
+    standin.add_argument("--inject-stall", type=int, default=0, metavar="N",
+                         help="stall before every Nth frame")
+    args = parser.parse_args(argv)
+    if not 1 <= args.bytes <= MAX_PAYLOAD_BYTES:
+        parser.error(f"--bytes must be 1..{MAX_PAYLOAD_BYTES}")
+    if not 1 <= args.count <= MAX_FRAMES:
+        parser.error(f"--count must be 1..{MAX_FRAMES}")
+    if args.pty and args.data != "cdc":
+        parser.error("the pty stand-in only models the CDC channel")
+    if args.link_mbps <= 0 or args.stall_ms <= 0:
+        parser.error("--link-mbps and --stall-ms must be positive")
+    return args
+
+
+if __name__ == "__main__":
+    try:
+        raise SystemExit(run(parse_args(sys.argv[1:])))
+    except (RuntimeError, TimeoutError, ValueError) as error:
+        print(f"ERROR: {error}", file=sys.stderr)
+        raise SystemExit(1)
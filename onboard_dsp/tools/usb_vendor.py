@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""Read pic0rick binary frames from the vendor bulk interface.
+
+After ``data vendor`` on the CDC port the firmware sends every binary frame on
+the vendor bulk IN endpoint while CDC carries only commands and responses.
+``VendorBulkStream`` wraps that endpoint (via pyusb) in the small ``read`` /
+``in_waiting`` interface FrameReader expects.  ``LoopbackBulkStream`` serves
+the same byte stream from memory so the reader can be exercised, and its
+throughput measured, without a board:
+
+    python tools/usb_vendor.py --loopback --frames 2000 --mode raw
+"""
+
+from __future__ import annotations
+
+import argparse
+import sys
+import time
+import zlib
+
+import numpy as np
+
+from pic0rick_capture import (
+    HEADER,
+    MAGIC,
+    PAYLOAD_NAMES,
+    PROTOCOL_VERSION,
+    SAMPLE_COUNT,
+    FrameReader,
+)
+
+USB_VID = 0xCAFE
+USB_PID = 0x4011
+VENDOR_CLASS = 0xFF
+# Each libusb bulk request spans many 64-byte packets; the device queues
+# 2 KB transfers, so 64 KB keeps several of them in one host call.
+BULK_READ_SIZE = 65536
+DEVICE_TRANSFER_SIZE = 2048
+PAYLOAD_TYPES = {name: value for value, name in PAYLOAD_NAMES.items()}
+
+
+class VendorBulkStream:
+    """Byte stream over the vendor bulk IN endpoint."""
+
+    def __init__(self, timeout: float, vid: int = USB_VID, pid: int = USB_PID):
+        try:
+            import usb.core
+            import usb.util
+        except ImportError as exc:
+            raise RuntimeError(
+                "pyusb is required for --data vendor; install "
+                "tools/requirements.txt"
+            ) from exc
+
+        self._usb_core = usb.core
+        self._usb_util = usb.util
+        self.device = usb.core.find(idVendor=vid, idProduct=pid)
+        if self.device is None:
+            raise RuntimeError(f"no USB device {vid:04x}:{pid:04x}")
+        interface = usb.util.find_descriptor(
+            self.device.get_active_configuration(),
+            bInterfaceClass=VENDOR_CLASS,
+        )
+        if interface is None:
+            raise RuntimeError("firmware has no vendor interface; reflash")
+        self.interface = interface.bInterfaceNumber
+        endpoint = usb.util.find_descriptor(
+            interface,
+            custom_match=lambda ep: usb.util.endpoint_direction(
+                ep.bEndpointAddress
+            )
+            == usb.util.ENDPOINT_IN,
+        )
+        if endpoint is None:
+            raise RuntimeError("vendor interface has no IN endpoint")
+        usb.util.claim_interface(self.device, self.interface)
+        self.endpoint = endpoint.bEndpointAddress
+        self.timeout_ms = max(1, int(timeout * 1000))
+        self.buffer = bytearray()
+
+    @property
+    def in_waiting(self) -> int:
+        return len(self.buffer)
+
+    def read(self, size: int) -> bytes:
+        if not self.buffer:
+            try:
+                data = self.device.read(
+                    self.endpoint, BULK_READ_SIZE, timeout=self.timeout_ms
+                )
+            except self._usb_core.USBTimeoutError:
+                return b""
+            self.buffer.extend(data)
+        chunk = bytes(self.buffer[:size])
+        del self.buffer[:size]
+        return chunk
+
+    def drain(self) -> None:
+        """Discard frames still queued on the endpoint after a stream stop."""
+        self.buffer.clear()
+        while True:
+            try:
+                self.device.read(self.endpoint, BULK_READ_SIZE, timeout=50)
+            except self._usb_core.USBTimeoutError:
+                return
+
+    def close(self) -> None:
+        self._usb_util.release_interface(self.device, self.interface)
+        self._usb_util.dispose_resources(self.device)
+
+
+def encode_frame(
+    payload_type: int,
+    sequence: int,
+    payload: bytes,
+    sample_count: int = SAMPLE_COUNT,
+    timestamp_us: int = 0,
+) -> bytes:
+    """Build a wire frame the way protocol.c does."""
+    header = HEADER.pack(
+        MAGIC,
+        PROTOCOL_VERSION,
+        payload_type,
+        0,
+        sequence,
+        sample_count,
+        60_000_000,
+        len(payload),
+        timestamp_us,
+        512.0,
+        0.0,
+        2048.0,
+        0,
+        0,
+        0,
+        0,
+        zlib.crc32(payload),
+    )
+    return header + payload
+
+
+class LoopbackBulkStream:
+    """In-memory stand-in for the vendor endpoint.
+
+    Bytes are delivered in device-sized transfers, so reads end on arbitrary
+    frame boundaries just like real bulk traffic.
+    """
+
+    def __init__(self, frames: list[bytes], transfer_size: int = DEVICE_TRANSFER_SIZE):
+        self.data = b"".join(frames)
+        self.offset = 0
+        self.transfer_size = transfer_size
+        self.buffer = bytearray()
+
+    @property
+    def in_waiting(self) -> int:
+        return len(self.buffer)
+
+    def read(self, size: int) -> bytes:
+        if not self.buffer:
+            end = min(len(self.data), self.offset + self.transfer_size)
+            self.buffer.extend(self.data[self.offset:end])
+            self.offset = end
+        chunk = bytes(self.buffer[:size])
+        del self.buffer[:size]
+        return chunk
+
+
+def synthetic_payload(mode: str, rng: np.random.Generator) -> tuple[int, bytes]:
+    samples = np.clip(
+        512 + rng.normal(0, 3, SAMPLE_COUNT), 0, 1023
+    ).astype("<u2")
+    if mode == "raw":
+        return PAYLOAD_TYPES["raw"], samples.tobytes()
+    if mode == "envelope":
+        return PAYLOAD_TYPES["envelope"], np.abs(
+            samples.astype("<f4") - 512.0
+        ).tobytes()
+    if mode == "alaw":
+        return PAYLOAD_TYPES["alaw"], (samples & 0xFF).astype("u1").tobytes()
+    raise ValueError(f"loopback does not synthesize {mode}")
+
+
+def run_loopback(args: argparse.Namespace) -> int:
+    rng = np.random.default_rng(1)
+    payloads = [
+        synthetic_payload(args.mode, rng) for _ in range(min(args.frames, 64))
+    ]
+    wire = []
+    for index in range(args.frames):
+        payload_type, payload = payloads[index % len(payloads)]
+        wire.append(encode_frame(payload_type, index, payload))
+    # Interleave some noise between frames to exercise resynchronization.
+    wire[len(wire) // 2] = b"\x00stale" + wire[len(wire) // 2]
+    stream = LoopbackBulkStream(wire)
+    reader = FrameReader(stream, read_size=BULK_READ_SIZE)
+
+    started = time.perf_counter()
+    total = 0
+    for index in range(args.frames):
+        frame = reader.read_frame()
+        if frame.header.sequence != index:
+            raise AssertionError(
+                f"expected sequence {index}, got {frame.header.sequence}"
+            )
+        expected = payloads[index % len(payloads)][1]
+        if frame.payload != expected:
+            raise AssertionError(f"payload mismatch at frame {index}")
+        total += HEADER.size + len(frame.payload)
+    elapsed = time.perf_counter() - started
+    print(
+        f"loopback {args.mode}: {args.frames} frames {total} bytes in "
+        f"{elapsed * 1e3:.1f} ms ({total / elapsed / 1e6:.1f} MB/s, "
+        f"{args.frames / elapsed:.0f} frames/s)"
+    )
+    return 0
+
+
+def parse_args(argv: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+    )
+    parser.add_argument(
+        "--loopback",
+        action="store_true",
+        required=True,
+        help="decode synthetic frames through the bulk reader path",
+    )
+    parser.add_argument("--frames", type=int, default=1000)
+    parser.add_argument(
+        "--mode", choices=("raw", "envelope", "alaw"), default="raw"
+    )
+    args = parser.parse_args(argv)
+    if args.frames < 2:
+        parser.error("--frames must be at least 2")
+    return args
+
+
+if __name__ == "__main__":
+    try:
+        raise SystemExit(run_loopback(parse_args(sys.argv[1:])))
+    except (AssertionError, RuntimeError, ValueError) as error:
+        print(f"ERROR: {error}", file=sys.stderr)
+        raise SystemExit(1)
@@ -1,14 +1,53 @@
 # Main libs
 import os
+import re
 import sys
 import glob
 import time
 import struct
+import zlib
 # Third party
 import serial
 import numpy as np
 
 
+# Block sent by "read bin": magic, uint32 payload length, uint16 samples,
+# CRC-32 of the payload; all little-endian.
+BIN_MAGIC = b"P0RB"
+BIN_MAX_BYTES = 1 << 20
+PROMPT = b"run> "
+# Lines the legacy firmware prints before its prompt once an acquisition
+# or a text dump has finished.
+LEGACY_END_MARKERS = (b"Acquisition ended", b"End of ACQ")
+# Every onboard_dsp text reply is one "OK ..." or "ERR <code> ..." line.
+REPLY_PREFIXES = (b"OK", b"ERR")
+
+# onboard_dsp data frame: 64-byte header, then the payload.
+FRAME_MAGIC = b"P0RK"
+FRAME_HEADER = struct.Struct("<4sBBHIIIIQfffIIIII")
+FRAME_FIELDS = (
+    "magic", "version", "payload_type", "flags", "sequence", "sample_count",
+    "sample_rate_hz", "payload_bytes", "capture_timestamp_us",
+    "adc_dc_mean", "envelope_peak", "alaw_reference", "negative_ns",
+    "damp_ns", "positive_ns", "dropped_frames", "payload_crc32",
+)
+FRAME_MAX_BYTES = 1 << 16
+PAYLOAD_RAW = 1
+# Most frames an onboard_dsp credit stream may have outstanding.
+CREDIT_LIMIT = 65535
+
+LEGACY = "legacy"
+ONBOARD_DSP = "onboard_dsp"
+
+
+class BinaryReadUnsupported(IOError):
+    """The firmware does not know the "read bin" command."""
+
+
+class StreamUnsupported(IOError):
+    """The firmware does not know the "start stream" command."""
+
+
 def _find_port():
     if sys.platform.startswith("win"):
         ports = glob.glob("COM[0-9]*")
@@ -29,8 +68,23 @@ def pprint(ans):
 
 
 class Pic0rick:
+    """Client for both the legacy firmware and the onboard_dsp firmware.
+
+    Commands return as soon as their reply is complete instead of waiting
+    for the serial port to go quiet; `firmware` tells which one answered.
+    """
+
+    def _log(self, ans):
+        if self.verbose:
+            pprint(ans)
+        if self.log:
+            with open(self.log_file, "a") as f:
+                for line in ans:
+                    if line and line != b"":
+                        f.write(line.decode("utf-8", errors="replace"))
 
     def sread(self):
+        """Read until the port stays quiet for one serial timeout."""
         done = False
         ans = []
         while not done:
@@ -38,15 +92,80 @@ class Pic0rick:
             ans.append(res)
             if res == b"":
                 done = True
-        if self.verbose:
-            pprint(ans)
-        if self.log:
-            with open(self.log_file, "a") as f:
-                for line in ans:
-                    if line and line != b"":
-                        f.write(line.decode("utf-8", errors="replace"))
+        self._log(ans)
         return ans
 
+    def _reply_end(self, buf, echo):
+        """Length of the complete reply at the start of `buf`, or None.
+
+        The legacy firmware echoes the command and always ends with its
+        prompt, which also follows "Acquisition ended" and "End of ACQ".
+        onboard_dsp answers with one OK/ERR line; the hex dump of "read"
+        is the line after its OK.
+        """
+        if self.firmware != ONBOARD_DSP and buf.endswith(PROMPT) and echo in buf:
+            return len(buf)
+        if self.firmware == LEGACY:
+            return None
+        start = 0
+        while True:
+            end = buf.find(b"\n", start)
+            if end < 0:
+                return None
+            if buf.startswith(REPLY_PREFIXES, start):
+                if buf.startswith(b"OK raw-hex", start):
+                    end = buf.find(b"\n", end + 1)
+                    if end < 0:
+                        return None
+                return end + 1
+            start = end + 1
+
+    def command(self, text, timeout=3.0):
+        """Send one command line and return its reply as lines.
+
+        Raises:
+            TimeoutError: the reply was not complete after `timeout` s.
+        """
+        echo = text.encode("ascii")
+        self.ser.write(echo + b"\n")
+        buf = self._rx
+        deadline = time.monotonic() + timeout
+        while (end := self._reply_end(buf, echo)) is None:
+            chunk = self.ser.read(self.ser.in_waiting or 1)
+            if chunk:
+                buf += chunk
+            elif time.monotonic() > deadline:
+                raise TimeoutError(f"{text}: no complete reply in {timeout} s")
+        # Bytes past the reply, such as the frame after "acq", are kept.
+        self._rx = buf[end:]
+        ans = bytes(buf[:end]).splitlines(keepends=True)
+        self._log(ans)
+        return ans
+
+    def _take(self, n, deadline):
+        """Return exactly n bytes, starting with those left by command()."""
+        while len(self._rx) < n:
+            chunk = self.ser.read(n - len(self._rx))
+            if chunk:
+                self._rx += chunk
+            elif time.monotonic() > deadline:
+                raise TimeoutError(f"timed out after {len(self._rx)}/{n} bytes")
+        data = bytes(self._rx[:n])
+        del self._rx[:n]
+        return data
+
+    def _identify(self):
+        """Tell the firmwares apart by their answer to "status".
+
+        The legacy firmware reads commands only once its start-up is
+        done, so the reply also replaces a fixed wait after opening.
+        """
+        self.firmware = None
+        ans = self.command("status")
+        if any(line.startswith(REPLY_PREFIXES) for line in ans):
+            return ONBOARD_DSP
+        return LEGACY
+
     def __init__(self, port=None, verbose=True, logging=False, log_file=".log"):
         self.verbose = verbose
         self.log = logging
@@ -58,10 +177,13 @@ class Pic0rick:
 
         self.ser = serial.Serial(port_device, 115200, timeout=0.2)
         self.ser.baudrate = 115200
-        time.sleep(1)  # wait for the serial connection to initialize
-        self.sread()
+        self._rx = bytearray()
+        self.firmware = self._identify()
 
         self.Fech = 60e6  # ADC sampling frequency (Hz)
+        # Cleared once the firmware lacks "read bin"; onboard_dsp has none.
+        self.binary_read = self.firmware == LEGACY
+        self.stream_skipped = 0
 
 
     def dac(self, N):
@@ -70,17 +192,233 @@ class Pic0rick:
         Args:
             N: DAC value (10-bit).
         """
-        self.ser.write(bytearray("write dac " + str(N) + "\n", "ascii"))
-        ans = self.sread()
-        return ans
+        if self.firmware == ONBOARD_DSP:
+            return self.command(f"dac write {int(N)}")
+        return self.command("write dac " + str(N))
     
+    def mux(self, pattern):
+        """Set the 16 MAX14866 switches (write mux); bit n closes switch n."""
+        return self.command(f"write mux {pattern:04x}")
+
+    def mux_table(self, patterns):
+        """Load up to 16 switch patterns (load mux).
+
+        While a table is loaded, `stream` acquires trace n on
+        patterns[n % len(patterns)].  An empty list clears the table.
+        """
+        words = " ".join(f"{p:04x}" for p in patterns) if patterns else "none"
+        return self.command(f"load mux {words}")
+
     def read(self):
-        self.ser.write(bytearray("read\n", "ascii"))
-        ans = self.sread()
-        return ans
+        return self.command("read")
+
+    def _read_exact(self, n):
+        data = self.ser.read(n)
+        if len(data) != n:
+            raise IOError(f"read bin: timed out after {len(data)}/{n} bytes")
+        return data
+
+    def read_bin(self):
+        """Read the last acquisition as one binary block (read bin).
+
+        Returns:
+            uint16 array of 10-bit ADC codes.
+        """
+        self.ser.write(b"read bin\n")
+        # Skip the echoed command line.
+        skipped = self.ser.read_until(BIN_MAGIC, 256)
+        if not skipped.endswith(BIN_MAGIC):
+            reply = skipped + self.ser.read_until(PROMPT)
+            if b"Unknown command: read bin" in reply:
+                raise BinaryReadUnsupported("read bin: not supported")
+            # "Acquisition busy" and the like are not a missing command.
+            lines = [l for l in reply.splitlines()
+                     if l.strip() and l != PROMPT and b"read bin" not in l]
+            text = lines[0].decode("ascii", "replace") if lines else "no reply"
+            raise IOError("read bin: " + text.strip())
+        samples = self._read_block()
+        self.ser.read_until(PROMPT)
+        return samples
+
+    def _read_block(self):
+        """Read the rest of a binary block whose magic was just consumed."""
+        (length,) = struct.unpack("<I", self._read_exact(4))
+        if length % 2 or length > BIN_MAX_BYTES:
+            raise IOError(f"read bin: invalid length {length}")
+        payload = self._read_exact(length)
+        (crc,) = struct.unpack("<I", self._read_exact(4))
+        if zlib.crc32(payload) != crc:
+            raise IOError("read bin: CRC mismatch")
+        return np.frombuffer(payload, dtype="<u2").copy()
+
+    def read_samples(self):
+        """Read the last acquisition as uint16 ADC codes.
+
+        Uses the binary block when the firmware supports it and falls back
+        to parsing the hex text dump of "read" otherwise.
+        """
+        if self.binary_read:
+            try:
+                return self.read_bin()
+            except BinaryReadUnsupported:
+                self.binary_read = False
+        # onboard_dsp answers BUSY until the capture of "start acq" is done.
+        deadline = time.monotonic() + 3.0
+        ans = self.read()
+        while ans[-1].startswith(b"ERR BUSY") and time.monotonic() < deadline:
+            time.sleep(0.002)
+            ans = self.read()
+        for line in ans:
+            if b"," in line:
+                return np.array(
+                    [int(x, 16) for x in line.split(b",") if x.strip()],
+                    dtype=np.uint16,
+                )
+        raise IOError("read: no samples in reply")
+
+    def read_frame(self, timeout=3.0):
+        """Read one onboard_dsp data frame and check its CRC.
+
+        Returns:
+            (header, payload): dict of the 64-byte header fields, bytes.
+        """
+        deadline = time.monotonic() + timeout
+        # Text between frames, if any, is skipped up to the next magic.
+        window = self._take(len(FRAME_MAGIC), deadline)
+        while window != FRAME_MAGIC:
+            window = window[1:] + self._take(1, deadline)
+        values = FRAME_HEADER.unpack(
+            window + self._take(FRAME_HEADER.size - len(window), deadline))
+        header = dict(zip(FRAME_FIELDS, values))
+        if header["payload_bytes"] > FRAME_MAX_BYTES:
+            raise IOError(f"frame: invalid length {header['payload_bytes']}")
+        payload = self._take(header["payload_bytes"], deadline)
+        if zlib.crc32(payload) != header["payload_crc32"]:
+            raise IOError("frame: CRC mismatch")
+        return header, payload
+
+    def acquire_frame(self, payload="raw", timeout=3.0):
+        """Acquire one trace as a binary onboard_dsp frame (acq <payload>).
+
+        Uses the pulse settings of the last `pulse_adc_trigger`, or of
+        command("pulse config ...").
+
+        Returns:
+            (header, samples): header dict, and uint16 ADC codes for "raw"
+            or the payload bytes as uint8 for the other payload types.
+        """
+        if self.firmware != ONBOARD_DSP:
+            raise IOError("acq: binary frames need the onboard_dsp firmware")
+        ans = self.command(f"acq {payload}", timeout)
+        if not ans[-1].startswith(b"OK"):
+            raise IOError(ans[-1].decode("ascii", "replace").strip())
+        header, data = self.read_frame(timeout)
+        if header["payload_type"] == PAYLOAD_RAW:
+            return header, np.frombuffer(data, dtype="<u2").copy()
+        return header, np.frombuffer(data, dtype=np.uint8).copy()
     
+    def stream(self, prf, count, pon: int=200, poff: int=200, damp: int=2000):
+        """Acquire `count` traces at a fixed rate (start stream / stop stream).
+
+        Args:
+            prf: acquisitions per second (1..1000).
+            count: number of traces to return.
+
+        On onboard_dsp this is a raw credit stream of exactly `count`
+        frames ("stream start raw <prf> credit <count>"), so none drop.
+
+        Returns:
+            (count, samples) uint16 array of 10-bit ADC codes.  Shots the
+            firmware could not start on time are counted in
+            `self.stream_skipped`.
+
+        Raises:
+            StreamUnsupported: the legacy firmware predates "start stream".
+        """
+        if self.firmware == ONBOARD_DSP:
+            return self._stream_frames(prf, count, pon, poff, damp)
+        timeout = self.ser.timeout
+        self.ser.timeout = max(timeout, 2.0 / prf + 0.2)
+        try:
+            self.ser.write(bytearray(
+                f"start stream {prf} {pon} {poff} {damp}\n", "ascii"))
+            self.ser.readline()  # echoed command
+            reply = self.ser.readline()
+            if not reply.startswith(b"Stream of"):
+                self.ser.read_until(PROMPT)
+                text = reply.decode("ascii", "replace").strip()
+                if reply.startswith(b"Unknown command"):
+                    raise StreamUnsupported("start stream: " + text)
+                raise IOError("start stream: " + text)
+            traces = []
+            try:
+                while len(traces) < count:
+                    if self._read_exact(4) != BIN_MAGIC:
+                        raise IOError("stream: lost block alignment")
+                    traces.append(self._read_block())
+            except Exception:
+                self.ser.write(b"stop stream\n")
+                time.sleep(0.5)
+                self.ser.reset_input_buffer()
+                raise
+            self.ser.write(b"stop stream\n")
+            # Blocks already on their way precede the stop reply.
+            head = self._read_exact(4)
+            while head == BIN_MAGIC:
+                self._read_block()
+                head = self._read_exact(4)
+            reply = head + self.ser.read_until(PROMPT)
+            match = re.search(rb"(\d+) skipped", reply)
+            self.stream_skipped = int(match.group(1)) if match else 0
+            return np.stack(traces)
+        finally:
+            self.ser.timeout = timeout
+
+    def _stream_frames(self, prf, count, pon, poff, damp):
+        """onboard_dsp: a credit stream of exactly `count` raw frames."""
+        self.pulse_config(pon, poff, damp)
+        granted = min(count, CREDIT_LIMIT)
+        reply = self.command(f"stream start raw {int(prf)} credit {granted}")[-1]
+        if not reply.startswith(b"OK"):
+            raise IOError("stream start: " + reply.decode("ascii", "replace").strip())
+        traces = []
+        try:
+            while len(traces) < count:
+                # Keep credit ahead of the reader on very long streams.
+                if granted < count and granted - len(traces) < CREDIT_LIMIT // 2:
+                    more = min(count - granted, CREDIT_LIMIT // 2)
+                    self.ser.write(f"credit {more}\n".encode("ascii"))
+                    granted += more
+                header, data = self.read_frame(2.0 / prf + 1.0)
+                if header["payload_type"] != PAYLOAD_RAW:
+                    raise IOError("stream: unexpected payload type "
+                                  f"{header['payload_type']}")
+                traces.append(np.frombuffer(data, dtype="<u2").copy())
+        except Exception:
+            self.ser.write(b"stream stop\n")
+            time.sleep(0.5)
+            self.ser.reset_input_buffer()
+            self._rx.clear()
+            raise
+        # Every credited frame has been read, so only the reply follows.
+        reply = self.command("stream stop")[-1]
+        match = re.search(rb"drops=(\d+)", reply)
+        self.stream_skipped = int(match.group(1)) if match else 0
+        return np.stack(traces)
+
     def pulse_adc_trigger(self, pon: int=200,poff:int=200,damp:int=2000):
-        self.ser.write(bytearray("start acq "+str(pon)+" "+str(poff)+" "+str(damp)+"\n",'ascii'))
-        ans = self.sread()
-        return ans
+        """Pulse and acquire one trace (start acq); durations in ns.
+
+        The legacy firmware replies once the acquisition has ended.
+        onboard_dsp takes pon and poff as the negative and positive
+        half-cycles of "pulse config", replies as soon as the capture is
+        queued, and needs command("pulser arm") first.
+        """
+        if self.firmware == ONBOARD_DSP:
+            self.pulse_config(pon, poff, damp)
+        return self.command(f"start acq {pon} {poff} {damp}", timeout=5.0)
+
+    def pulse_config(self, pon: int=200, poff: int=200, damp: int=2000):
+        """Set the onboard_dsp pulse without acquiring (pulse config)."""
+        return self.command(f"pulse config {pon} {damp} {poff} neg-first")
 
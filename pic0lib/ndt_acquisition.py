@@ -4,11 +4,16 @@ Ultrasonic NDT pulse-echo acquisition.
 Bundles a captured signal with all of its acquisition parameters
 (Fech, pulse settings, gain, target description), provides a labelled
 (15, 5) plot, and saves/loads batches to HDF5.
+
+`acquire_batch` takes N traces per setting of a parameter grid in one
+device session and returns them stacked in an `AcquisitionBatch`.
 """
 
 from __future__ import annotations
 
+import itertools
 import json
+import time
 from dataclasses import dataclass, field
 from datetime import datetime
 from typing import Iterable, List, Optional
@@ -381,11 +386,7 @@ class UltrasonicAcquisition:
             probe = get_probe()
         probe.dac(gain)
         probe.pulse_adc_trigger(pon=pon, poff=poff, damp=damp)
-        C = probe.read()
-        raw = [x.replace("b'", "") for x in str(C[2]).split(",") if len(x)]
-        signal = np.array(
-            [(int(x, 16) - 512) / 512.0 for x in raw[:-1]], dtype=np.float32
-        )
+        signal = _normalize(probe.read_samples())
         a = cls(
             signal=signal, Fech=Fech,
             pon=pon, poff=poff, damp=damp,
@@ -420,7 +421,7 @@ class UltrasonicAcquisition:
             return summary
 
         with h5:
-            names = list(h5)
+            names = [n for n in h5 if n != _BATCH_GROUP]
             gains = sorted({float(_attr(h5[n], "gain")) for n in names})
             targets = sorted({str(_attr(h5[n], "target")) for n in names})
 
@@ -469,20 +470,46 @@ class UltrasonicAcquisition:
         the optimum.
         """
         values = list(pon_poff_values)
-        amps = np.empty(len(values))
-        acqs: List[UltrasonicAcquisition] = []
-
+        acqs: List[Optional[UltrasonicAcquisition]] = [None] * len(values)
+        dirty: List[UltrasonicAcquisition] = []
+
+        # Cached values are reused, like from_probe; the rest are taken
+        # in one batch and the file is written once.
+        cached = {}
+        if not overwrite:
+            try:
+                cached = {a.key: a for a in load_h5(h5_path)}
+            except (FileNotFoundError, OSError):
+                pass
         for i, p in enumerate(values):
-            a = cls.from_probe(
-                Fech=Fech, probe=probe, gain=gain,
-                pon=p, poff=p, damp=damp, target=target,
+            a = cached.get((round(float(gain), 6), int(p), int(p),
+                            int(damp), str(target), str(piezo_id)))
+            if a is None:
+                continue
+            if (a.piezo_central_freq != piezo_central_freq
+                    or a.piezo_bandwidth != piezo_bandwidth):
+                a.piezo_central_freq = piezo_central_freq
+                a.piezo_bandwidth = piezo_bandwidth
+                dirty.append(a)
+            acqs[i] = a
+
+        missing = [i for i, a in enumerate(acqs) if a is None]
+        if missing:
+            batch = acquire_batch(
+                Fech, probe=probe, gain=gain, damp=damp, target=target,
+                grid=[{"pon": values[i], "poff": values[i]} for i in missing],
                 piezo_id=piezo_id,
                 piezo_central_freq=piezo_central_freq,
                 piezo_bandwidth=piezo_bandwidth,
-                h5_path=h5_path, overwrite=overwrite,
             )
-            amps[i] = a.amplitude(start_us, end_us)
-            acqs.append(a)
+            for i, a in zip(missing, batch.acquisitions()):
+                a.h5_path = h5_path
+                acqs[i] = a
+                dirty.append(a)
+        if dirty:
+            save_h5(h5_path, dirty)
+
+        amps = np.array([a.amplitude(start_us, end_us) for a in acqs])
 
         i_max = int(np.argmax(amps))
         i_min = int(np.argmin(amps))
@@ -586,6 +613,189 @@ class UltrasonicAcquisition:
         return ax
 
 
+# --------------------------------------------------------------------------- #
+#  Batch acquisition                                                          #
+# --------------------------------------------------------------------------- #
+
+# Per-trace settings of a batch; `shot` counts repeats of one setting and
+# `t_s` is when its setting's traces were read, from the batch start [s].
+BATCH_DTYPE = np.dtype([
+    ("gain", "<f8"),
+    ("pon",  "<i4"),
+    ("poff", "<i4"),
+    ("damp", "<i4"),
+    ("shot", "<i4"),
+    ("t_s",  "<f8"),
+])
+
+_GRID_KEYS = ("gain", "pon", "poff", "damp")
+
+
+def _normalize(codes: np.ndarray) -> np.ndarray:
+    """10-bit ADC codes -> echo in ~[-1, 1]."""
+    return (codes.astype(np.float32) - 512) / 512.0
+
+
+def param_grid(**axes) -> List[dict]:
+    """
+    Cartesian product of settings, e.g.
+    param_grid(gain=[10, 20], pon=[50, 70]) -> 4 dicts for `acquire_batch`.
+    """
+    unknown = set(axes) - set(_GRID_KEYS)
+    if unknown:
+        raise ValueError(f"Unknown grid axes: {sorted(unknown)}")
+    names = list(axes)
+    return [dict(zip(names, combo))
+            for combo in itertools.product(*(axes[n] for n in names))]
+
+
+@dataclass
+class AcquisitionBatch:
+    """Traces taken in one device session, stacked along axis 0."""
+
+    signals: np.ndarray           # (n_traces, n_samples), normalized
+    params:  np.ndarray           # BATCH_DTYPE record per trace
+    Fech:    float                # sampling frequency [Hz]
+    target:  str = ""
+    timestamp: str = field(
+        default_factory=lambda: datetime.now().isoformat(timespec="seconds")
+    )
+    piezo_id:           str = ""
+    piezo_central_freq: Optional[float] = None
+    piezo_bandwidth:    Optional[float] = None
+
+    def __len__(self) -> int:
+        return len(self.signals)
+
+    def acquisition(self, i: int) -> UltrasonicAcquisition:
+        """Trace `i` as a standalone acquisition (signal is a view)."""
+        p = self.params[i]
+        return UltrasonicAcquisition(
+            signal=self.signals[i], Fech=self.Fech,
+            pon=int(p["pon"]), poff=int(p["poff"]), damp=int(p["damp"]),
+            gain=float(p["gain"]), target=self.target,
+            timestamp=self.timestamp,
+            piezo_id=self.piezo_id,
+            piezo_central_freq=self.piezo_central_freq,
+            piezo_bandwidth=self.piezo_bandwidth,
+        )
+
+    def acquisitions(self) -> List[UltrasonicAcquisition]:
+        return [self.acquisition(i) for i in range(len(self))]
+
+    def select(self, **settings) -> np.ndarray:
+        """Indices of the traces matching settings, e.g. select(pon=70)."""
+        mask = np.ones(len(self), dtype=bool)
+        for k, v in settings.items():
+            mask &= self.params[k] == v
+        return np.flatnonzero(mask)
+
+    def save(self, h5_path: str) -> str:
+        """
+        Write the whole batch to `h5_path` as one group under "batches/"
+        (stacked signals plus the per-trace table) and return its name.
+        Per-trace entries written by `save_h5` are left alone.
+        """
+        with h5py.File(h5_path, "a") as h5:
+            root = h5.require_group(_BATCH_GROUP)
+            i = 0
+            while f"batch_{i:04d}" in root:
+                i += 1
+            g = root.create_group(f"batch_{i:04d}")
+            g.create_dataset("signals", data=self.signals,
+                             compression="gzip")
+            g.create_dataset("params", data=self.params)
+            for k in _BATCH_ATTRS:
+                v = getattr(self, k)
+                if v is not None:
+                    g.attrs[k] = v
+            return g.name
+
+
+def _acquire_shots(probe, n: int, pon: int, poff: int, damp: int,
+                   prf: float) -> np.ndarray:
+    """Take `n` traces at one pulse setting; (n, samples) ADC codes."""
+    from pic0lib.device import ONBOARD_DSP, StreamUnsupported  # lazy import
+    if n > 1:
+        try:
+            return probe.stream(prf, n, pon=pon, poff=poff, damp=damp)
+        except StreamUnsupported:
+            pass  # legacy firmware without "start stream": single shots
+    if probe.firmware == ONBOARD_DSP:
+        probe.pulse_config(pon, poff, damp)
+        return np.stack([probe.acquire_frame()[1] for _ in range(n)])
+    rows = []
+    for _ in range(n):
+        probe.pulse_adc_trigger(pon=pon, poff=poff, damp=damp)
+        rows.append(probe.read_samples())
+    return np.stack(rows)
+
+
+def acquire_batch(
+    Fech: float,
+    *,
+    n: int = 1,
+    grid: Optional[Iterable[dict]] = None,
+    probe=None,
+    pon: int = 70,
+    poff: int = 70,
+    damp: int = 6000,
+    gain: float = 20,
+    prf: float = 100,
+    target: str = "",
+    piezo_id: str = "",
+    piezo_central_freq: Optional[float] = None,
+    piezo_bandwidth: Optional[float] = None,
+    h5_path: Optional[str] = None,
+) -> AcquisitionBatch:
+    """
+    Acquire `n` traces for every point of `grid` in one device session.
+
+    `grid`   : dicts overriding any of gain / pon / poff / damp (see
+               `param_grid`); None means the single point given by the
+               scalar arguments.
+    `prf`    : shot rate of the burst used when n > 1: "start stream" on
+               the legacy firmware, a raw credit stream of n frames on
+               onboard_dsp.
+    `h5_path`: if given, the batch is written there once, at the end.
+
+    The DAC is only written when the gain changes between points.
+    """
+    if n < 1:
+        raise ValueError("n must be at least 1.")
+    base = {"gain": gain, "pon": pon, "poff": poff, "damp": damp}
+    points = [dict(base, **pt) for pt in (grid if grid is not None else [{}])]
+    if probe is None:
+        probe = get_probe()
+
+    signals = []
+    params = np.empty(n * len(points), dtype=BATCH_DTYPE)
+    t0 = time.monotonic()
+    last_gain = None
+    for j, pt in enumerate(points):
+        if pt["gain"] != last_gain:
+            probe.dac(pt["gain"])
+            last_gain = pt["gain"]
+        codes = _acquire_shots(probe, n, int(pt["pon"]), int(pt["poff"]),
+                               int(pt["damp"]), prf)
+        rows = params[j * n:(j + 1) * n]
+        for k in _GRID_KEYS:
+            rows[k] = pt[k]
+        rows["shot"] = np.arange(n)
+        rows["t_s"] = time.monotonic() - t0
+        signals.append(_normalize(codes))
+
+    batch = AcquisitionBatch(
+        signals=np.concatenate(signals), params=params, Fech=Fech,
+        target=target, piezo_id=piezo_id,
+        piezo_central_freq=piezo_central_freq,
+        piezo_bandwidth=piezo_bandwidth,
+    )
+    if h5_path is not None:
+        batch.save(h5_path)
+    return batch
+
+
 # --------------------------------------------------------------------------- #
 #  HDF5 I/O                                                                   #
 # --------------------------------------------------------------------------- #
@@ -596,6 +806,14 @@ _SCALAR_ATTRS = (
 )
 
 
+# Batches live under this group; per-trace readers skip it.
+_BATCH_GROUP = "batches"
+_BATCH_ATTRS = (
+    "Fech", "target", "timestamp",
+    "piezo_id", "piezo_central_freq", "piezo_bandwidth",
+)
+
+
 def _attr(g, name):
     """Read an HDF5 attr, decoding bytes if needed."""
     v = g.attrs[name]
@@ -637,23 +855,28 @@ def _find_group_by_key(h5, key) -> Optional[str]:
     return None
 
 
+def _write_group(h5, a: "UltrasonicAcquisition") -> None:
+    """Add `a` to an open file, replacing any entry with the same key."""
+    match = _find_group_by_key(h5, a.key)
+    if match is not None:
+        del h5[match]
+    i = 0
+    while f"acq_{i:04d}" in h5:
+        i += 1
+    g = h5.create_group(f"acq_{i:04d}")
+    g.create_dataset("signal", data=np.asarray(a.signal),
+                     compression="gzip")
+    for k in _SCALAR_ATTRS:
+        v = getattr(a, k)
+        if v is None:
+            continue  # optional fields (e.g. piezo_*) omitted when unset
+        g.attrs[k] = v
+
+
 def _write_one(path: str, a: "UltrasonicAcquisition") -> None:
     """Append `a` to `path`, replacing any entry with the same key."""
     with h5py.File(path, "a") as h5:
-        match = _find_group_by_key(h5, a.key)
-        if match is not None:
-            del h5[match]
-        i = 0
-        while f"acq_{i:04d}" in h5:
-            i += 1
-        g = h5.create_group(f"acq_{i:04d}")
-        g.create_dataset("signal", data=np.asarray(a.signal),
-                         compression="gzip")
-        for k in _SCALAR_ATTRS:
-            v = getattr(a, k)
-            if v is None:
-                continue  # optional fields (e.g. piezo_*) omitted when unset
-            g.attrs[k] = v
+        _write_group(h5, a)
 
 
 def _load_by_key(path: str, key: tuple) -> Optional["UltrasonicAcquisition"]:
@@ -695,11 +918,9 @@ def save_h5(
     replaces any prior entry with a matching key. Pass `overwrite_file=True`
     to wipe the file first.
     """
-    if overwrite_file:
-        with h5py.File(path, "w"):
-            pass
-    for a in acquisitions:
-        _write_one(path, a)
+    with h5py.File(path, "w" if overwrite_file else "a") as h5:
+        for a in acquisitions:
+            _write_group(h5, a)
 
 
 def load_h5(path: str) -> List["UltrasonicAcquisition"]:
@@ -707,6 +928,8 @@ def load_h5(path: str) -> List["UltrasonicAcquisition"]:
     out: List[UltrasonicAcquisition] = []
     with h5py.File(path, "r") as h5:
         for name in sorted(h5):
+            if name == _BATCH_GROUP:
+                continue
             g = h5[name]
             out.append(UltrasonicAcquisition(
                 signal=g["signal"][:],
@@ -722,4 +945,26 @@ def load_h5(path: str) -> List["UltrasonicAcquisition"]:
                 piezo_central_freq=_opt_float(_attr_or(g, "piezo_central_freq")),
                 piezo_bandwidth=_opt_float(_attr_or(g, "piezo_bandwidth")),
             ))
-    return out
\ No newline at end of file
+    return out
+
+
+def load_batches(path: str) -> List[AcquisitionBatch]:
+    """Load every batch written by `AcquisitionBatch.save`, oldest first."""
+    out: List[AcquisitionBatch] = []
+    with h5py.File(path, "r") as h5:
+        if _BATCH_GROUP not in h5:
+            return out
+        root = h5[_BATCH_GROUP]
+        for name in sorted(root):
+            g = root[name]
+            out.append(AcquisitionBatch(
+                signals=g["signals"][:],
+                params=g["params"][:],
+                Fech=float(_attr(g, "Fech")),
+                target=str(_attr(g, "target")),
+                timestamp=str(_attr(g, "timestamp")),
+                piezo_id=str(_attr_or(g, "piezo_id", "")),
+                piezo_central_freq=_opt_float(_attr_or(g, "piezo_central_freq")),
+                piezo_bandwidth=_opt_float(_attr_or(g, "piezo_bandwidth")),
+            ))
+    return out